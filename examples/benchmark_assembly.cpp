@@ -0,0 +1,134 @@
+/**
+ * @file benchmark_assembly.cpp
+ * @brief Compares the direct (scatter) assembly of the data matrix Q against
+ * the previous approach of forming Q from sparse-sparse products of the data
+ * submatrices. Besides the timings we report the number of nonzeros held by
+ * the intermediate products, which dominates the peak memory of the product
+ * path, and check that both paths agree.
+ */
+
+#include <CORA/CORA_problem.h>
+#include <CORA/pyfg_text_parser.h>
+
+#include <string>
+#include <vector>
+
+#include <benchmark_utils.h>
+
+using CORA::Index;
+using CORA::Scalar;
+using CORA::SparseMatrix;
+
+namespace {
+
+constexpr int kNumReps = 10;
+
+/** Assembles Q from the data submatrices via sparse-sparse products (the way
+ * the data matrix used to be built). Returns the total number of nonzeros of
+ * the intermediate products through num_temp_nonzeros */
+SparseMatrix assembleFromProducts(const CORA::CoraDataSubmatrices &sub,
+                                  Index rot_mat_sz, Index rot_range_mat_sz,
+                                  Index data_matrix_size,
+                                  Index &num_temp_nonzeros) {
+  SparseMatrix Q11 = sub.rotation_conn_laplacian +
+                     sub.rel_pose_translation_data_matrix.transpose() *
+                         sub.rel_pose_translation_precision_matrix *
+                         sub.rel_pose_translation_data_matrix;
+  SparseMatrix Q13 = sub.rel_pose_translation_data_matrix.transpose() *
+                     sub.rel_pose_translation_precision_matrix *
+                     sub.rel_pose_incidence_matrix;
+  SparseMatrix OmegaRD = sub.range_precision_matrix * sub.range_dist_matrix;
+  SparseMatrix Q22 = OmegaRD * sub.range_dist_matrix;
+  SparseMatrix Q23 = OmegaRD * sub.range_incidence_matrix;
+  SparseMatrix Q33 = (sub.rel_pose_incidence_matrix.transpose() *
+                      sub.rel_pose_translation_precision_matrix *
+                      sub.rel_pose_incidence_matrix) +
+                     (sub.range_incidence_matrix.transpose() *
+                      sub.range_precision_matrix * sub.range_incidence_matrix);
+
+  std::vector<Eigen::Triplet<Scalar>> triplets;
+  triplets.reserve(Q11.nonZeros() + 2 * Q13.nonZeros() + Q22.nonZeros() +
+                   2 * Q23.nonZeros() + Q33.nonZeros());
+  auto addTriplets = [&triplets](const SparseMatrix &matrix, Index row_offset,
+                                 Index col_offset, bool transpose) {
+    for (int k = 0; k < matrix.outerSize(); ++k) {
+      for (SparseMatrix::InnerIterator it(matrix, k); it; ++it) {
+        if (transpose) {
+          triplets.emplace_back(it.col() + row_offset, it.row() + col_offset,
+                                it.value());
+        } else {
+          triplets.emplace_back(it.row() + row_offset, it.col() + col_offset,
+                                it.value());
+        }
+      }
+    }
+  };
+  addTriplets(Q11, 0, 0, false);
+  addTriplets(Q13, 0, rot_range_mat_sz, false);
+  addTriplets(Q13, rot_range_mat_sz, 0, true);
+  addTriplets(Q22, rot_mat_sz, rot_mat_sz, false);
+  addTriplets(Q23, rot_mat_sz, rot_range_mat_sz, false);
+  addTriplets(Q23, rot_range_mat_sz, rot_mat_sz, true);
+  addTriplets(Q33, rot_range_mat_sz, rot_range_mat_sz, false);
+
+  SparseMatrix Q(data_matrix_size, data_matrix_size);
+  Q.setFromTriplets(triplets.begin(), triplets.end());
+
+  num_temp_nonzeros = Q11.nonZeros() + Q13.nonZeros() + OmegaRD.nonZeros() +
+                      Q22.nonZeros() + Q23.nonZeros() + Q33.nonZeros() +
+                      static_cast<Index>(triplets.size());
+  return Q;
+}
+
+void benchmarkAssembly(const std::string &pyfg_fpath) {
+  CORA::benchmark::printHeader(pyfg_fpath);
+  CORA::Problem problem = CORA::parsePyfgTextToProblem(
+      CORA::benchmark::resolvePyfgPath(pyfg_fpath));
+
+  // the Jacobi preconditioner is essentially free, so updateProblemData() is
+  // dominated by the assembly of the data matrix
+  problem.setPreconditioner(CORA::Preconditioner::Jacobi);
+
+  double scatter_time =
+      CORA::benchmark::timeAverage([&]() { problem.updateProblemData(); },
+                                   kNumReps);
+  SparseMatrix Q_scatter = problem.getDataMatrix();
+
+  // the product path is charged for building the submatrices as well, as
+  // both paths start from the measurements
+  Index num_temp_nonzeros = 0;
+  SparseMatrix Q_products;
+  double products_time = CORA::benchmark::timeAverage(
+      [&]() {
+        Q_products = assembleFromProducts(
+            problem.getDataSubmatrices(), problem.numPosesDim(),
+            problem.rotAndRangeMatrixSize(), problem.getDataMatrixSize(),
+            num_temp_nonzeros);
+      },
+      kNumReps);
+
+  Scalar max_abs_diff =
+      SparseMatrix(Q_scatter - Q_products).coeffs().cwiseAbs().maxCoeff();
+
+  std::cout << "Q: " << Q_scatter.rows() << " x " << Q_scatter.cols() << ", "
+            << Q_scatter.nonZeros() << " nonzeros" << std::endl;
+  std::cout << std::setw(12) << "path" << std::setw(14) << "time [ms]"
+            << std::setw(20) << "temp. nonzeros" << std::endl;
+  std::cout << std::setw(12) << "scatter" << std::setw(14)
+            << scatter_time * 1e3 << std::setw(20) << 0 << std::endl;
+  std::cout << std::setw(12) << "products" << std::setw(14)
+            << products_time * 1e3 << std::setw(20) << num_temp_nonzeros
+            << std::endl;
+  std::cout << "speedup: " << products_time / scatter_time
+            << "x, max |Q_scatter - Q_products|: " << max_abs_diff
+            << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  for (const auto &file : CORA::benchmark::getBenchmarkFiles(
+           argc, argv, {"data/plaza1.pyfg", "data/tiers.pyfg"})) {
+    benchmarkAssembly(file);
+  }
+}
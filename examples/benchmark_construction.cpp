@@ -0,0 +1,100 @@
+/**
+ * @file benchmark_construction.cpp
+ * @brief Measures how the cost of building a CORA::Problem scales with the
+ * number of measurements. For each data set we rebuild the problem from
+ * increasing prefixes of its measurements and report the time per
+ * measurement, which should stay roughly constant if construction is O(m).
+ */
+
+#include <CORA/CORA_problem.h>
+#include <CORA/pyfg_text_parser.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <benchmark_utils.h>
+
+using CORA::benchmark::timeOnce;
+
+namespace {
+
+std::vector<CORA::Symbol>
+getSymbolsInIndexOrder(const std::map<CORA::Symbol, int> &symbol_idxs) {
+  std::vector<CORA::Symbol> symbols(symbol_idxs.size(), CORA::Symbol('?', 0));
+  for (const auto &[sym, idx] : symbol_idxs) {
+    symbols[idx] = sym;
+  }
+  return symbols;
+}
+
+void benchmarkConstructionScaling(const std::string &pyfg_fpath) {
+  CORA::benchmark::printHeader(pyfg_fpath);
+
+  auto start = CORA::benchmark::Clock::now();
+  CORA::Problem full_problem = CORA::parsePyfgTextToProblem(
+      CORA::benchmark::resolvePyfgPath(pyfg_fpath));
+  double parse_time = CORA::benchmark::secondsSince(start);
+  std::cout << "Parsed " << full_problem.numPoses() << " poses, "
+            << full_problem.numLandmarks() << " landmarks, "
+            << full_problem.numPosePoseMeasurements()
+            << " relative pose measurements and "
+            << full_problem.numRangeMeasurements() << " range measurements in "
+            << parse_time << " s" << std::endl;
+
+  auto poses = getSymbolsInIndexOrder(full_problem.getPoseSymbolMap());
+  auto landmarks = getSymbolsInIndexOrder(full_problem.getLandmarkSymbolMap());
+  auto rpms = full_problem.getRPMs();
+  auto ranges = full_problem.getRangeMeasurements();
+
+  std::cout << std::setw(10) << "fraction" << std::setw(14) << "#measures"
+            << std::setw(14) << "add [ms]" << std::setw(18) << "per meas. [us]"
+            << std::setw(20) << "range lookup [us]" << std::endl;
+  for (double fraction : {0.125, 0.25, 0.5, 1.0}) {
+    size_t num_rpms = static_cast<size_t>(fraction * rpms.size());
+    size_t num_ranges = static_cast<size_t>(fraction * ranges.size());
+
+    CORA::Problem problem(full_problem.dim(), full_problem.dim());
+    for (const auto &pose : poses) {
+      problem.addPoseVariable(pose);
+    }
+    for (const auto &landmark : landmarks) {
+      problem.addLandmarkVariable(landmark);
+    }
+
+    double add_time = timeOnce([&]() {
+      for (size_t i = 0; i < num_rpms; i++) {
+        problem.addRelativePoseMeasurement(rpms[i]);
+      }
+      for (size_t i = 0; i < num_ranges; i++) {
+        problem.addRangeMeasurement(ranges[i]);
+      }
+    });
+
+    // every range variable is looked up once (e.g., when building an
+    // initialization)
+    CORA::Index idx_sum = 0;
+    double lookup_time = timeOnce([&]() {
+      for (size_t i = 0; i < num_ranges; i++) {
+        idx_sum += problem.getRangeIdx(ranges[i].getSymbolPair());
+      }
+    });
+
+    size_t num_measures = std::max<size_t>(num_rpms + num_ranges, 1);
+    std::cout << std::setw(10) << fraction << std::setw(14) << num_measures
+              << std::setw(14) << add_time * 1e3 << std::setw(18)
+              << add_time * 1e6 / num_measures << std::setw(20)
+              << lookup_time * 1e6 / std::max<size_t>(num_ranges, 1)
+              << std::endl;
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  for (const auto &file : CORA::benchmark::getBenchmarkFiles(argc, argv)) {
+    benchmarkConstructionScaling(file);
+  }
+}
@@ -0,0 +1,79 @@
+/**
+ * @file benchmark_hessian.cpp
+ * @brief Measures the time spent on Riemannian Hessian-vector products in one
+ * iteration of the trust-region solver, whose inner (truncated CG) loop
+ * performs up to max_TPCG_iterations products at the same iterate. We compare
+ * recomputing the Lagrange multiplier blocks in every product against
+ * computing them once per iterate and reusing them.
+ */
+
+#include <CORA/CORA_problem.h>
+#include <CORA/pyfg_text_parser.h>
+
+#include <string>
+
+#include <benchmark_utils.h>
+
+using CORA::Matrix;
+
+namespace {
+
+// the maximum number of inner iterations used by solveCORA
+constexpr int kNumHessianProducts = 80;
+constexpr int kNumReps = 5;
+
+void benchmarkHessianProducts(const std::string &pyfg_fpath) {
+  CORA::benchmark::printHeader(pyfg_fpath);
+  CORA::Problem problem = CORA::parsePyfgTextToProblem(
+      CORA::benchmark::resolvePyfgPath(pyfg_fpath));
+  // the preconditioner plays no part in Hessian-vector products
+  problem.setPreconditioner(CORA::Preconditioner::Jacobi);
+  problem.updateProblemData();
+
+  Matrix Y = problem.projectToManifold(problem.getRandomInitialGuess());
+  Matrix NablaF_Y = problem.Euclidean_gradient(Y);
+  Matrix Ydot = problem.tangent_space_projection(
+      Y, Matrix::Random(Y.rows(), Y.cols()));
+
+  Matrix HYdot;
+  double recompute_time = CORA::benchmark::timeAverage(
+      [&]() {
+        for (int i = 0; i < kNumHessianProducts; i++) {
+          HYdot = problem.Riemannian_Hessian_vector_product(Y, NablaF_Y, Ydot);
+        }
+      },
+      kNumReps);
+  Matrix HYdot_recompute = HYdot;
+
+  double reuse_time = CORA::benchmark::timeAverage(
+      [&]() {
+        auto Lambda_blocks = problem.compute_Lambda_blocks(Y, NablaF_Y);
+        for (int i = 0; i < kNumHessianProducts; i++) {
+          HYdot =
+              problem.Riemannian_Hessian_vector_product(Y, Lambda_blocks, Ydot);
+        }
+      },
+      kNumReps);
+
+  std::cout << "Y: " << Y.rows() << " x " << Y.cols() << ", "
+            << kNumHessianProducts << " Hessian-vector products per iterate"
+            << std::endl;
+  std::cout << std::setw(28) << "multiplier blocks" << std::setw(20)
+            << "per iterate [ms]" << std::endl;
+  std::cout << std::setw(28) << "recomputed per product" << std::setw(20)
+            << recompute_time * 1e3 << std::endl;
+  std::cout << std::setw(28) << "computed once per iterate" << std::setw(20)
+            << reuse_time * 1e3 << std::endl;
+  std::cout << "speedup: " << recompute_time / reuse_time
+            << "x, max |difference|: "
+            << (HYdot - HYdot_recompute).cwiseAbs().maxCoeff() << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  for (const auto &file : CORA::benchmark::getBenchmarkFiles(
+           argc, argv, {"data/plaza1.pyfg", "data/tiers.pyfg"})) {
+    benchmarkHessianProducts(file);
+  }
+}
@@ -0,0 +1,137 @@
+/**
+ * @file benchmark_layout.cpp
+ * @brief Measures the heap allocations and time of the manifold operations in
+ * one inner (truncated CG) iteration of the trust-region solver: a Riemannian
+ * Hessian-vector product followed by a tangent space projection. We compare
+ * passing transposed copies of the rotation and range blocks to the manifolds
+ * (and transposing their results back) against operating on the layout of the
+ * variables directly.
+ */
+
+#include <CORA/CORA_problem.h>
+#include <CORA/ObliqueManifold.h>
+#include <CORA/StiefelProduct.h>
+#include <CORA/pyfg_text_parser.h>
+
+#include <string>
+
+#include <allocation_counter.h>
+#include <benchmark_utils.h>
+
+using CORA::Matrix;
+
+namespace {
+
+constexpr int kNumIterations = 80;
+constexpr int kNumReps = 5;
+
+void benchmarkLayout(const std::string &pyfg_fpath) {
+  CORA::benchmark::printHeader(pyfg_fpath);
+  CORA::Problem problem = CORA::parsePyfgTextToProblem(
+      CORA::benchmark::resolvePyfgPath(pyfg_fpath));
+  problem.setPreconditioner(CORA::Preconditioner::Jacobi);
+  problem.updateProblemData();
+
+  Matrix Y = problem.projectToManifold(problem.getRandomInitialGuess());
+  Matrix Ydot = problem.tangent_space_projection(
+      Y, Matrix::Random(Y.rows(), Y.cols()));
+  auto Lambda_blocks =
+      problem.compute_Lambda_blocks(Y, problem.Euclidean_gradient(Y));
+
+  int p = Y.cols();
+  int rot_mat_sz = problem.numPosesDim();
+  int r = problem.numRangeMeasurements();
+  CORA::StiefelProduct stiefel(problem.dim(), p, problem.numPoses());
+  CORA::ObliqueManifold oblique(p, r);
+
+  // the manifold operations as they were done before, on transposed copies
+  auto transposed_iteration = [&]() {
+    Matrix H = problem.Euclidean_gradient(Ydot);
+    H.topRows(rot_mat_sz) =
+        stiefel
+            .projectToTangentSpace(
+                Y.topRows(rot_mat_sz).transpose(),
+                H.topRows(rot_mat_sz).transpose() -
+                    stiefel.BlockDiagProduct(
+                        Ydot.topRows(rot_mat_sz).transpose(),
+                        Lambda_blocks.first))
+            .transpose();
+    Matrix weighted_Ydot = Ydot.middleRows(rot_mat_sz, r).array().colwise() *
+                           Lambda_blocks.second.array();
+    H.middleRows(rot_mat_sz, r) =
+        oblique
+            .projectToTangentSpace(
+                Y.middleRows(rot_mat_sz, r).transpose(),
+                (H.middleRows(rot_mat_sz, r) - weighted_Ydot).transpose())
+            .transpose();
+
+    Matrix V = H;
+    V.topRows(rot_mat_sz) =
+        stiefel
+            .projectToTangentSpace(Y.topRows(rot_mat_sz).transpose(),
+                                   V.topRows(rot_mat_sz).transpose())
+            .transpose();
+    V.middleRows(rot_mat_sz, r) =
+        oblique
+            .projectToTangentSpace(Y.middleRows(rot_mat_sz, r).transpose(),
+                                   V.middleRows(rot_mat_sz, r).transpose())
+            .transpose();
+    return V;
+  };
+
+  // the same operations on the layout of the variables
+  auto native_iteration = [&]() {
+    return problem.tangent_space_projection(
+        Y,
+        problem.Riemannian_Hessian_vector_product(Y, Lambda_blocks, Ydot));
+  };
+
+  Matrix V_transposed, V_native;
+  size_t transposed_allocs = CORA::heap::countAllocations(
+      [&]() { V_transposed = transposed_iteration(); });
+  size_t native_allocs = CORA::heap::countAllocations(
+      [&]() { V_native = native_iteration(); });
+
+  double transposed_time = CORA::benchmark::timeAverage(
+      [&]() {
+        for (int i = 0; i < kNumIterations; i++) {
+          V_transposed = transposed_iteration();
+        }
+      },
+      kNumReps);
+  double native_time = CORA::benchmark::timeAverage(
+      [&]() {
+        for (int i = 0; i < kNumIterations; i++) {
+          V_native = native_iteration();
+        }
+      },
+      kNumReps);
+
+  std::cout << "Y: " << Y.rows() << " x " << Y.cols() << ", "
+            << kNumIterations << " inner iterations" << std::endl;
+  if (!CORA::heap::countsAllocations()) {
+    std::cout << "(allocations are not counted on this platform)"
+              << std::endl;
+  }
+  std::cout << std::setw(28) << "manifold operations" << std::setw(20)
+            << "allocations/iter" << std::setw(20) << "total [ms]"
+            << std::endl;
+  std::cout << std::setw(28) << "on transposed copies" << std::setw(20)
+            << transposed_allocs << std::setw(20) << transposed_time * 1e3
+            << std::endl;
+  std::cout << std::setw(28) << "on the variable layout" << std::setw(20)
+            << native_allocs << std::setw(20) << native_time * 1e3
+            << std::endl;
+  std::cout << "speedup: " << transposed_time / native_time
+            << "x, max |difference|: "
+            << (V_native - V_transposed).cwiseAbs().maxCoeff() << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  for (const auto &file : CORA::benchmark::getBenchmarkFiles(
+           argc, argv, {"data/plaza1.pyfg", "data/tiers.pyfg"})) {
+    benchmarkLayout(file);
+  }
+}
@@ -0,0 +1,120 @@
+/**
+ * @file benchmark_matrix_free.cpp
+ * @brief Compares the memory and the throughput of the products Q*Y of the
+ * data matrix assembled in CSR format (DataMatrixOperator::Assembled) against
+ * the products computed directly from the measurement edges
+ * (DataMatrixOperator::MatrixFree), for each relaxation rank. The products are
+ * timed through Problem::Euclidean_gradient(), alternating between two points
+ * so that the cached product is never reused, with a single thread and with
+ * every hardware thread. The time taken to color the edges
+ * (MatrixFreeDataMatrix::finalize()) is reported as well.
+ */
+
+#include <CORA/CORA_parallel.h>
+#include <CORA/CORA_problem.h>
+#include <CORA/pyfg_text_parser.h>
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <benchmark_utils.h>
+
+using CORA::Matrix;
+
+namespace {
+
+constexpr int kNumProducts = 100;
+constexpr int kNumReps = 5;
+
+// the bytes of a compressed CSR matrix with 32-bit indices
+size_t getCsrMemoryUsage(const CORA::SparseMatrix &A) {
+  return A.nonZeros() * (sizeof(CORA::Scalar) + sizeof(int)) +
+         (A.outerSize() + 1) * sizeof(int);
+}
+
+double timeGradients(const CORA::Problem &problem, const Matrix &Y0,
+                     const Matrix &Y1, Matrix &gradient) {
+  return CORA::benchmark::timeAverage(
+      [&]() {
+        for (int i = 0; i < kNumProducts; i++) {
+          problem.Euclidean_gradient(i % 2 == 0 ? Y0 : Y1, gradient);
+        }
+      },
+      kNumReps);
+}
+
+void benchmarkMatrixFree(const std::string &pyfg_fpath) {
+  CORA::benchmark::printHeader(pyfg_fpath);
+  const std::string resolved_fpath =
+      CORA::benchmark::resolvePyfgPath(pyfg_fpath);
+  CORA::Problem assembled_problem =
+      CORA::parsePyfgTextToProblem(resolved_fpath);
+  assembled_problem.setPreconditioner(CORA::Preconditioner::Jacobi);
+  assembled_problem.updateProblemData();
+  CORA::Problem free_problem = CORA::parsePyfgTextToProblem(
+      resolved_fpath, CORA::DataMatrixOperator::MatrixFree);
+  free_problem.setPreconditioner(CORA::Preconditioner::Jacobi);
+  free_problem.updateProblemData();
+
+  const size_t csr_bytes = getCsrMemoryUsage(assembled_problem.data_matrix_);
+  const size_t edge_bytes = free_problem.matrixFreeMemoryUsage();
+  std::cout << "Q: " << assembled_problem.data_matrix_.rows() << " x "
+            << assembled_problem.data_matrix_.cols() << ", "
+            << assembled_problem.data_matrix_.nonZeros() << " nonzeros, "
+            << kNumProducts << " products" << std::endl;
+  std::cout << "CSR: " << csr_bytes / 1024.0 << " KiB, edges: "
+            << edge_bytes / 1024.0 << " KiB (" << std::setprecision(3)
+            << static_cast<double>(edge_bytes) / csr_bytes << "x)"
+            << std::endl;
+
+  // recolor a copy of the (already sorted) edges
+  CORA::MatrixFreeDataMatrix edges = free_problem.getMatrixFreeDataMatrix();
+  double finalize_time = CORA::benchmark::timeOnce([&]() { edges.finalize(); });
+  std::cout << "finalize: " << finalize_time * 1e3 << " ms, "
+            << edges.numColors() << " colors, " << edges.numUncoloredRows()
+            << " rows summed per thread" << std::endl;
+
+  std::vector<int> thread_counts = {1};
+  const int hardware_threads =
+      std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  if (hardware_threads > 1) {
+    thread_counts.push_back(hardware_threads);
+  }
+  std::cout << std::setw(8) << "threads" << std::setw(8) << "rank"
+            << std::setw(16) << "CSR [ms]" << std::setw(16) << "free [ms]"
+            << std::setw(12) << "speedup" << std::setw(16) << "max |diff|"
+            << std::endl;
+  for (int num_threads : thread_counts) {
+    CORA::setNumThreads(num_threads);
+    for (int rank = assembled_problem.dim();
+         rank <= CORA::kMaxThinProductCols + 2; rank++) {
+      const int rows = assembled_problem.getExpectedVariableSize();
+      Matrix Y0 = Matrix::Random(rows, rank);
+      Matrix Y1 = Matrix::Random(rows, rank);
+      Matrix assembled_gradient, free_gradient;
+
+      double assembled_time =
+          timeGradients(assembled_problem, Y0, Y1, assembled_gradient);
+      double free_time = timeGradients(free_problem, Y0, Y1, free_gradient);
+
+      std::cout << std::setw(8) << CORA::getNumThreads() << std::setw(8) << rank
+                << std::setw(16) << assembled_time * 1e3 << std::setw(16)
+                << free_time * 1e3 << std::setw(12)
+                << assembled_time / free_time << std::setw(16)
+                << (free_gradient - assembled_gradient).cwiseAbs().maxCoeff()
+                << std::endl;
+    }
+  }
+  CORA::setNumThreads(0);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  for (const auto &file : CORA::benchmark::getBenchmarkFiles(
+           argc, argv, {"data/plaza1.pyfg", "data/tiers.pyfg"})) {
+    benchmarkMatrixFree(file);
+  }
+}
@@ -0,0 +1,94 @@
+/**
+ * @file benchmark_retraction.cpp
+ * @brief Measures the time spent on retractions, which project every p x d
+ * rotation block back onto the Stiefel manifold. We compare the closed-form
+ * polar projection used by StiefelProduct against computing an SVD of each
+ * block.
+ */
+
+#include <CORA/CORA_problem.h>
+#include <CORA/StiefelProduct.h>
+#include <CORA/pyfg_text_parser.h>
+
+#include <Eigen/SVD>
+
+#include <string>
+
+#include <benchmark_utils.h>
+
+using CORA::Matrix;
+
+namespace {
+
+constexpr int kNumRetractions = 100;
+constexpr int kNumReps = 5;
+
+// the SVD-based projection of each p x d block of the transposed rotation
+// variables
+Matrix svdProjection(const Matrix &A, int d) {
+  Matrix P(A.rows(), A.cols());
+  for (int i = 0; i < A.cols() / d; i++) {
+    Eigen::JacobiSVD<Matrix> svd(A.middleCols(i * d, d),
+                                 Eigen::ComputeThinU | Eigen::ComputeThinV);
+    P.middleCols(i * d, d) = svd.matrixU() * svd.matrixV().transpose();
+  }
+  return P;
+}
+
+void benchmarkRetraction(const std::string &pyfg_fpath) {
+  CORA::benchmark::printHeader(pyfg_fpath);
+  CORA::Problem problem = CORA::parsePyfgTextToProblem(
+      CORA::benchmark::resolvePyfgPath(pyfg_fpath));
+  problem.setPreconditioner(CORA::Preconditioner::Jacobi);
+  problem.updateProblemData();
+
+  int d = problem.dim();
+  Matrix Y = problem.projectToManifold(problem.getRandomInitialGuess());
+  Matrix V = 1e-2 * problem.tangent_space_projection(
+                        Y, Matrix::Random(Y.rows(), Y.cols()));
+
+  // the rotation blocks of Y + V, laid out as in StiefelProduct
+  Matrix rot_plus = (Y + V).topRows(problem.numPosesDim()).transpose();
+  CORA::StiefelProduct stiefel(d, rot_plus.rows(), problem.numPoses());
+
+  Matrix rot_plus_polar;
+  double polar_time = CORA::benchmark::timeAverage(
+      [&]() {
+        for (int i = 0; i < kNumRetractions; i++) {
+          rot_plus_polar = stiefel.projectToManifold(rot_plus);
+        }
+      },
+      kNumReps);
+
+  Matrix rot_plus_svd;
+  double svd_time = CORA::benchmark::timeAverage(
+      [&]() {
+        for (int i = 0; i < kNumRetractions; i++) {
+          rot_plus_svd = svdProjection(rot_plus, d);
+        }
+      },
+      kNumReps);
+
+  std::cout << "Y: " << Y.rows() << " x " << Y.cols() << ", "
+            << problem.numPoses() << " rotation blocks, " << kNumRetractions
+            << " retractions" << std::endl;
+  std::cout << std::setw(28) << "rotation projection" << std::setw(20)
+            << "total [ms]" << std::endl;
+  std::cout << std::setw(28) << "SVD per block" << std::setw(20)
+            << svd_time * 1e3 << std::endl;
+  std::cout << std::setw(28) << "closed-form polar" << std::setw(20)
+            << polar_time * 1e3 << std::endl;
+  std::cout << "speedup: " << svd_time / polar_time
+            << "x, max |difference|: "
+            << (rot_plus_polar - rot_plus_svd).cwiseAbs().maxCoeff()
+            << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  for (const auto &file : CORA::benchmark::getBenchmarkFiles(
+           argc, argv, {"data/plaza1.pyfg", "data/tiers.pyfg"})) {
+    benchmarkRetraction(file);
+  }
+}
@@ -0,0 +1,205 @@
+/**
+ * @file benchmark_scalar_types.cpp
+ * @brief Compares the throughput of the kernels of a solver iteration
+ * instantiated for double against their float instantiations: the product
+ * Q*Y with the data matrix, and the projections onto the Stiefel (rotation
+ * blocks) and oblique (range variables) manifolds and onto their tangent
+ * spaces, in the layout of the variables of a CORA Problem. The errors of the
+ * float results relative to the double ones are reported alongside. This is a
+ * kernel experiment only: Problem, the preconditioners and the certification
+ * are double-only, so the solver cannot run in float, and the float product is
+ * a copy of the library's thin kernel (sparseThinDenseProduct()) kept in this
+ * file. For 2D problems the float tangent projection is slower than the double
+ * one (about 0.3x), as the 2-row Stiefel blocks fill an SSE packet of doubles
+ * but only half a packet of floats, which Eigen cannot vectorize on x86.
+ */
+
+#include <CORA/CORA_parallel.h>
+#include <CORA/CORA_problem.h>
+#include <CORA/CORA_spmm.h>
+#include <CORA/ObliqueManifold.h>
+#include <CORA/StiefelProduct.h>
+#include <CORA/pyfg_text_parser.h>
+
+#include <string>
+
+#include <benchmark_utils.h>
+
+using CORA::Matrix;
+
+namespace {
+
+constexpr int kNumOperations = 100;
+constexpr int kNumReps = 5;
+constexpr int kMaxRank = 6;
+
+typedef Eigen::SparseMatrix<float, Eigen::RowMajor> FloatSparseMatrix;
+typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+    FloatRowMajorMatrix;
+
+/**
+ * @brief The float counterpart of sparseThinDenseProduct() (for X with at most
+ * kMaxThinProductCols columns): X is rounded to float as it is copied into
+ * X_rows, the rows of X are accumulated in float and AX is returned in double.
+ */
+void floatThinDenseProduct(const FloatSparseMatrix &A, const Matrix &X,
+                           Matrix &AX, FloatRowMajorMatrix &X_rows) {
+  X_rows = X.cast<float>();
+  AX.resize(A.rows(), X.cols());
+  CORA::dispatchOnThinCols(X.cols(), [&](auto cols_constant) {
+    constexpr int Cols = decltype(cols_constant)::value;
+    using RowVector = Eigen::Matrix<float, 1, Cols>;
+    const float *X_data = X_rows.data();
+    CORA::parallelForRange(
+        0, A.rows(),
+        [&](CORA::Index begin, CORA::Index end) {
+          for (CORA::Index row = begin; row < end; row++) {
+            RowVector acc = RowVector::Zero();
+            for (FloatSparseMatrix::InnerIterator it(A, row); it; ++it) {
+              acc.noalias() +=
+                  it.value() *
+                  Eigen::Map<const RowVector>(X_data + it.index() * Cols);
+            }
+            AX.row(row) = acc.template cast<CORA::Scalar>();
+          }
+        },
+        2048);
+  });
+}
+
+/**
+ * @brief The manifolds, inputs and output of the manifold kernels for scalar
+ * type T. Each time*() function times kNumOperations calls of a kernel.
+ */
+template <typename T> struct Kernels {
+  using MatrixType = CORA::MatrixT<T>;
+
+  CORA::StiefelProductT<T> stiefel;
+  CORA::ObliqueManifoldT<T> oblique;
+  CORA::Index rot_mat_sz;
+  CORA::Index num_ranges;
+  MatrixType Y, V, result;
+
+  // the rotation and range rows of a variable of the problem
+  auto rotations(MatrixType &A) const { return A.topRows(rot_mat_sz); }
+  auto ranges(MatrixType &A) const {
+    return A.middleRows(rot_mat_sz, num_ranges);
+  }
+
+  double timeRetractions() {
+    return CORA::benchmark::timeAverage(
+        [&]() {
+          for (int i = 0; i < kNumOperations; i++) {
+            stiefel.projectTransposedToManifold(rotations(V),
+                                                rotations(result));
+            oblique.projectTransposedToManifold(ranges(V), ranges(result));
+          }
+        },
+        kNumReps);
+  }
+
+  double timeTangentProjections() {
+    return CORA::benchmark::timeAverage(
+        [&]() {
+          for (int i = 0; i < kNumOperations; i++) {
+            stiefel.projectTransposedToTangentSpace(
+                rotations(Y), rotations(V), rotations(result));
+            oblique.projectTransposedToTangentSpace(ranges(Y), ranges(V),
+                                                    ranges(result));
+          }
+        },
+        kNumReps);
+  }
+};
+
+template <typename T>
+Kernels<T> getKernels(const CORA::Problem &problem, const Matrix &Y,
+                      const Matrix &V) {
+  Kernels<T> kernels{
+      CORA::StiefelProductT<T>(problem.dim(), Y.cols(), problem.numPoses()),
+      CORA::ObliqueManifoldT<T>(Y.cols(), problem.numRangeMeasurements()),
+      static_cast<CORA::Index>(problem.numPosesDim()),
+      static_cast<CORA::Index>(problem.numRangeMeasurements()),
+      Y.cast<T>(),
+      V.cast<T>(),
+      CORA::MatrixT<T>::Zero(Y.rows(), Y.cols())};
+  return kernels;
+}
+
+void printRow(const std::string &name, double double_time, double float_time,
+              double error) {
+  std::cout << std::setw(22) << name << std::setw(14) << double_time * 1e3
+            << std::setw(14) << float_time * 1e3 << std::setw(10)
+            << double_time / float_time << std::setw(14) << error << std::endl;
+}
+
+void benchmarkScalarTypes(const std::string &pyfg_fpath) {
+  CORA::benchmark::printHeader(pyfg_fpath);
+  CORA::Problem problem = CORA::parsePyfgTextToProblem(
+      CORA::benchmark::resolvePyfgPath(pyfg_fpath));
+  problem.setPreconditioner(CORA::Preconditioner::Jacobi);
+  problem.updateProblemData();
+
+  const CORA::SparseMatrix &Q = problem.data_matrix_;
+  const FloatSparseMatrix float_Q = Q.cast<float>();
+  std::cout << "Q: " << Q.rows() << " x " << Q.cols() << ", " << Q.nonZeros()
+            << " nonzeros, " << kNumOperations << " operations" << std::endl;
+
+  for (int rank = problem.dim(); rank <= kMaxRank; rank++) {
+    problem.setRank(rank);
+    Matrix Y = problem.projectToManifold(problem.getRandomInitialGuess());
+    Matrix V = Matrix::Random(Y.rows(), Y.cols());
+    Kernels<double> double_kernels = getKernels<double>(problem, Y, V);
+    Kernels<float> float_kernels = getKernels<float>(problem, Y, V);
+
+    std::cout << "rank " << rank << std::endl;
+    std::cout << std::setw(22) << "kernel" << std::setw(14) << "double [ms]"
+              << std::setw(14) << "float [ms]" << std::setw(10) << "speedup"
+              << std::setw(14) << "max |diff|" << std::endl;
+
+    // the float product rounds Y as it is copied into the row-major scratch
+    // matrix, so both products include the copy
+    Matrix QY, float_QY;
+    CORA::RowMajorMatrix Y_rows;
+    FloatRowMajorMatrix float_Y_rows;
+    double double_time = CORA::benchmark::timeAverage(
+        [&]() {
+          for (int i = 0; i < kNumOperations; i++) {
+            CORA::sparseThinDenseProduct(Q, Y, QY, Y_rows);
+          }
+        },
+        kNumReps);
+    double float_time = CORA::benchmark::timeAverage(
+        [&]() {
+          for (int i = 0; i < kNumOperations; i++) {
+            floatThinDenseProduct(float_Q, Y, float_QY, float_Y_rows);
+          }
+        },
+        kNumReps);
+    printRow("Q * Y", double_time, float_time,
+             (float_QY - QY).cwiseAbs().maxCoeff());
+
+    double_time = double_kernels.timeRetractions();
+    float_time = float_kernels.timeRetractions();
+    printRow("retraction", double_time, float_time,
+             (float_kernels.result.cast<double>() - double_kernels.result)
+                 .cwiseAbs()
+                 .maxCoeff());
+
+    double_time = double_kernels.timeTangentProjections();
+    float_time = float_kernels.timeTangentProjections();
+    printRow("tangent projection", double_time, float_time,
+             (float_kernels.result.cast<double>() - double_kernels.result)
+                 .cwiseAbs()
+                 .maxCoeff());
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  for (const auto &file : CORA::benchmark::getBenchmarkFiles(
+           argc, argv, {"data/plaza1.pyfg", "data/tiers.pyfg"})) {
+    benchmarkScalarTypes(file);
+  }
+}
@@ -0,0 +1,131 @@
+/**
+ * @file benchmark_spmm.cpp
+ * @brief Measures the time of the product Q*Y of the data matrix with the
+ * (thin) variable matrix for each relaxation rank. We compare Eigen's generic
+ * sparse-dense product against sparseThinDenseProduct(), which is used by
+ * Problem::dataMatrixProduct(), against symmetricThinDenseProduct() with
+ * only the upper triangle of Q stored (MatrixStorage::UpperTriangular), and
+ * against the product with the rotation block of Q in block sparse (BSR)
+ * format and the rest of Q in CSR format (Problem::setBlockSparseRotations).
+ * The memory of each format is reported as well; the problem stores the BSR
+ * split in addition to Q, so its memory adds to that of Q.
+ */
+
+#include <CORA/CORA_parallel.h>
+#include <CORA/CORA_problem.h>
+#include <CORA/CORA_spmm.h>
+#include <CORA/pyfg_text_parser.h>
+
+#include <algorithm>
+#include <string>
+
+#include <benchmark_utils.h>
+
+using CORA::Matrix;
+
+namespace {
+
+constexpr int kNumProducts = 100;
+constexpr int kNumReps = 5;
+
+// the bytes of a compressed CSR matrix
+size_t getCsrMemoryUsage(const CORA::SparseMatrix &A) {
+  return A.nonZeros() *
+             (sizeof(CORA::Scalar) + sizeof(CORA::SparseMatrix::StorageIndex)) +
+         (A.outerSize() + 1) * sizeof(CORA::SparseMatrix::StorageIndex);
+}
+
+void benchmarkProducts(const std::string &pyfg_fpath) {
+  CORA::benchmark::printHeader(pyfg_fpath);
+  CORA::Problem problem = CORA::parsePyfgTextToProblem(
+      CORA::benchmark::resolvePyfgPath(pyfg_fpath));
+  problem.setPreconditioner(CORA::Preconditioner::Jacobi);
+  problem.setBlockSparseRotations(true);
+  problem.updateProblemData();
+  const CORA::SparseMatrix Q = problem.getDataMatrix();
+  const CORA::SparseMatrix Q_upper = Q.triangularView<Eigen::Upper>();
+  const int rot_mat_sz = problem.numPosesDim();
+  const CORA::BlockSparseMatrix Q_rotations(
+      Q.topLeftCorner(rot_mat_sz, rot_mat_sz), problem.dim());
+  CORA::SparseMatrix Q_remainder = Q;
+  Q_remainder.prune([rot_mat_sz](CORA::Index row, CORA::Index col, double) {
+    return row >= rot_mat_sz || col >= rot_mat_sz;
+  });
+
+  std::cout << "Q: " << Q.rows() << " x " << Q.cols() << ", " << Q.nonZeros()
+            << " nonzeros, " << CORA::getNumThreads() << " thread(s), "
+            << kNumProducts << " products" << std::endl;
+  std::cout << "upper triangle: " << Q_upper.nonZeros() << " nonzeros"
+            << std::endl;
+  std::cout << "rotation block: " << Q_rotations.numBlocks() << " "
+            << problem.dim() << " x " << problem.dim() << " blocks, rest: "
+            << Q_remainder.nonZeros() << " nonzeros" << std::endl;
+  std::cout << "memory: Q " << getCsrMemoryUsage(Q) / 1024.0 << " KiB, upper "
+            << getCsrMemoryUsage(Q_upper) / 1024.0 << " KiB, bsr split "
+            << problem.blockSparseRotationMemoryUsage() / 1024.0
+            << " KiB (stored in addition to Q)" << std::endl;
+  std::cout << std::setw(8) << "rank" << std::setw(16) << "Eigen [ms]"
+            << std::setw(16) << "thin [ms]" << std::setw(12) << "speedup"
+            << std::setw(16) << "upper [ms]" << std::setw(12) << "speedup"
+            << std::setw(16) << "bsr [ms]" << std::setw(12) << "speedup"
+            << std::setw(16) << "max |diff|" << std::endl;
+  for (int rank = problem.dim(); rank <= CORA::kMaxThinProductCols + 2;
+       rank++) {
+    Matrix Y = Matrix::Random(Q.cols(), rank);
+    Matrix QY_eigen, QY_thin, QY_upper, QY_bsr;
+    CORA::RowMajorMatrix Y_rows, QY_rows;
+
+    double eigen_time = CORA::benchmark::timeAverage(
+        [&]() {
+          for (int i = 0; i < kNumProducts; i++) {
+            QY_eigen.noalias() = Q * Y;
+          }
+        },
+        kNumReps);
+    double thin_time = CORA::benchmark::timeAverage(
+        [&]() {
+          for (int i = 0; i < kNumProducts; i++) {
+            CORA::sparseThinDenseProduct(Q, Y, QY_thin, Y_rows);
+          }
+        },
+        kNumReps);
+    double upper_time = CORA::benchmark::timeAverage(
+        [&]() {
+          for (int i = 0; i < kNumProducts; i++) {
+            CORA::symmetricThinDenseProduct(
+                Q_upper, CORA::MatrixStorage::UpperTriangular, Y, QY_upper,
+                Y_rows, QY_rows);
+          }
+        },
+        kNumReps);
+    double bsr_time = CORA::benchmark::timeAverage(
+        [&]() {
+          for (int i = 0; i < kNumProducts; i++) {
+            CORA::sparseThinDenseProduct(Q_remainder, Y, QY_bsr, Y_rows);
+            CORA::addBlockSparseProduct(Q_rotations, Y.topRows(rot_mat_sz),
+                                        QY_bsr.topRows(rot_mat_sz));
+          }
+        },
+        kNumReps);
+
+    std::cout << std::setw(8) << rank << std::setw(16) << eigen_time * 1e3
+              << std::setw(16) << thin_time * 1e3 << std::setw(12)
+              << eigen_time / thin_time << std::setw(16) << upper_time * 1e3
+              << std::setw(12) << eigen_time / upper_time << std::setw(16)
+              << bsr_time * 1e3 << std::setw(12) << eigen_time / bsr_time
+              << std::setw(16)
+              << std::max({(QY_thin - QY_eigen).cwiseAbs().maxCoeff(),
+                           (QY_upper - QY_eigen).cwiseAbs().maxCoeff(),
+                           (QY_bsr - QY_eigen).cwiseAbs().maxCoeff()})
+              << std::endl;
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  for (const auto &file : CORA::benchmark::getBenchmarkFiles(
+           argc, argv, {"data/plaza1.pyfg", "data/tiers.pyfg"})) {
+    benchmarkProducts(file);
+  }
+}
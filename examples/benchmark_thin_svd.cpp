@@ -0,0 +1,77 @@
+/**
+ * @file benchmark_thin_svd.cpp
+ * @brief Compares the thin SVD of the (tall) solution Y computed with a
+ * one-sided Jacobi SVD against the one computed from the eigendecomposition of
+ * the (r x r) Gram matrix Y^T * Y (thinSvdFromGram), as used by
+ * certify_solution() and projectSolution(), for each relaxation rank. Both
+ * variants compute the rank-d factor U_d * Sigma_d that projectSolution()
+ * rounds to the feasible set.
+ */
+
+#include <CORA/CORA_problem.h>
+#include <CORA/CORA_utils.h>
+#include <CORA/pyfg_text_parser.h>
+
+#include <string>
+
+#include <benchmark_utils.h>
+
+using CORA::Matrix;
+using CORA::Vector;
+
+namespace {
+
+constexpr int kNumReps = 5;
+constexpr int kMaxRank = 10;
+
+void benchmarkThinSvd(const std::string &pyfg_fpath) {
+  CORA::benchmark::printHeader(pyfg_fpath);
+  CORA::Problem problem = CORA::parsePyfgTextToProblem(
+      CORA::benchmark::resolvePyfgPath(pyfg_fpath));
+  problem.setPreconditioner(CORA::Preconditioner::Jacobi);
+  problem.updateProblemData();
+  const int d = problem.dim();
+
+  std::cout << std::setw(8) << "rank" << std::setw(16) << "Jacobi [ms]"
+            << std::setw(16) << "Gram [ms]" << std::setw(12) << "speedup"
+            << std::setw(16) << "max |diff|" << std::endl;
+  for (int rank = d; rank <= kMaxRank; rank++) {
+    problem.setRank(rank);
+    Matrix Y = problem.projectToManifold(problem.getRandomInitialGuess());
+
+    Vector jacobi_sigmas;
+    Matrix jacobi_Yd;
+    double jacobi_time = CORA::benchmark::timeAverage(
+        [&]() {
+          Eigen::JacobiSVD<Matrix> svd(Y, Eigen::ComputeThinU);
+          jacobi_sigmas = svd.singularValues();
+          jacobi_Yd = svd.matrixU().leftCols(d) *
+                      jacobi_sigmas.head(d).asDiagonal();
+        },
+        kNumReps);
+
+    Vector gram_sigmas;
+    Matrix V, gram_Yd;
+    double gram_time = CORA::benchmark::timeAverage(
+        [&]() {
+          CORA::thinSvdFromGram(Y, gram_sigmas, V);
+          gram_Yd = Y * V.leftCols(d);
+        },
+        kNumReps);
+
+    std::cout << std::setw(8) << rank << std::setw(16) << jacobi_time * 1e3
+              << std::setw(16) << gram_time * 1e3 << std::setw(12)
+              << jacobi_time / gram_time << std::setw(16)
+              << (gram_sigmas - jacobi_sigmas).cwiseAbs().maxCoeff()
+              << std::endl;
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  for (const auto &file : CORA::benchmark::getBenchmarkFiles(
+           argc, argv, {"data/plaza1.pyfg", "data/tiers.pyfg"})) {
+    benchmarkThinSvd(file);
+  }
+}
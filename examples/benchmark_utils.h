@@ -0,0 +1,75 @@
+/**
+ * @file benchmark_utils.h
+ * @brief Small helpers shared by the CORA benchmark executables: loading the
+ * bundled data sets and timing repeated calls.
+ */
+
+#pragma once
+
+#include <CORA/CORA_problem.h>
+#include <CORA/pyfg_text_parser.h>
+
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace CORA {
+namespace benchmark {
+
+/** The data sets passed on the command line, or default_files if none are
+ * passed (paths are relative to the build directory) */
+inline std::vector<std::string>
+getBenchmarkFiles(int argc, char **argv,
+                  std::vector<std::string> default_files = {
+                      "data/plaza1.pyfg", "data/plaza2.pyfg",
+                      "data/single_drone.pyfg", "data/tiers.pyfg"}) {
+  if (argc > 1) {
+    return std::vector<std::string>(argv + 1, argv + argc);
+  }
+  return default_files;
+}
+
+/** Resolve a data set path either relative to the working directory or to the
+ * ./bin directory that the examples are copied into */
+inline std::string resolvePyfgPath(const std::string &pyfg_fpath) {
+  if (std::filesystem::exists(pyfg_fpath)) {
+    return pyfg_fpath;
+  }
+  return "./bin/" + pyfg_fpath;
+}
+
+using Clock = std::chrono::high_resolution_clock;
+
+/** Returns the wall-clock time (in seconds) elapsed since start */
+inline double secondsSince(const Clock::time_point &start) {
+  std::chrono::duration<double> elapsed = Clock::now() - start;
+  return elapsed.count();
+}
+
+/** Returns the wall-clock time (in seconds) of a single call to func */
+template <typename Func> double timeOnce(Func &&func) {
+  auto start = Clock::now();
+  func();
+  return secondsSince(start);
+}
+
+/** Returns the average wall-clock time (in seconds) of num_reps calls to func
+ * after a single warm-up call */
+template <typename Func> double timeAverage(Func &&func, int num_reps) {
+  func();
+  double total = 0;
+  for (int i = 0; i < num_reps; i++) {
+    total += timeOnce(func);
+  }
+  return total / num_reps;
+}
+
+inline void printHeader(const std::string &title) {
+  std::cout << "\n==== " << title << " ====" << std::endl;
+}
+
+} // namespace benchmark
+} // namespace CORA
@@ -10,6 +10,7 @@
 #include <CORA/CORA_problem.h>
 #include <CORA/CORA_types.h>
 #include <CORA/pyfg_text_parser.h>
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
@@ -19,6 +20,32 @@ namespace CORA {
 using CoraTntResult = Optimization::Riemannian::TNTResult<Matrix, Scalar>;
 using CoraResult = std::pair<CoraTntResult, std::vector<Matrix>>;
 
+/**
+ * @brief The functions that define the problem for the truncated-Newton
+ * trust-region solver, as used by solveCORA(). They share a workspace that is
+ * reused across calls, so in steady state they only allocate the matrices
+ * that the Optimization library takes by value: the tangent vectors returned
+ * by the Hessian-vector products and the preconditioner, and the retracted
+ * points. The exceptions are the CHOLMOD solves of the implicit formulation
+ * and of the Cholesky-based preconditioners, which allocate their solutions.
+ * This only holds (and is only tested) with the serial parallel backend: the
+ * Threads backend allocates the job of each parallel loop, and the OpenMP
+ * runtime may allocate as well.
+ */
+struct CoraTntFunctions {
+  Optimization::Objective<Matrix, Scalar, Matrix> f;
+  Optimization::Riemannian::QuadraticModel<Matrix, Matrix, Matrix> QM;
+  Optimization::Riemannian::RiemannianMetric<Matrix, Matrix, Scalar, Matrix>
+      metric;
+  Optimization::Riemannian::Retraction<Matrix, Matrix, Matrix> retract;
+  std::optional<
+      Optimization::Riemannian::LinearOperator<Matrix, Matrix, Matrix>>
+      precon;
+};
+
+/** The solver functions for problem, which must outlive them */
+CoraTntFunctions getTntFunctions(const Problem &problem);
+
 CoraResult solveCORA(Problem &problem, const Matrix &x0,
                      int max_relaxation_rank = 20, bool verbose = false,
                      bool log_iterates = false, bool show_iterates = false);
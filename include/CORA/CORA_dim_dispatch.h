@@ -0,0 +1,55 @@
+/**
+ * @file CORA_dim_dispatch.h
+ * @brief Helpers for writing d x d block kernels with compile-time block sizes.
+ * The dimension of a CORA problem (as read by getDimFromPyfgFirstLine) is
+ * almost always 2 or 3, so kernels that loop over rotation blocks are
+ * instantiated for D = 2 and D = 3, where Eigen keeps the blocks in registers
+ * and unrolls their products, and fall back to dynamic sizes otherwise.
+ */
+
+#pragma once
+
+#include <CORA/CORA_types.h>
+
+#include <type_traits>
+
+namespace CORA {
+
+/** A D x D block (e.g., a rotation or a Lagrange multiplier block) */
+template <int D, typename T = Scalar> using DimMatrix = Eigen::Matrix<T, D, D>;
+
+/** A D x p (or p x D) slice of a variable, e.g., the rows of one frame */
+template <int D, typename T = Scalar>
+using DimRowsMatrix = Eigen::Matrix<T, D, Eigen::Dynamic>;
+template <int D, typename T = Scalar>
+using DimColsMatrix = Eigen::Matrix<T, Eigen::Dynamic, D>;
+
+/** The compile-time dimension passed to the kernels of dispatchOnDim() */
+template <int D> using DimConstant = std::integral_constant<int, D>;
+
+/**
+ * @brief Calls func(DimConstant<D>()) where D is dim if dim is 2 or 3, and
+ * Eigen::Dynamic otherwise. func should be a generic lambda that reads the
+ * dimension from decltype of its argument, e.g.,
+ *
+ *   dispatchOnDim(dim, [&](auto dim_constant) {
+ *     constexpr int D = decltype(dim_constant)::value;
+ *     DimMatrix<D> block = A.middleCols<D>(start, dim);
+ *     ...
+ *   });
+ *
+ * Fixed-size block expressions should still be given the runtime dimension
+ * (as above), which is required when D is Eigen::Dynamic.
+ */
+template <typename Func> decltype(auto) dispatchOnDim(Index dim, Func &&func) {
+  switch (dim) {
+  case 2:
+    return func(DimConstant<2>());
+  case 3:
+    return func(DimConstant<3>());
+  default:
+    return func(DimConstant<Eigen::Dynamic>());
+  }
+}
+
+} // namespace CORA
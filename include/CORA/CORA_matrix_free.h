@@ -0,0 +1,143 @@
+/**
+ * @file CORA_matrix_free.h
+ * @brief Products with the data matrix computed directly from the list of
+ * measurements (edges), without assembling the data matrix.
+ */
+
+#pragma once
+
+#include <CORA/CORA_spmm.h>
+#include <CORA/CORA_types.h>
+
+#include <cstddef>
+#include <vector>
+
+namespace CORA {
+
+/**
+ * @brief The data matrix Q as a list of edges, each of which adds its local
+ * contribution to Q * Y. Every variable is referred to by its first row in Q
+ * (e.g., d * i for the i-th rotation).
+ *
+ * The edges are greedily colored so that no two edges of the same color touch
+ * the same variable. The edges of each color are then split among threads
+ * with parallelFor(), without any synchronization other than between colors.
+ * The few variables touched by many edges (e.g., landmarks measured from
+ * every pose, or the origin pose of the priors) would need a color per edge,
+ * so they are left out of the coloring: each thread sums their rows
+ * separately, and the sums are added up once every edge is applied.
+ */
+class MatrixFreeDataMatrix {
+public:
+  MatrixFreeDataMatrix() = default;
+
+  /**
+   * @brief An empty data matrix of the given size, for variables of dimension
+   * dim
+   */
+  MatrixFreeDataMatrix(Index dim, Index size);
+
+  /**
+   * @brief Adds the terms of a relative pose measurement (or pose prior) from
+   * the pose with rotation at row rot_i and translation at row trans_a to the
+   * pose with rotation at row rot_j and translation at row trans_b: those of
+   * the relative rotation R (with precision kappa) and of the translation t
+   * (with precision tau) measured in the frame of the first pose
+   */
+  void addPoseEdge(Index rot_i, Index rot_j, Index trans_a, Index trans_b,
+                   const Matrix &R, const Vector &t, Scalar kappa, Scalar tau);
+
+  /**
+   * @brief Adds the terms of a translation t (with precision tau) measured in
+   * the frame of the rotation at row rot_i, from the translation at row
+   * trans_a to the translation at row trans_b (e.g., a pose-landmark
+   * measurement or a landmark prior)
+   */
+  void addTranslationEdge(Index rot_i, Index trans_a, Index trans_b,
+                          const Vector &t, Scalar tau);
+
+  /**
+   * @brief Adds the terms of a range measurement r (with precision omega)
+   * between the translations at rows trans_a and trans_b, whose unit bearing
+   * is the variable at row range_row.
+   */
+  void addRangeEdge(Index range_row, Index trans_a, Index trans_b, Scalar r,
+                    Scalar omega);
+
+  /**
+   * @brief Colors the edges, leaving out the variables touched by many edges.
+   * Must be called after the last edge is added.
+   */
+  void finalize();
+
+  /**
+   * @brief Computes QY = Q * Y, resizing QY as needed (must not alias Y). The
+   * edges read and update whole rows of Y and QY, so they work on row-major
+   * copies of them, Y_rows and QY_rows, which are reused across calls (QY_rows
+   * also holds the per-thread sums of the variables that are not colored)
+   */
+  void multiply(const Matrix &Y, Matrix &QY, RowMajorMatrix &Y_rows,
+                RowMajorMatrix &QY_rows) const;
+  void multiply(const Matrix &Y, Matrix &QY) const;
+
+  Index rows() const { return size_; }
+  Index cols() const { return size_; }
+  size_t numEdges() const { return pose_edges_.size() + range_edges_.size(); }
+  size_t numColors() const {
+    return pose_color_starts_.size() + range_color_starts_.size() - 2;
+  }
+  /** The number of rows of the variables that are left out of the coloring */
+  size_t numUncoloredRows() const { return hub_rows_.size(); }
+
+  /** The number of bytes used to store the edges and their coloring */
+  size_t memoryUsage() const;
+
+private:
+  // applies the edges split into num_slots slots, each with its own sums of
+  // the rows of the variables that are not colored when there are several
+  template <int D, int Cols>
+  void multiplyFixed(const RowMajorMatrix &Y, RowMajorMatrix &QY,
+                     Index num_slots) const;
+
+  struct PoseEdge {
+    Index rot_i;
+    // -1 if the edge only has translation terms
+    Index rot_j;
+    Index trans_a;
+    Index trans_b;
+    Scalar kappa;
+    Scalar tau;
+  };
+
+  struct RangeEdge {
+    Index range_row;
+    Index trans_a;
+    Index trans_b;
+    Scalar r;
+    Scalar omega;
+  };
+
+  Index dim_ = 0;
+  Index size_ = 0;
+
+  // the edges, sorted by color after finalize()
+  std::vector<PoseEdge> pose_edges_;
+  std::vector<RangeEdge> range_edges_;
+
+  // the rotation R (d x d, column-major) followed by the translation t (d) of
+  // each pose edge
+  std::vector<Scalar> pose_edge_params_;
+
+  // the edges of color c are [color_starts[c], color_starts[c + 1])
+  std::vector<Index> pose_color_starts_ = {0};
+  std::vector<Index> range_color_starts_ = {0};
+
+  // the offset of the rows of each variable (by its first row) among the rows
+  // summed per thread, or -1 if the variable is colored. Empty if every
+  // variable is colored
+  std::vector<int> hub_offsets_;
+  // the row of Q of each of the rows summed per thread
+  std::vector<Index> hub_rows_;
+};
+
+} // namespace CORA
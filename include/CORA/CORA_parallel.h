@@ -0,0 +1,309 @@
+/**
+ * @file CORA_parallel.h
+ * @brief Minimal helpers for running independent loop iterations in parallel.
+ * The iterations are shared among the threads of an OpenMP team (when CORA is
+ * built with OpenMP, i.e., ENABLE_OPENMP) or among the std::threads of a pool
+ * that persists across loops, as selected by setParallelBackend(), or are run
+ * serially.
+ */
+
+#pragma once
+
+#include <CORA/CORA_types.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef CORA_USE_OPENMP
+#include <omp.h>
+#endif
+
+namespace CORA {
+
+/** The threading backend used by CORA's parallel loops */
+enum class ParallelBackend {
+  // run every loop on the calling thread
+  Serial,
+  // share the iterations among the threads of an OpenMP team (requires
+  // CORA_USE_OPENMP)
+  OpenMP,
+  // share the iterations among the std::threads of a pool, which are started
+  // once and reused by every loop
+  Threads
+};
+
+namespace internal {
+// The settings below are process-wide and may be changed while another thread
+// runs a loop, so they are atomic. A loop reads them once when it starts.
+
+// the number of threads used by parallelFor(); <= 0 means "use the backend
+// default"
+inline std::atomic<int> num_threads(0);
+
+#ifdef CORA_USE_OPENMP
+inline std::atomic<ParallelBackend> parallel_backend(ParallelBackend::OpenMP);
+#else
+inline std::atomic<ParallelBackend> parallel_backend(ParallelBackend::Serial);
+#endif
+
+// the number of frames (rotation blocks or spheres) handled per chunk by the
+// manifold kernels
+inline std::atomic<Index> manifold_grain_size(256);
+
+// whether the current thread is running an iteration of a parallel loop, in
+// which case nested loops are run serially
+inline thread_local bool in_parallel_loop = false;
+
+/**
+ * @brief The worker threads of the Threads backend. They are started once and
+ * then wait for jobs, so a parallel loop only wakes them up rather than
+ * creating (and joining) new threads.
+ */
+class ThreadPool {
+public:
+  ThreadPool() = default;
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+  ~ThreadPool();
+
+  /** The number of worker threads started */
+  int size() const;
+
+  /** Stops the workers and starts num_workers new ones, unless there already
+   * are num_workers. Waits for the job running on the pool (if any) to finish
+   * first, so the workers are only replaced while the pool is idle. */
+  void resize(int num_workers);
+
+  /**
+   * @brief Calls job() on the calling thread and on num_workers workers
+   * concurrently (starting more workers if there are fewer) and returns once
+   * every call has returned. If another thread is running a job on the pool,
+   * job() is only called on the calling thread, so it must be able to do all
+   * of the work by itself.
+   */
+  void run(int num_workers, const std::function<void()> &job);
+
+private:
+  // seen_generation is the last job the worker need not take part in
+  void workerLoop(int worker_idx, size_t seen_generation);
+  void stopWorkers();
+
+  std::vector<std::thread> workers_;
+  // held by run() and resize(), so that a single job uses the pool at a time
+  std::mutex run_mutex_;
+  // guards the state below, which the workers wait on
+  std::mutex mutex_;
+  std::condition_variable job_ready_;
+  std::condition_variable job_done_;
+  const std::function<void()> *job_ = nullptr;
+  // incremented for each job, so that the workers can tell a new one apart
+  size_t job_generation_ = 0;
+  // the workers [0, num_job_workers_) take part in the current job
+  int num_job_workers_ = 0;
+  int num_pending_workers_ = 0;
+  bool stop_ = false;
+};
+
+/** The pool of the Threads backend, started on first use */
+ThreadPool &getThreadPool();
+
+/** The number of threads used by the loops of the given backend */
+inline int getNumThreads(ParallelBackend backend) {
+  int num_threads = internal::num_threads;
+  switch (backend) {
+#ifdef CORA_USE_OPENMP
+  case ParallelBackend::OpenMP:
+    return num_threads > 0 ? num_threads : omp_get_max_threads();
+#endif
+  case ParallelBackend::Threads:
+    return num_threads > 0
+               ? num_threads
+               : std::max(1, static_cast<int>(
+                                 std::thread::hardware_concurrency()));
+  default:
+    return 1;
+  }
+}
+
+// the settings cannot be changed from within a loop iteration: resizing the
+// pool waits for the running loop, i.e., for the caller itself
+inline void checkNotInParallelLoop(const char *func_name) {
+  if (in_parallel_loop) {
+    throw std::logic_error(std::string(func_name) +
+                           " cannot be called from within a parallel loop");
+  }
+}
+} // namespace internal
+
+inline ParallelBackend getParallelBackend() {
+  return internal::parallel_backend;
+}
+
+/**
+ * @brief Returns the number of threads used by CORA's parallel loops (1 for
+ * the Serial backend)
+ */
+inline int getNumThreads() {
+  return internal::getNumThreads(getParallelBackend());
+}
+
+/**
+ * @brief Sets the number of threads used by CORA's parallel loops. Values <= 0
+ * restore the default (for OpenMP, e.g., OMP_NUM_THREADS, and for std::threads
+ * the number of hardware threads). With the Threads backend, the pool is
+ * resized to match once the loop it is running (if any) has finished; loops
+ * that are already running keep their threads. Must not be called from within
+ * a loop iteration.
+ */
+inline void setNumThreads(int num_threads) {
+  internal::checkNotInParallelLoop("setNumThreads");
+  internal::num_threads = num_threads;
+  if (getParallelBackend() == ParallelBackend::Threads) {
+    internal::getThreadPool().resize(getNumThreads() - 1);
+  }
+}
+
+/**
+ * @brief Selects the threading backend used by CORA's parallel loops. The
+ * default is OpenMP if CORA was built with it and Serial otherwise. Selecting
+ * the Threads backend starts its pool (see setNumThreads()). Loops that are
+ * already running finish on their backend. Must not be called from within a
+ * loop iteration.
+ */
+inline void setParallelBackend(ParallelBackend backend) {
+#ifndef CORA_USE_OPENMP
+  if (backend == ParallelBackend::OpenMP) {
+    throw std::invalid_argument(
+        "The OpenMP parallel backend requires CORA to be built with OpenMP "
+        "(ENABLE_OPENMP)");
+  }
+#endif
+  internal::checkNotInParallelLoop("setParallelBackend");
+  internal::parallel_backend = backend;
+  if (backend == ParallelBackend::Threads) {
+    internal::getThreadPool().resize(getNumThreads() - 1);
+  }
+}
+
+/**
+ * @brief Sets the number of frames (rotation blocks or unit spheres) that the
+ * manifold kernels (e.g., projections and retractions) process per chunk of a
+ * parallel loop. The work per frame is tiny, so chunks should be large enough
+ * to outweigh the cost of handing them out to threads.
+ */
+inline void setManifoldGrainSize(Index grain_size) {
+  internal::manifold_grain_size = std::max<Index>(1, grain_size);
+}
+
+inline Index getManifoldGrainSize() { return internal::manifold_grain_size; }
+
+/**
+ * @brief Calls func(chunk_begin, chunk_end) for consecutive chunks of (at most)
+ * grain_size iterations covering [begin, end). The chunks must be independent
+ * of one another, as they may run concurrently and in any order. If the loop
+ * would be run by a single thread (or is nested in another parallel loop),
+ * func is called once for the whole range. If any chunk throws, the first
+ * exception is rethrown once the loop is done.
+ *
+ * @param begin the first iteration
+ * @param end one past the last iteration
+ * @param func the loop body, callable as func(Index, Index)
+ * @param grain_size the number of consecutive iterations per chunk
+ */
+template <typename Func>
+void parallelForRange(Index begin, Index end, Func &&func,
+                      Index grain_size = 1) {
+  if (end <= begin) {
+    return;
+  }
+  grain_size = std::max<Index>(1, grain_size);
+  Index num_chunks = (end - begin + grain_size - 1) / grain_size;
+  // the backend is read once, so that the whole loop runs on the backend it
+  // started on even if setParallelBackend() is called meanwhile
+  const ParallelBackend backend = getParallelBackend();
+  int num_threads =
+      internal::in_parallel_loop ? 1 : internal::getNumThreads(backend);
+  num_threads = static_cast<int>(std::min<Index>(num_threads, num_chunks));
+  if (num_threads <= 1) {
+    func(begin, end);
+    return;
+  }
+
+  std::exception_ptr first_exception = nullptr;
+  std::mutex exception_mutex;
+  auto run_chunk = [&](Index chunk_idx) {
+    Index chunk_begin = begin + chunk_idx * grain_size;
+    Index chunk_end = std::min(chunk_begin + grain_size, end);
+    bool was_in_parallel_loop = internal::in_parallel_loop;
+    internal::in_parallel_loop = true;
+    try {
+      func(chunk_begin, chunk_end);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(exception_mutex);
+      if (!first_exception) {
+        first_exception = std::current_exception();
+      }
+    }
+    internal::in_parallel_loop = was_in_parallel_loop;
+  };
+
+#ifdef CORA_USE_OPENMP
+  if (backend == ParallelBackend::OpenMP) {
+#pragma omp parallel for schedule(dynamic, 1) num_threads(num_threads)
+    for (Index chunk_idx = 0; chunk_idx < num_chunks; chunk_idx++) {
+      run_chunk(chunk_idx);
+    }
+  } else
+#endif
+  {
+    // the calling thread works alongside num_threads - 1 workers of the pool,
+    // each taking the next unclaimed chunk until none are left
+    std::atomic<Index> next_chunk(0);
+    std::function<void()> worker = [&]() {
+      for (Index chunk_idx = next_chunk++; chunk_idx < num_chunks;
+           chunk_idx = next_chunk++) {
+        run_chunk(chunk_idx);
+      }
+    };
+    internal::getThreadPool().run(num_threads - 1, worker);
+  }
+
+  if (first_exception) {
+    std::rethrow_exception(first_exception);
+  }
+}
+
+/**
+ * @brief Calls func(i) for every i in [begin, end). The iterations must be
+ * independent of one another, as they may run concurrently and in any order.
+ * Iterations are handed out to threads in chunks of grain_size, so grain_size
+ * should be large enough that a chunk outweighs the scheduling overhead. If
+ * any iteration throws, the first exception is rethrown once the loop is done.
+ *
+ * @param begin the first iteration
+ * @param end one past the last iteration
+ * @param func the loop body, callable as func(Index)
+ * @param grain_size the number of consecutive iterations per chunk
+ */
+template <typename Func>
+void parallelFor(Index begin, Index end, Func &&func, Index grain_size = 1) {
+  parallelForRange(
+      begin, end,
+      [&func](Index chunk_begin, Index chunk_end) {
+        for (Index i = chunk_begin; i < chunk_end; i++) {
+          func(i);
+        }
+      },
+      grain_size);
+}
+
+} // namespace CORA
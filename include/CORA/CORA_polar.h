@@ -0,0 +1,111 @@
+/**
+ * @file CORA_polar.h
+ * @brief Closed-form polar projection of small blocks. The nearest matrix with
+ * orthonormal columns to a p x d matrix A (d = 2, 3) is its orthogonal polar
+ * factor A (A^T A)^{-1/2}, which only requires the eigendecomposition of the
+ * d x d Gram matrix A^T A. For d <= 3 this is computed in closed form, which
+ * is considerably cheaper than an iterative SVD of A.
+ */
+
+#pragma once
+
+#include <CORA/CORA_dim_dispatch.h>
+
+#include <Eigen/Eigenvalues>
+
+#include <algorithm>
+#include <limits>
+
+namespace CORA {
+
+/**
+ * @brief The smallest ratio between the smallest and the largest eigenvalue of
+ * the Gram matrix for which the closed-form polar projection is used. Forming
+ * A^T A squares the condition number of A, so for (nearly) rank-deficient
+ * blocks callers should fall back to an SVD of A itself.
+ */
+constexpr Scalar kPolarGramMinEigenvalueRatio = 1e-6;
+
+/**
+ * @brief The smallest ratio between the smallest and the largest eigenvalue of
+ * the Gram matrix for which the closed-form polar factor A * W is orthonormal
+ * to (a small multiple of) machine precision as computed. Its error grows in
+ * proportion to the condition number of A^T A, so below this ratio the factor
+ * is refined with a Newton-Schulz step (see newtonSchulzCorrection()).
+ */
+constexpr Scalar kPolarRefinementEigenvalueRatio = 0.1;
+
+/**
+ * @brief The ratio above for the scalar type T. The relative error of the
+ * smallest eigenvalue of the Gram matrix is about epsilon / ratio, so for
+ * types less precise than double the threshold is raised to keep it small.
+ */
+template <typename T> constexpr T polarGramMinEigenvalueRatio() {
+  return std::max(T(kPolarGramMinEigenvalueRatio),
+                  T(1e4) * std::numeric_limits<T>::epsilon());
+}
+
+/**
+ * @brief Computes W = (A^T A)^{-1/2} from the Gram matrix G = A^T A of a
+ * matrix A with D columns, so that A * W is the orthogonal polar factor of A
+ * (i.e., the projection of A onto the Stiefel manifold). If flip_smallest is
+ * set, the direction of the smallest singular value of A is reversed, which
+ * gives the projection onto SO(D) of a square A with negative determinant.
+ *
+ * @tparam D the (fixed) number of columns of A, 2 or 3
+ * @tparam T the scalar type, deduced from W
+ * @param G the Gram matrix A^T A
+ * @param W the inverse square root of G
+ * @param flip_smallest whether to reverse the smallest singular direction
+ * @param needs_refinement if given, set to whether G is conditioned badly
+ * enough for A * W to need a Newton-Schulz step to be orthonormal to machine
+ * precision (see kPolarRefinementEigenvalueRatio)
+ * @return false (leaving W unset) if G is too ill-conditioned for W to be
+ * accurate, in which case the projection should be computed from an SVD
+ */
+template <int D, typename T>
+bool inverseSqrtGram(const typename DimMatrix<D, T>::PlainObject &G,
+                     DimMatrix<D, T> &W, bool flip_smallest = false,
+                     bool *needs_refinement = nullptr) {
+  static_assert(D == 2 || D == 3,
+                "The closed-form polar projection requires D = 2 or D = 3");
+  Eigen::SelfAdjointEigenSolver<DimMatrix<D, T>> eig;
+  eig.computeDirect(G);
+
+  // the eigenvalues are sorted in increasing order
+  const auto &lambdas = eig.eigenvalues();
+  if (!(lambdas(0) > polarGramMinEigenvalueRatio<T>() * lambdas(D - 1))) {
+    return false;
+  }
+  if (needs_refinement) {
+    *needs_refinement =
+        lambdas(0) < T(kPolarRefinementEigenvalueRatio) * lambdas(D - 1);
+  }
+
+  Eigen::Matrix<T, D, 1> inv_sigmas = lambdas.cwiseSqrt().cwiseInverse();
+  if (flip_smallest) {
+    inv_sigmas(0) = -inv_sigmas(0);
+  }
+  const DimMatrix<D, T> &V = eig.eigenvectors();
+  W.noalias() = V * inv_sigmas.asDiagonal() * V.transpose();
+  return true;
+}
+
+/**
+ * @brief Returns C = (3I - G) / 2 for the Gram matrix G = R^T R of a matrix R
+ * with D (nearly) orthonormal columns, so that R * C is a Newton-Schulz step of
+ * the polar iteration. The closed-form polar factor A * W loses orthogonality
+ * in proportion to the conditioning of A, and one step squares this error.
+ * Only needed if inverseSqrtGram() reports that the factor needs refinement.
+ *
+ * @tparam D the (fixed) number of columns of R
+ * @tparam T the scalar type
+ * @param G the Gram matrix R^T R
+ */
+template <int D, typename T>
+DimMatrix<D, T>
+newtonSchulzCorrection(const typename DimMatrix<D, T>::PlainObject &G) {
+  return T(1.5) * DimMatrix<D, T>::Identity() - T(0.5) * G;
+}
+
+} // namespace CORA
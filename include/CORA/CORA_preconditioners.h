@@ -21,7 +21,64 @@
 
 namespace CORA {
 
-using CholeskyFactorization = Eigen::CholmodDecomposition<SparseMatrix>;
+/**
+ * @brief A Cholesky factorization (computed by CHOLMOD) that keeps its
+ * symbolic analysis (fill-reducing ordering and elimination tree) around.
+ * Refactorizing a matrix with the same sparsity pattern as the last analyzed
+ * one skips the symbolic analysis and only recomputes the numeric
+ * factorization.
+ *
+ * Only the upper triangle of the factorized matrices is read, so they may be
+ * stored either in full or as their upper triangle (MatrixStorage).
+ *
+ * Use refactorize() rather than compute() so that the analyzed pattern is
+ * tracked.
+ *
+ * @tparam Decomposition the CHOLMOD decomposition (reading the upper
+ * triangle) to compute
+ */
+template <typename Decomposition>
+class CholeskyFactorizationT : public Decomposition {
+public:
+  CholeskyFactorizationT() = default;
+  explicit CholeskyFactorizationT(const SparseMatrix &A) { refactorize(A); }
+
+  /**
+   * @brief factorizes A, reusing the symbolic analysis of the previously
+   * factorized matrix if A has the same sparsity pattern
+   *
+   * @param A the matrix to factorize
+   * @return true if the symbolic analysis was reused
+   */
+  bool refactorize(const SparseMatrix &A);
+
+  /** The number of symbolic analyses computed by refactorize() */
+  size_t numAnalyses() const { return num_analyses_; }
+
+private:
+  // the sparsity pattern (compressed storage) the symbolic analysis is for
+  Index analyzed_rows_ = -1;
+  std::vector<SparseMatrix::StorageIndex> analyzed_outer_idxs_;
+  std::vector<SparseMatrix::StorageIndex> analyzed_inner_idxs_;
+  size_t num_analyses_ = 0;
+};
+
+/** The factorization used by the preconditioners (CHOLMOD picks a simplicial
+ * or supernodal factorization) */
+using CholeskyFactorization = CholeskyFactorizationT<
+    Eigen::CholmodDecomposition<SparseMatrix, Eigen::Upper>>;
+
+/** The supernodal factorization of the regularized certificate matrix
+ * S + eta * I used by fast_verification() to test its positive-semidefiniteness
+ */
+using CertificateFactorization = CholeskyFactorizationT<
+    Eigen::CholmodSupernodalLLT<SparseMatrix, Eigen::Upper>>;
+
+extern template class CholeskyFactorizationT<
+    Eigen::CholmodDecomposition<SparseMatrix, Eigen::Upper>>;
+extern template class CholeskyFactorizationT<
+    Eigen::CholmodSupernodalLLT<SparseMatrix, Eigen::Upper>>;
+
 using CholFactorPtr = std::shared_ptr<CholeskyFactorization>;
 using CholFactorPtrVector = std::vector<CholFactorPtr>;
 
@@ -40,7 +97,39 @@ using CholFactorPtrVector = std::vector<CholFactorPtr>;
 CholFactorPtrVector getBlockCholeskyFactorization(const SparseMatrix &A,
                                                   const VectorXi &block_sizes);
 
+/**
+ * @brief Same as getBlockCholeskyFactorization(), but updates the given
+ * factorization in place. The symbolic analysis of each block whose sparsity
+ * pattern did not change is reused.
+ *
+ * @param block_chol_factor_ptrs the factorization to update
+ * @param A the matrix to precondition (should be symmetric positive definite)
+ * @param block_sizes the sizes of the blocks (should sum to A.rows())
+ * @return the number of blocks whose symbolic analysis was reused
+ */
+int updateBlockCholeskyFactorization(
+    CholFactorPtrVector &block_chol_factor_ptrs, const SparseMatrix &A,
+    const VectorXi &block_sizes);
+
+/**
+ * @brief Refactorizes A into chol_factor_ptr, reusing its symbolic analysis if
+ * possible. A new factorization is created if chol_factor_ptr is empty or is
+ * shared with another owner (which must not see its values change).
+ *
+ * @param chol_factor_ptr the factorization to update
+ * @param A the matrix to factorize
+ * @return true if the symbolic analysis was reused
+ */
+bool refactorizeCholesky(CholFactorPtr &chol_factor_ptr, const SparseMatrix &A);
+
 Matrix blockCholeskySolve(const CholFactorPtrVector &block_chol_factor_ptrs,
                           const Matrix &rhs);
 
+/**
+ * @brief Same as above, but writing the solution into result (reusing its
+ * storage). result may alias rhs.
+ */
+void blockCholeskySolve(const CholFactorPtrVector &block_chol_factor_ptrs,
+                        const Matrix &rhs, Matrix &result);
+
 } // namespace CORA
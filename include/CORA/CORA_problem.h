@@ -11,7 +11,9 @@
 
 #pragma once
 
+#include <CORA/CORA_matrix_free.h>
 #include <CORA/CORA_preconditioners.h>
+#include <CORA/CORA_spmm.h>
 #include <CORA/CORA_types.h>
 #include <CORA/Measurements.h>
 #include <CORA/ObliqueManifold.h>
@@ -19,11 +21,22 @@
 #include <CORA/Symbol.h>
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 namespace CORA {
 
+/** Maps an (unordered) pair of symbols to the index of the measurement between
+ * them. Used to reject duplicate measurements and look up measurement indices
+ * in O(1) */
+using SymbolPairIdxMap =
+    std::unordered_map<SymbolPair, int, UnorderedSymbolPairHash,
+                       UnorderedSymbolPairEqual>;
+
+/** Maps a symbol (by key) to the index of the prior on it */
+using SymbolIdxMap = std::unordered_map<Key, int>;
+
 /**
  * @brief the submatrices that are used to construct the data matrix.
  * All of these matrices are sparse and most have sparsity structures
@@ -85,12 +98,24 @@ private:
   // the range measurements that are used to construct the problem
   std::vector<RangeMeasurement> range_measurements_;
 
+  // maps from the symbol pair of a range measurement to its index in
+  // range_measurements_
+  SymbolPairIdxMap range_measurement_idxs_;
+
   // the relative pose measurements that are used to construct the problem
   std::vector<RelativePoseMeasurement> rel_pose_pose_measurements_;
 
+  // maps from the symbol pair of a relative pose measurement to its index in
+  // rel_pose_pose_measurements_
+  SymbolPairIdxMap rel_pose_pose_measurement_idxs_;
+
   // the pose-landmark measurements that are used to construct the problem
   std::vector<RelativePoseLandmarkMeasurement> rel_pose_landmark_measurements_;
 
+  // maps from the symbol pair of a pose-landmark measurement to its index in
+  // rel_pose_landmark_measurements_
+  SymbolPairIdxMap rel_pose_landmark_measurement_idxs_;
+
   // the symbol for the origin (is added automatically if there are any priors)
   Symbol origin_symbol_;
 
@@ -99,9 +124,15 @@ private:
   // the pose priors that are used to construct the problem
   std::vector<PosePrior> pose_priors_;
 
+  // maps from the pose symbol of a prior to its index in pose_priors_
+  SymbolIdxMap pose_prior_idxs_;
+
   // the landmark priors that are used to construct the problem
   std::vector<LandmarkPrior> landmark_priors_;
 
+  // maps from the landmark symbol of a prior to its index in landmark_priors_
+  SymbolIdxMap landmark_prior_idxs_;
+
   // the non-Euclidean manifolds that make up the problem
   Manifolds manifolds_;
 
@@ -111,15 +142,82 @@ private:
   // the preconditioner to use for solving the problem
   Preconditioner preconditioner_;
 
+  // whether products with the data matrix use the assembled matrix or are
+  // computed directly from the measurements
+  const DataMatrixOperator data_matrix_operator_;
+
+  // the data matrix as a list of measurement edges. Only built with
+  // matrix-free products, in which case data_matrix_ is left empty
+  MatrixFreeDataMatrix matrix_free_data_matrix_;
+
   // the preconditioner matrices
   PreconditionerMatrices preconditioner_matrices_;
 
-  // the submatrices that are used to construct the data matrix
+  // the submatrices that describe the data matrix (built on request)
   CoraDataSubmatrices data_submatrices_;
 
   // a flag to check if there are any priors
   bool has_priors_ = false;
 
+  /**
+   * @brief the number of variables and measurements of each kind. Variables
+   * and measurements are only ever appended, so comparing the counts at the
+   * last call to updateProblemData() against the current counts tells us
+   * exactly what was added since then
+   */
+  struct ProblemCounts {
+    int num_poses = 0;
+    int num_landmarks = 0;
+    int num_range_measurements = 0;
+    int num_pose_pose_measurements = 0;
+    int num_pose_landmark_measurements = 0;
+    int num_pose_priors = 0;
+    int num_landmark_priors = 0;
+  };
+  ProblemCounts getProblemCounts() const;
+
+  // the counts of everything that has been assembled into the data matrix
+  ProblemCounts assembled_counts_;
+
+  // if true, updateProblemData() patches the data matrix with the
+  // measurements added since the last update instead of rebuilding it
+  bool incremental_updates_ = false;
+
+  // whether the last call to updateProblemData() changed the sparsity pattern
+  // of the data matrix
+  bool data_matrix_pattern_changed_ = true;
+
+  // whether the data matrix (and the certificate matrix, and Qmain_) store
+  // both triangles or only the upper one
+  MatrixStorage data_matrix_storage_ = MatrixStorage::Full;
+
+  // whether dataMatrixProduct() multiplies with the rotation block in block
+  // sparse (BSR) format
+  bool block_sparse_rotations_ = false;
+
+  // the order of the variables within each block of the data matrix
+  VariableOrdering variable_ordering_ = VariableOrdering::Insertion;
+
+  // the position of each pose, landmark and range variable (by the index it
+  // was added with) within its block of the data matrix, as set by the last
+  // reordering. Empty if the variables are in insertion order. Variables added
+  // since the last reordering keep their insertion index, i.e., are placed
+  // after the reordered ones
+  std::vector<Index> pose_positions_;
+  std::vector<Index> landmark_positions_;
+  std::vector<Index> range_positions_;
+
+  // computes the positions above from the factor graph. Should only be called
+  // from updateProblemData() when the data matrix is rebuilt
+  void updateVariableOrdering();
+
+  // the position of the k-th range measurement's variable in the range block
+  Index getRangePosition(Index k) const;
+
+  // the number of Cholesky factorizations (of the preconditioner blocks and of
+  // the reduced translation block) that reused an earlier symbolic analysis
+  size_t num_symbolic_analyses_skipped_ = 0;
+
   // a flag to check if any data has been modified since last call to
   // updateProblemData()
   bool problem_data_up_to_date_ = false;
@@ -133,11 +231,11 @@ private:
   }
 
   // function to fill all of the submatrices built from range measurements.
-  // Should only be called from updateProblemData()
+  // Should only be called from getDataSubmatrices()
   void fillRangeSubmatrices();
 
   // function to fill all of the submatrices built from relative pose
-  // measurements. Should only be called from updateProblemData()
+  // measurements. Should only be called from getDataSubmatrices()
   void fillRelPoseSubmatrices();
 
   // function to construct the rotation connection Laplacian. Should only be
@@ -145,8 +243,8 @@ private:
   void fillRotConnLaplacian();
 
   /**
-   * @brief function to fill in the full data matrix from the *already computed*
-   * submatrices. Should only be called from updateProblemData()
+   * @brief function to fill in the full data matrix directly from the
+   * measurements. Should only be called from updateProblemData()
    *
    * The data matrix Q is a symmetric block matrix of the form:
    *            dn                r                 n + l
@@ -180,23 +278,162 @@ private:
    *  A_r = range_incidence_matrix
    *  A_t = rel_pose_incidence_matrix
    *
+   * Rather than forming these products, each measurement's contribution to
+   * the blocks above is scattered straight into the rows of Q, which are
+   * reserved ahead of time (see forEachDataMatrixEntry())
+   *
    */
   void fillDataMatrix();
 
-  void fillImplicitFormulationMatrices();
+  // assembles the data matrix from the measurements (see fillDataMatrix())
+  SparseMatrix assembleDataMatrix() const;
+
+  // returns data_matrix_, or, with matrix-free products, assembles the data
+  // matrix into assembled and returns it
+  const SparseMatrix &getAssembledDataMatrix(SparseMatrix &assembled) const;
+
+  // builds matrix_free_data_matrix_ from the measurements. Should only be
+  // called from updateProblemData()
+  void fillMatrixFreeDataMatrix();
+
+  // the part of updateProblemData() for matrix-free products
+  void updateMatrixFreeProblemData();
+
+  /**
+   * @brief function to add the measurements appended since the last call to
+   * updateProblemData() to the already assembled data matrix. Should only be
+   * called from updateProblemData()
+   *
+   * If no variables were added and every new contribution falls on an existing
+   * nonzero, the values of the data matrix (and of Qmain_ and TransOffDiagRed_
+   * if they are assembled) are updated in place and the sparsity pattern is
+   * left untouched. Otherwise the existing rows are relabelled into the new
+   * variable ordering and extended with the new contributions
+   *
+   * @return true if Qmain_ and TransOffDiagRed_ were patched in place
+   */
+  bool patchDataMatrix();
+
+  /**
+   * @brief calls add_entry(row, col, value) for every contribution of every
+   * measurement to the (symmetric) data matrix. Contributions to the same
+   * coefficient are reported separately and must be summed by the caller.
+   * With upper-triangular storage, the contributions below the diagonal are
+   * skipped
+   *
+   * @tparam EntryFunc callable with signature void(Index, Index, Scalar)
+   * @param add_entry the function to call on each contribution
+   * @param start the number of measurements of each kind to skip, e.g., to
+   * visit only the measurements added since the last update
+   */
+  template <typename EntryFunc>
+  void forEachDataMatrixEntry(EntryFunc &&add_entry,
+                              const ProblemCounts &start = ProblemCounts()) const;
+
+  /**
+   * @brief fills in the matrices used by the implicit formulation
+   *
+   * @param extract_blocks if false, Qmain_ and TransOffDiagRed_ are assumed to
+   * be up to date (e.g., patched in place) and are not re-extracted from the
+   * data matrix
+   */
+  void fillImplicitFormulationMatrices(bool extract_blocks = true);
 
   void updatePreconditioner();
 
+  /**
+   * @brief the matrix whose products dominate dataMatrixProduct() (the data
+   * matrix in the explicit formulation and Qmain_ in the implicit one), split
+   * into its rotation block, which is made of dense d x d blocks and is stored
+   * in full in BSR format, and the rest of its entries, which are stored like
+   * the data matrix. Only assembled if block_sparse_rotations_ is set, and
+   * stored in addition to the data matrix (and Qmain_), which the other users
+   * of the data matrix still read.
+   */
+  struct BlockSparseRotationSplit {
+    BlockSparseMatrix rotations;
+    SparseMatrix remainder;
+  };
+  BlockSparseRotationSplit block_sparse_rotation_split_;
+
+  // assembles block_sparse_rotation_split_ from the data matrix or Qmain_
+  void fillBlockSparseRotationSplit();
+
+  // computes QY = Q*Y (explicit formulation) or QY = Qmain_*Y (implicit
+  // formulation), reusing the storage of QY (which must not alias Y)
+  void mainDataMatrixProduct(const Matrix &Y, Matrix &QY) const;
+
   Matrix dataMatrixProduct(const Matrix &Y) const;
 
+  // computes QY = Q*Y, reusing the storage of QY (which must not alias Y)
+  void dataMatrixProduct(const Matrix &Y, Matrix &QY) const;
+
+  /**
+   * @brief scratch matrices for the intermediate results of the solver
+   * operations. They are resized on their first use after the problem size or
+   * the relaxation rank changes and reused afterwards, so that steady-state
+   * solver iterations do not allocate. Not thread-safe.
+   */
+  struct Workspace {
+    // TransOffDiagRed_^T * Y and the Cholesky solve with it (implicit
+    // formulation)
+    Matrix trans_rhs;
+    Matrix trans_solution;
+    Matrix trans_product;
+    // the row-major copy of the dense operand of sparseThinDenseProduct(),
+    // and the row-major product of symmetricThinDenseProduct()
+    RowMajorMatrix thin_product_rows;
+    RowMajorMatrix thin_product_result_rows;
+    // the input and output of the block Cholesky preconditioner, padded with
+    // the translations (implicit formulation)
+    Matrix lifted_rhs;
+    Matrix lifted_solution;
+  };
+  mutable Workspace workspace_;
+
+  /**
+   * @brief the product Q*Y at the last point Y it was computed for. Within an
+   * iteration of the optimizer the objective and the gradient are evaluated
+   * at the same point, so this saves recomputing Q*Y (which requires a
+   * Cholesky solve in the implicit formulation). Not thread-safe.
+   */
+  struct DataProductCache {
+    bool valid = false;
+    Matrix Y;
+    Matrix QY;
+    // the number of products computed because Y was not the cached point
+    size_t num_misses = 0;
+  };
+  mutable DataProductCache data_product_cache_;
+
+  // returns Q*Y, reusing the cached product if Y is the cached point
+  const Matrix &cachedDataMatrixProduct(const Matrix &Y) const;
+
+  /**
+   * @brief the state kept between calls to certify_solution(). The sparsity
+   * pattern of the certificate matrix S only depends on the measurements, so
+   * it is the same at every rank of the staircase and for every eta, and the
+   * symbolic analysis of S + eta * I is only computed for the first
+   * certification. Not thread-safe.
+   */
+  struct CertificationContext {
+    // the factorization of S + eta * I. Copies of the problem share it until
+    // one of them certifies a solution, which then gets its own
+    std::shared_ptr<CertificateFactorization> factorization;
+  };
+  mutable CertificationContext certification_context_;
+
 public:
   Problem(int dim, int relaxation_rank,
           Formulation formulation = Formulation::Explicit,
-          Preconditioner preconditioner = Preconditioner::RegularizedCholesky)
+          Preconditioner preconditioner = Preconditioner::RegularizedCholesky,
+          DataMatrixOperator data_matrix_operator =
+              DataMatrixOperator::Assembled)
       : dim_(dim),
         relaxation_rank_(relaxation_rank),
         formulation_(formulation),
         preconditioner_(preconditioner),
+        data_matrix_operator_(data_matrix_operator),
         origin_symbol_(Symbol("O0")),
         manifolds_(Manifolds()) {
     // relaxation rank must be >= dim
@@ -238,11 +475,14 @@ public:
 
   void printProblem() const;
 
-  // function to get read-only references to the data submatrices
+  // function to get read-only references to the data submatrices. These are
+  // not needed to assemble the data matrix, so they are only built on request
   const CoraDataSubmatrices &getDataSubmatrices() {
     if (!problem_data_up_to_date_) {
       updateProblemData();
     }
+    fillRangeSubmatrices();
+    fillRelPoseSubmatrices();
     return data_submatrices_;
   }
 
@@ -280,6 +520,7 @@ public:
   bool last_cert_results_valid_ = false;
 
   void updateProblemData();
+  // the data matrix with both triangles stored (see dataMatrixStorage())
   SparseMatrix getDataMatrix();
 
   // the full size of the full (explicit problem) data matrix
@@ -335,7 +576,140 @@ public:
   void setPreconditioner(Preconditioner preconditioner) {
     preconditioner_ = preconditioner;
   }
-  void setFormulation(Formulation formulation) { formulation_ = formulation; }
+  void setFormulation(Formulation formulation) {
+    if (formulation != formulation_) {
+      // the implicit formulation blocks are not maintained in the explicit
+      // formulation, so they must be rebuilt rather than patched
+      Qmain_ = SparseMatrix();
+      TransOffDiagRed_ = SparseMatrix();
+      data_product_cache_.valid = false;
+    }
+    formulation_ = formulation;
+  }
+
+  /**
+   * @brief enables/disables incremental updates. When enabled,
+   * updateProblemData() only adds the measurements appended since its last
+   * call to the data matrix rather than rebuilding it from scratch. This is
+   * useful when measurements arrive in a stream
+   */
+  void setIncrementalUpdates(bool incremental) {
+    incremental_updates_ = incremental;
+  }
+  bool incrementalUpdates() const { return incremental_updates_; }
+
+  /**
+   * @brief sets whether the data matrix is stored in full or as its upper
+   * triangle. Upper-triangular storage roughly halves the memory of the data
+   * matrix (and of the certificate matrix built from it) and the memory
+   * traffic of the products with it. The products scatter the lower-triangle
+   * contributions and sum them across threads (see
+   * symmetricThinDenseProduct()), which makes them slower than with full
+   * storage on a single thread or when the matrix fits in cache, so this is
+   * mainly a trade of speed for memory. Takes effect at the next call to
+   * updateProblemData()
+   */
+  void setDataMatrixStorage(MatrixStorage storage) {
+    if (storage != data_matrix_storage_) {
+      problem_data_up_to_date_ = false;
+      // the stored matrices must be rebuilt rather than patched
+      data_matrix_ = SparseMatrix();
+      Qmain_ = SparseMatrix();
+      TransOffDiagRed_ = SparseMatrix();
+    }
+    data_matrix_storage_ = storage;
+  }
+  MatrixStorage dataMatrixStorage() const { return data_matrix_storage_; }
+
+  /**
+   * @brief enables/disables products with the rotation block of the data
+   * matrix in block sparse (BSR) format. The rotation block is made of dense
+   * d x d blocks, so BSR storage needs one column index per block rather than
+   * per nonzero and its products use fixed-size d x d block kernels. The other
+   * rows and columns are still multiplied in (scalar) CSR format. Takes effect
+   * at the next call to updateProblemData()
+   *
+   * This trades memory for speed: the split (the rotation block in BSR format,
+   * in full even with upper-triangular storage, and a CSR copy of the other
+   * entries) is stored in addition to the data matrix, which the
+   * preconditioners, the certificate matrix and the incremental updates still
+   * read. It takes about as much memory as the full data matrix (see
+   * blockSparseRotationMemoryUsage() and benchmark_spmm)
+   */
+  void setBlockSparseRotations(bool block_sparse) {
+    if (block_sparse != block_sparse_rotations_) {
+      problem_data_up_to_date_ = false;
+    }
+    block_sparse_rotations_ = block_sparse;
+  }
+  bool blockSparseRotations() const { return block_sparse_rotations_; }
+
+  /**
+   * @brief sets the order of the variables within each block (rotations,
+   * ranges and translations) of the data matrix. Reordering places variables
+   * that share measurements close together, which improves the locality of
+   * the products with the data matrix (e.g., when the poses of several robots
+   * are interleaved). getRotationIdx(), getRangeIdx() and getTranslationIdx(),
+   * and the functions that extract or save solutions through them, account
+   * for the order. The order is recomputed whenever updateProblemData()
+   * rebuilds the data matrix, so solutions from before that call must not be
+   * reused
+   */
+  void setVariableOrdering(VariableOrdering ordering) {
+    if (ordering != variable_ordering_) {
+      problem_data_up_to_date_ = false;
+      // the data matrix must be rebuilt in the new order rather than patched
+      data_matrix_ = SparseMatrix();
+      Qmain_ = SparseMatrix();
+      TransOffDiagRed_ = SparseMatrix();
+    }
+    variable_ordering_ = ordering;
+  }
+  VariableOrdering variableOrdering() const { return variable_ordering_; }
+
+  DataMatrixOperator getDataMatrixOperator() const {
+    return data_matrix_operator_;
+  }
+
+  // the number of bytes used to store the edges of the matrix-free data
+  // matrix (zero if the data matrix is assembled)
+  size_t matrixFreeMemoryUsage() const {
+    return data_matrix_operator_ == DataMatrixOperator::MatrixFree
+               ? matrix_free_data_matrix_.memoryUsage()
+               : 0;
+  }
+
+  // the number of bytes used to store the block sparse rotation split of the
+  // data matrix, on top of the data matrix itself (zero if it is disabled)
+  size_t blockSparseRotationMemoryUsage() const {
+    const SparseMatrix &remainder = block_sparse_rotation_split_.remainder;
+    return block_sparse_rotation_split_.rotations.memoryUsage() +
+           remainder.nonZeros() *
+               (sizeof(Scalar) + sizeof(SparseMatrix::StorageIndex)) +
+           (remainder.outerSize() + 1) * sizeof(SparseMatrix::StorageIndex);
+  }
+
+  // the edges of the matrix-free data matrix (empty if the data matrix is
+  // assembled)
+  const MatrixFreeDataMatrix &getMatrixFreeDataMatrix() const {
+    return matrix_free_data_matrix_;
+  }
+
+  // whether the last call to updateProblemData() changed the sparsity pattern
+  // of the data matrix (and hence of the matrices factored from it)
+  bool dataMatrixPatternChanged() const { return data_matrix_pattern_changed_; }
+
+  // the number of times the symbolic analysis of a Cholesky factorization
+  // (preconditioner blocks or the implicit formulation's translation block)
+  // was skipped because the sparsity pattern had not changed
+  size_t numSymbolicAnalysesSkipped() const {
+    return num_symbolic_analyses_skipped_;
+  }
+
+  /** The diagonal blocks of the Lagrange multipliers associated with the
+   * Stiefel (d x dn matrix of d x d blocks) and oblique (r-vector) constraints
+   */
+  using LambdaBlocks = std::pair<Matrix, Vector>;
 
   Scalar evaluateObjective(const Matrix &Y) const;
   Matrix Euclidean_gradient(const Matrix &Y) const;
@@ -344,18 +718,58 @@ public:
   Matrix Riemannian_Hessian_vector_product(const Matrix &Y,
                                            const Matrix &NablaF_Y,
                                            const Matrix &Ydot) const;
+
+  /**
+   * @brief Riemannian Hessian-vector product at Y, given the Lagrange
+   * multiplier blocks at Y (see compute_Lambda_blocks()). The blocks only
+   * depend on Y, so when computing many products at the same iterate (e.g.,
+   * in the inner loop of the trust-region solver) they should be computed
+   * once and reused.
+   */
+  Matrix Riemannian_Hessian_vector_product(const Matrix &Y,
+                                           const LambdaBlocks &Lambda_blocks,
+                                           const Matrix &Ydot) const;
   Matrix tangent_space_projection(const Matrix &Y, const Matrix &Ydot) const;
   Matrix precondition(const Matrix &V) const;
   Matrix projectToManifold(const Matrix &A) const;
+
+  /**
+   * @brief Projects A onto the manifold in place, without the copies made by
+   * projectToManifold()
+   */
+  void projectToManifoldInPlace(Matrix &A) const;
   Matrix retract(const Matrix &Y, const Matrix &V) const;
 
-  /********** Certification **************/
+  /**
+   * In-place versions of the operations above, for use in the solver's inner
+   * loop. They write their result into the last argument, reusing its
+   * storage, and do not allocate once the outputs (and the problem's
+   * workspace) are sized, except inside the CHOLMOD solves of the implicit
+   * formulation and the Cholesky-based preconditioners. The outputs may alias
+   * the tangent vector (NablaF_Y, Ydot or V) unless noted otherwise, but not
+   * the point Y.
+   */
+  void Euclidean_gradient(const Matrix &Y, Matrix &NablaF_Y) const;
+  void Riemannian_gradient(const Matrix &Y, const Matrix &NablaF_Y,
+                           Matrix &grad_F_Y) const;
+  // HYdot must not alias Ydot
+  void Riemannian_Hessian_vector_product(const Matrix &Y,
+                                         const LambdaBlocks &Lambda_blocks,
+                                         const Matrix &Ydot,
+                                         Matrix &HYdot) const;
+  void tangent_space_projection(const Matrix &Y, const Matrix &Ydot,
+                                Matrix &result) const;
+  void precondition(const Matrix &V, Matrix &result) const;
+  void retract(const Matrix &Y, const Matrix &V, Matrix &Y_plus) const;
 
-  using LambdaBlocks = std::pair<Matrix, Vector>;
+  /********** Certification **************/
 
   /**
    * @brief Check if a solution is certified. If not, compute a direction of
-   * negative curvature and its associated Rayleigh quotient.
+   * negative curvature and its associated Rayleigh quotient. The Lagrange
+   * multipliers are computed from the product Q*Y cached by the last
+   * evaluation of the objective or gradient at Y (e.g., the final iterate of
+   * the optimizer), if there is one.
    *
    * @param Y the rank-r solution to certify
    * @param eta the regularization parameter (tolerance on PSDness of the
@@ -374,6 +788,21 @@ public:
                                Scalar max_fill_factor = 3,
                                Scalar drop_tol = 1e-3) const;
 
+  /** The number of products Q*Y computed by the objective, the gradient and
+   * certify_solution() because Y was not the last point evaluated (see
+   * DataProductCache) */
+  size_t numDataProductCacheMisses() const {
+    return data_product_cache_.num_misses;
+  }
+
+  /** The number of symbolic analyses of the regularized certificate matrix
+   * computed by certify_solution() so far (see CertificationContext) */
+  size_t numCertificationAnalyses() const {
+    return certification_context_.factorization
+               ? certification_context_.factorization->numAnalyses()
+               : 0;
+  }
+
   /** Given the d x dn block matrix containing the diagonal blocks of Lambda,
    * this function computes and returns the matrix Lambda itself */
   SparseMatrix
@@ -387,15 +816,37 @@ public:
    * (cf. eq. (119) in the SE-Sync tech report) */
   LambdaBlocks compute_Lambda_blocks(const Matrix &Y) const;
 
+  /** Same as above, but with the product Q*Y (i.e., the Euclidean gradient at
+   * Y) already computed */
+  LambdaBlocks compute_Lambda_blocks(const Matrix &Y, const Matrix &QY) const;
+
+  /** Same as above, but reusing the storage of Lambda_blocks */
+  void compute_Lambda_blocks(const Matrix &Y, const Matrix &QY,
+                             LambdaBlocks &Lambda_blocks) const;
+
   /**
    * @brief Get the certificate matrix as Q - Lambda. If this matrix is PSD,
-   * then the solution is certified.
+   * then the solution is certified. It is stored like the data matrix (see
+   * dataMatrixStorage()).
    *
    * @param Lambda the Lagrange multiplier matrix
    * @return SparseMatrix
    */
   SparseMatrix get_certificate_matrix(const Matrix &Y) const;
 
+  /**
+   * @brief Get the certificate matrix Q - Lambda in operator form: its
+   * products are computed as Q*X minus the block-diagonal product Lambda*X,
+   * without assembling it. The operator refers to Lambda_blocks and to this
+   * problem, which must outlive it.
+   *
+   * @param Lambda_blocks the blocks of the Lagrange multiplier matrix (see
+   * compute_Lambda_blocks())
+   * @return CertificateOperator
+   */
+  CertificateOperator
+  get_certificate_operator(const LambdaBlocks &Lambda_blocks) const;
+
   /************** Utilities **********************/
 
   Matrix getTranslationExplicitSolution(const Matrix &Y) const;
@@ -0,0 +1,155 @@
+/**
+ * @file CORA_spmm.h
+ * @brief Products of CORA's (row-major) sparse matrices with the thin dense
+ * matrices that hold the variables, which have only a handful of columns
+ * (the relaxation rank).
+ */
+
+#pragma once
+
+#include <CORA/CORA_types.h>
+
+#include <type_traits>
+#include <vector>
+
+namespace CORA {
+
+typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+    RowMajorMatrix;
+
+/** The largest number of columns of X handled by the specialized kernel */
+constexpr Index kMaxThinProductCols = 10;
+
+/**
+ * @brief Calls kernel(std::integral_constant<int, Cols>()) with the
+ * compile-time Cols = cols, which must be in [1, kMaxThinProductCols]. Like
+ * dispatchOnDim(), but for the number of columns of a thin dense matrix.
+ */
+template <int Cols = 1, typename Kernel>
+void dispatchOnThinCols(Index cols, Kernel &&kernel) {
+  if (cols == Cols) {
+    kernel(std::integral_constant<int, Cols>());
+  } else if constexpr (Cols < kMaxThinProductCols) {
+    dispatchOnThinCols<Cols + 1>(cols, kernel);
+  }
+}
+
+/**
+ * @brief Computes AX = A * X for a thin X. Eigen's generic product traverses
+ * the rows of A once per column of X. For X with at most
+ * kMaxThinProductCols columns, this instead traverses A once and, for each of
+ * its rows, accumulates the rows of X (copied into row-major order so that each
+ * is a contiguous, fixed-size vector) in SIMD registers. The rows of A are
+ * split among threads with parallelFor(). Wider X fall back to Eigen's
+ * product.
+ *
+ * @param A the sparse matrix
+ * @param X the dense matrix, with A.cols() rows
+ * @param AX the product, resized as needed (must not alias X)
+ * @param X_rows storage for the row-major copy of X, which is reused across
+ * calls
+ */
+void sparseThinDenseProduct(const SparseMatrix &A, const Matrix &X, Matrix &AX,
+                            RowMajorMatrix &X_rows);
+
+/** Same as above, allocating the row-major copy of X */
+void sparseThinDenseProduct(const SparseMatrix &A, const Matrix &X,
+                            Matrix &AX);
+
+/**
+ * @brief Computes AX = A * X for a symmetric A stored as given by storage. If
+ * only the upper triangle of A is stored, each off-diagonal nonzero is applied
+ * to both of its rows in a single pass over A, which reads half as much of A
+ * as a product with the full matrix. The rows are split into one contiguous
+ * block per thread (of at least 2048 rows); the contributions of a block to the
+ * rows below it go to partial sums of the block, which are added once every
+ * block is done. The scattered updates and the partial sums cost more than
+ * reading the lower triangle, so on a single thread (or when A fits in cache)
+ * this is slower than the product with the full matrix: upper-triangular
+ * storage mainly trades speed for memory. Full storage uses
+ * sparseThinDenseProduct().
+ *
+ * @param A the symmetric sparse matrix
+ * @param storage which part of A is stored
+ * @param X the dense matrix, with A.cols() rows
+ * @param AX the product, resized as needed (must not alias X)
+ * @param X_rows storage for the row-major copy of X
+ * @param AX_rows storage for the row-major accumulator of the product and for
+ * the partial sums of the blocks (only used with upper-triangular storage)
+ */
+void symmetricThinDenseProduct(const SparseMatrix &A, MatrixStorage storage,
+                               const Matrix &X, Matrix &AX,
+                               RowMajorMatrix &X_rows,
+                               RowMajorMatrix &AX_rows);
+
+/** Same as above, allocating the row-major copies */
+void symmetricThinDenseProduct(const SparseMatrix &A, MatrixStorage storage,
+                               const Matrix &X, Matrix &AX);
+
+/** Returns the symmetric matrix A (stored as given by storage) with both of
+ * its triangles stored */
+SparseMatrix getFullSymmetricMatrix(const SparseMatrix &A,
+                                    MatrixStorage storage);
+
+/**
+ * @brief A sparse matrix made of dense block_size x block_size blocks, stored
+ * in block compressed sparse row (BSR) format: the blocks of each block row
+ * are stored consecutively (each in column-major order), with one column index
+ * per block rather than one per nonzero. The rotation block of the data
+ * matrix is made of dense d x d blocks, for which this saves most of the index
+ * storage and allows fixed-size d x d block products.
+ */
+class BlockSparseMatrix {
+public:
+  BlockSparseMatrix() = default;
+
+  /**
+   * @brief Converts A, whose dimensions must be multiples of block_size. Every
+   * block with at least one stored entry is stored in full.
+   */
+  BlockSparseMatrix(const SparseMatrix &A, Index block_size);
+
+  Index rows() const { return block_rows_ * block_size_; }
+  Index cols() const { return block_cols_ * block_size_; }
+  Index blockSize() const { return block_size_; }
+  Index numBlockRows() const { return block_rows_; }
+  Index numBlocks() const {
+    return static_cast<Index>(block_col_idxs_.size());
+  }
+
+  // the blocks of block row i are [blockRowStarts()[i], blockRowStarts()[i+1])
+  const Index *blockRowStarts() const { return block_row_starts_.data(); }
+  // the block column of each block
+  const Index *blockColIdxs() const { return block_col_idxs_.data(); }
+  // the block_size x block_size (column-major) values of each block
+  const Scalar *blockValues() const { return values_.data(); }
+
+  // the matrix in (scalar) compressed sparse row format
+  SparseMatrix toSparse() const;
+
+  /** The number of bytes used to store the blocks and their indices */
+  size_t memoryUsage() const;
+
+private:
+  Index block_size_ = 1;
+  Index block_rows_ = 0;
+  Index block_cols_ = 0;
+  std::vector<Index> block_row_starts_ = {0};
+  std::vector<Index> block_col_idxs_;
+  std::vector<Scalar> values_;
+};
+
+/**
+ * @brief Adds A * X to AX, one fixed-size block product per block of A (for
+ * block sizes 2 and 3, and X with at most kMaxThinProductCols columns). The
+ * block rows of A are split among threads with parallelFor().
+ *
+ * @param A the block sparse matrix
+ * @param X the dense matrix, with A.cols() rows
+ * @param AX the matrix to add the product to, with A.rows() rows (must not
+ * alias X)
+ */
+void addBlockSparseProduct(const BlockSparseMatrix &A, const ConstMatrixRef &X,
+                           MatrixRef AX);
+
+} // namespace CORA
@@ -8,7 +8,9 @@
 #include <Eigen/Dense>
 #include <Eigen/Sparse>
 
+#include <functional>
 #include <string>
+#include <string_view>
 
 #include "Optimization/Riemannian/TNT.h"
 
@@ -30,11 +32,13 @@ public:
                          std::to_string(act_rows) + ", " +
                          std::to_string(act_cols) + ")") {}
 };
-inline void checkMatrixShape(const std::string &func_name, Index exp_rows,
+// the name is only copied into a string if the check fails, as this is called
+// in the solver's inner loop
+inline void checkMatrixShape(std::string_view func_name, Index exp_rows,
                              Index exp_cols, Index act_rows, Index act_cols) {
   if (exp_rows != act_rows || exp_cols != act_cols) {
-    throw MatrixShapeException(func_name, exp_rows, exp_cols, act_rows,
-                               act_cols);
+    throw MatrixShapeException(std::string(func_name), exp_rows, exp_cols,
+                               act_rows, act_cols);
   }
 }
 
@@ -42,12 +46,27 @@ namespace CORA {
 
 typedef double Scalar;
 
+// the dense types for a given scalar type T; the types below are their
+// instantiations for Scalar. Only the manifolds are compiled for float as well,
+// and only with the benchmarks (CORA_FLOAT_MANIFOLDS): Problem, the
+// preconditioners and the certification work in Scalar alone
+template <typename T> using VectorT = Eigen::Matrix<T, Eigen::Dynamic, 1>;
+template <typename T>
+using MatrixT = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>;
+template <typename T> using MatrixRefT = Eigen::Ref<MatrixT<T>>;
+template <typename T> using ConstMatrixRefT = Eigen::Ref<const MatrixT<T>>;
+
 typedef Eigen::VectorXi VectorXi;
 typedef Eigen::Index Index;
-typedef Eigen::VectorXd Vector;
-typedef Eigen::MatrixXd Matrix;
+typedef VectorT<Scalar> Vector;
+typedef MatrixT<Scalar> Matrix;
 typedef Eigen::DiagonalMatrix<Scalar, Eigen::Dynamic> DiagonalMatrix;
 
+// (writable) views of a Matrix or of a block of one, which are passed without
+// copying
+typedef MatrixRefT<Scalar> MatrixRef;
+typedef ConstMatrixRefT<Scalar> ConstMatrixRef;
+
 enum class Formulation {
   // The CORA problem in which translations are explicitly represented
   Explicit,
@@ -69,10 +88,53 @@ struct CertResults {
  * documentation page on "Eigen and Multithreading") */
 typedef Eigen::SparseMatrix<Scalar, Eigen::RowMajor> SparseMatrix;
 
+/** How the (symmetric) data and certificate matrices are stored */
+enum class MatrixStorage {
+  // both triangles are stored
+  Full,
+  // only the upper triangle (including the diagonal) is stored, which halves
+  // the memory (and the memory traffic of products) of the off-diagonal part
+  UpperTriangular
+};
+
+/**
+ * @brief A symmetric certificate matrix S given in operator form: the LOBPCG
+ * iterations of fast_verification() only need the products S * X, so the
+ * matrix itself is only assembled (with the regularization eta * I added)
+ * when it is factorized.
+ */
+struct CertificateOperator {
+  // the number of rows (and columns) of S
+  Index size = 0;
+  // computes SX = S * X
+  std::function<void(const Matrix &X, Matrix &SX)> multiply;
+  // returns S + eta * I, stored as given by storage
+  std::function<SparseMatrix(Scalar eta)> assembleRegularized;
+  MatrixStorage storage = MatrixStorage::Full;
+};
+
 // manifold operations
 enum class StiefelRetraction { QR, Polar };
 enum class ObliqueRetraction { Normalize };
 
+/** How products with the data matrix are computed */
+enum class DataMatrixOperator {
+  // multiply with the data matrix assembled in CSR format
+  Assembled,
+  // apply the contribution of each measurement directly, without assembling
+  // (or storing) the data matrix
+  MatrixFree
+};
+
+/** The order of the variables within each block of the data matrix */
+enum class VariableOrdering {
+  // the order in which the variables (and range measurements) were added
+  Insertion,
+  // reverse Cuthill-McKee order of the factor graph, which places variables
+  // that share measurements close together
+  ReverseCuthillMcKee
+};
+
 /** The preconditioner applied to the inner tCG solver. */
 enum class Preconditioner { None, Jacobi, BlockCholesky, RegularizedCholesky };
 
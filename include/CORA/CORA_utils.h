@@ -1,5 +1,6 @@
 #pragma once
 
+#include <CORA/CORA_preconditioners.h>
 #include <CORA/CORA_problem.h>
 #include <CORA/CORA_types.h>
 #include <CORA/Symbol.h>
@@ -9,6 +10,26 @@
 
 namespace CORA {
 
+/** Returns the operator form of the sparse matrix S, stored as given by
+ * storage. S must outlive the operator. */
+CertificateOperator
+getCertificateOperator(const SparseMatrix &S,
+                       MatrixStorage storage = MatrixStorage::Full);
+
+/**
+ * @brief Same as fast_verification() below, with the certificate matrix S
+ * given in operator form. The regularized matrix M := S + eta * I is assembled
+ * for the Cholesky test and released before LOBPCG, which only multiplies
+ * with S, and assembled again only if the incomplete factorization-based
+ * preconditioner is needed.
+ */
+CertResults fast_verification(const CertificateOperator &S, Scalar eta,
+                              const Matrix &X0, size_t max_iters = 1000,
+                              Scalar max_fill_factor = 3,
+                              Scalar drop_tol = 1e-3,
+                              CertificateFactorization *factorization =
+                                  nullptr);
+
 /**
  * @brief This function implements the fast solution verification method
  * (Algorithm 3) described in the paper "Accelerating Certifiable Estimation
@@ -28,12 +49,20 @@ namespace CORA {
  * factorization-based preconditioner
  * @param drop_tol the drop tolerance to use in the incomplete
  * factorization-based preconditioner
+ * @param storage whether S is stored in full or as its upper triangle
+ * @param factorization if given, the factorization of M is computed in it,
+ * reusing its symbolic analysis if M has the same sparsity pattern as the
+ * matrix it last factorized (e.g., the certificate matrix of the same problem
+ * at another rank, or with another eta)
  * @return the results of the PSD test
  */
 CertResults fast_verification(const SparseMatrix &S, Scalar eta,
                               const Matrix &X0, size_t max_iters = 1000,
                               Scalar max_fill_factor = 3,
-                              Scalar drop_tol = 1e-3);
+                              Scalar drop_tol = 1e-3,
+                              MatrixStorage storage = MatrixStorage::Full,
+                              CertificateFactorization *factorization =
+                                  nullptr);
 
 /**
  * @brief This function implements the fast solution verification method
@@ -54,18 +83,49 @@ CertResults fast_verification(const SparseMatrix &S, Scalar eta,
  * factorization-based preconditioner
  * @param drop_tol the drop tolerance to use in the incomplete
  * factorization-based preconditioner
+ * @param storage whether S is stored in full or as its upper triangle
  * @return the results of the PSD test
  */
 inline CertResults fast_verification(const SparseMatrix &S, Scalar eta,
                                      size_t nx, size_t max_iters = 1000,
                                      Scalar max_fill_factor = 3,
-                                     Scalar drop_tol = 1e-3) {
+                                     Scalar drop_tol = 1e-3,
+                                     MatrixStorage storage =
+                                         MatrixStorage::Full) {
   return fast_verification(S, eta, Matrix::Random(S.rows(), nx), max_iters,
-                           max_fill_factor, drop_tol);
+                           max_fill_factor, drop_tol, storage);
 }
 
 Matrix projectToSOd(const Matrix &A);
 
+/**
+ * @brief Computes the singular values and the right singular vectors of a
+ * tall N x r matrix Y from the self-adjoint eigendecomposition of its r x r
+ * Gram matrix Y^T Y, which is much cheaper than a (thin) SVD of Y itself when
+ * N >> r. The left singular vectors (scaled by the singular values) are
+ * Y * V. Forming Y^T Y squares the condition number of Y, so singular values
+ * smaller than about sqrt(epsilon) * sigma_max are only accurate in absolute
+ * terms.
+ *
+ * @param Y the matrix to decompose
+ * @param singular_values the singular values of Y, in decreasing order
+ * @param V the corresponding right singular vectors (r x r)
+ */
+void thinSvdFromGram(const Matrix &Y, Vector &singular_values, Matrix &V);
+
+/**
+ * @brief Computes the reverse Cuthill-McKee ordering of an undirected graph,
+ * which reduces the bandwidth of its adjacency matrix. Each connected
+ * component is started from a pseudo-peripheral vertex.
+ *
+ * @param adjacency the neighbors of each vertex (each edge must be listed by
+ * both of its vertices)
+ * @return the vertices in their new order, i.e., the new position k holds the
+ * vertex order[k]
+ */
+std::vector<Index>
+reverseCuthillMcKee(const std::vector<std::vector<Index>> &adjacency);
+
 void saveSolnToG20(const std::vector<Symbol> pose_symbols,
                    const Problem &problem, const Matrix &soln,
                    const std::string &fpath);
@@ -17,12 +17,19 @@
 
 namespace CORA {
 
-class MatrixManifold {
+/**
+ * @brief The base of the matrix manifolds, whose points (and tangent vectors)
+ * are dense matrices with entries of type ScalarType. MatrixManifold is the
+ * instantiation for Scalar.
+ */
+template <typename ScalarType> class MatrixManifoldT {
 public:
+  using MatrixType = MatrixT<ScalarType>;
+
   /// CONSTRUCTORS AND MUTATORS
 
   // Default constructor -- sets all dimensions to 0
-  MatrixManifold() = default;
+  MatrixManifoldT() = default;
 
   /// GEOMETRY
 
@@ -32,7 +39,7 @@ public:
    * @param A the matrix to project
    * @return Matrix the projection of A onto M
    */
-  virtual Matrix projectToManifold(const Matrix &A) const = 0;
+  virtual MatrixType projectToManifold(const MatrixType &A) const = 0;
 
   /**
    * @brief projectToTangentSpaceects a matrix V onto the tangent space T_Y(M)
@@ -42,8 +49,8 @@ public:
    * @param V the matrix to project
    * @return Matrix the projection of V onto T_Y(M)
    */
-  virtual Matrix projectToTangentSpace(const Matrix &Y,
-                                       const Matrix &V) const = 0;
+  virtual MatrixType projectToTangentSpace(const MatrixType &Y,
+                                           const MatrixType &V) const = 0;
 
   /**
    * @brief Computes the trace inner product of A and B
@@ -52,13 +59,13 @@ public:
    * @param B the second matrix
    * @return Scalar the inner product of A and B
    */
-  Scalar innerProduct(const Matrix &A, const Matrix &B) const {
+  ScalarType innerProduct(const MatrixType &A, const MatrixType &B) const {
     // get the inner product by taking the row-wise summation of the Hadamard
     // product of A and B
     return (A.array() * B.array()).sum();
   }
 
-  Matrix retract(const Matrix &Y, const Matrix &V) const {
+  MatrixType retract(const MatrixType &Y, const MatrixType &V) const {
     // We use projection-based retraction, as described in
     // "Projection-Like Retractions on Matrix Manifolds" by Absil
     // and Malick
@@ -67,4 +74,6 @@ public:
   }
 };
 
+using MatrixManifold = MatrixManifoldT<Scalar>;
+
 } // namespace CORA
@@ -18,7 +18,18 @@
 
 namespace CORA {
 
-class ObliqueManifold : public MatrixManifold {
+/** The scalar type of the matrices is ScalarType; ObliqueManifold is the
+ * instantiation for Scalar. The float instantiation is compiled only with the
+ * benchmarks (CORA_FLOAT_MANIFOLDS) to measure the kernels (see
+ * benchmark_scalar_types) and is not a solver option.
+ */
+template <typename ScalarType>
+class ObliqueManifoldT : public MatrixManifoldT<ScalarType> {
+public:
+  using MatrixType = MatrixT<ScalarType>;
+  using MatrixRefType = MatrixRefT<ScalarType>;
+  using ConstMatrixRefType = ConstMatrixRefT<ScalarType>;
+
 private:
   // Dimension of ambient Euclidean space containing the unit vectors
   size_t r_;
@@ -30,7 +41,7 @@ public:
   /// CONSTRUCTORS AND MUTATORS
 
   // Default constructor -- sets all dimensions to 0
-  ObliqueManifold() = default;
+  ObliqueManifoldT() = default;
 
   /**
    * @brief Construct a new Oblique Manifold object
@@ -39,7 +50,7 @@ public:
    * vectors
    * @param n the number of unit vectors in the product
    */
-  ObliqueManifold(size_t r, size_t n) : r_(r), n_(n) {}
+  ObliqueManifoldT(size_t r, size_t n) : r_(r), n_(n) {}
 
   void set_r(size_t r) { r_ = r; }
   void set_n(size_t n) { n_ = n; }
@@ -54,7 +65,7 @@ public:
    * that this is a computationally cheap operation but is not a second-order
    * retraction. See Boumal "Optimization on Smooth Manifolds" for more details.
    */
-  Matrix projectToManifold(const Matrix &A) const;
+  MatrixType projectToManifold(const MatrixType &A) const;
 
   /**
    * @brief Projects a matrix A in R^{r x n} onto the tangent space T_Y(M) of
@@ -64,12 +75,39 @@ public:
    * @param Y the point defining the tangent space
    * @return Matrix
    */
-  Matrix projectToTangentSpace(const Matrix &Y, const Matrix &V) const;
+  MatrixType projectToTangentSpace(const MatrixType &Y,
+                                   const MatrixType &V) const;
+
+  /// GEOMETRY IN THE TRANSPOSED LAYOUT
+  // The following functions operate on the transposes (n x r matrices whose
+  // rows are the unit vectors) of the matrices above, which is how the range
+  // variables are stored in a CORA Problem. They write their result into the
+  // passed (block of a) matrix, so that no transposes or temporaries are
+  // needed.
+
+  /** Normalizes each row of A_T and writes the result into P_T, which may be
+   * A_T itself. */
+  void projectTransposedToManifold(const ConstMatrixRefType &A_T,
+                                   MatrixRefType P_T) const;
+
+  /** Computes the projection of V_T^T onto the tangent space at Y_T^T and
+   * writes its transpose into R_T, which may be V_T itself (but not Y_T). */
+  void projectTransposedToTangentSpace(const ConstMatrixRefType &Y_T,
+                                       const ConstMatrixRefType &V_T,
+                                       MatrixRefType R_T) const;
 
   /** Sample a random point on M, using the (optional) passed seed to initialize
    * the random number generator.  */
-  Matrix random_sample(const std::default_random_engine::result_type &seed =
-                           std::default_random_engine::default_seed) const;
+  MatrixType
+  random_sample(const std::default_random_engine::result_type &seed =
+                    std::default_random_engine::default_seed) const;
 };
 
+extern template class ObliqueManifoldT<double>;
+#ifdef CORA_FLOAT_MANIFOLDS
+extern template class ObliqueManifoldT<float>;
+#endif
+
+using ObliqueManifold = ObliqueManifoldT<Scalar>;
+
 } // namespace CORA
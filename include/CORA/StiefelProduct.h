@@ -17,7 +17,21 @@
 
 namespace CORA {
 
-class StiefelProduct : public MatrixManifold {
+/** The scalar type of the matrices is ScalarType; StiefelProduct is the
+ * instantiation for Scalar. The float instantiation is compiled only with the
+ * benchmarks (CORA_FLOAT_MANIFOLDS) to measure the kernels (see
+ * benchmark_scalar_types) and is not a solver option.
+ * It is not faster for 2D problems: a 2-row block of doubles fills one SSE
+ * packet, while Eigen has no packet of 2 floats on x86 and runs the float
+ * blocks of projectTransposedToTangentSpace() in scalar code, about 2x slower
+ * than double. */
+template <typename ScalarType>
+class StiefelProductT : public MatrixManifoldT<ScalarType> {
+public:
+  using MatrixType = MatrixT<ScalarType>;
+  using MatrixRefType = MatrixRefT<ScalarType>;
+  using ConstMatrixRefType = ConstMatrixRefT<ScalarType>;
+
 private:
   // Number of vectors in each orthonormal k-frame
   size_t k_{};
@@ -32,7 +46,7 @@ public:
   /// CONSTRUCTORS AND MUTATORS
 
   // Default constructor -- sets all dimensions to 0
-  StiefelProduct() = default;
+  StiefelProductT() = default;
 
   /**
    * @brief Construct a new Stiefel Product object
@@ -41,7 +55,7 @@ public:
    * @param p the dimension of ambient Euclidean space containing the frames
    * @param n the number of copies of St(k,p) in the product
    */
-  StiefelProduct(size_t k, size_t p, size_t n) : k_(k), p_(p), n_(n) {}
+  StiefelProductT(size_t k, size_t p, size_t n) : k_(k), p_(p), n_(n) {}
 
   void set_k(size_t k) { k_ = k; }
   void set_p(size_t p) { p_ = p; }
@@ -59,7 +73,7 @@ public:
 
   /** Given a generic matrix A in R^{p x kn}, this function computes the
    * projection of A onto R (closest point in the Frobenius norm sense).  */
-  Matrix projectToManifold(const Matrix &A) const;
+  MatrixType projectToManifold(const MatrixType &A) const;
 
   /** Helper function -- this computes and returns the product
    *
@@ -68,22 +82,65 @@ public:
    * where A, B, and C are p x kn matrices (cf. eq. (5) in the SE-Sync tech
    * report).
    */
-  Matrix SymBlockDiagProduct(const Matrix &A, const Matrix &BT,
-                             const Matrix &C) const;
+  MatrixType SymBlockDiagProduct(const MatrixType &A, const MatrixType &BT,
+                                 const MatrixType &C) const;
+
+  /** Helper function -- this computes and returns the product
+   *
+   *  P = A * BlockDiag(S)
+   *
+   * where A is a p x kn matrix and S is a k x kn matrix whose i-th k x k block
+   * is the i-th diagonal block of BlockDiag(S).
+   */
+  MatrixType BlockDiagProduct(const MatrixType &A, const MatrixType &S) const;
 
   /** Given an element Y in M and a matrix V in T_X(R^{p x kn}) (that is, a (p
    * x kn)-dimensional matrix V considered as an element of the tangent space to
    * the *entire* ambient Euclidean space at X), this function computes and
    * returns the projection of V onto T_X(M), the tangent space of M at X (cf.
    * eq. (42) in the SE-Sync tech report).*/
-  Matrix projectToTangentSpace(const Matrix &Y, const Matrix &V) const {
+  MatrixType projectToTangentSpace(const MatrixType &Y,
+                                   const MatrixType &V) const {
     return V - SymBlockDiagProduct(Y, Y.transpose(), V);
   }
 
+  /// GEOMETRY IN THE TRANSPOSED LAYOUT
+  // The following functions operate on the transposes (kn x p matrices whose
+  // i-th k x p block of rows is the transpose of the i-th frame) of the
+  // matrices above, which is how the rotation variables are stored in a CORA
+  // Problem. They write their result into the passed (block of a) matrix, so
+  // that no transposes or temporaries are needed.
+
+  /** Computes the projection of A_T^T onto M and writes its transpose into
+   * P_T, which may be A_T itself (i.e., the projection may be done in place).
+   */
+  void projectTransposedToManifold(const ConstMatrixRefType &A_T,
+                                   MatrixRefType P_T) const;
+
+  /** Computes the projection of V_T^T onto the tangent space of M at Y_T^T and
+   * writes its transpose into R_T, which may be V_T itself (but not Y_T). */
+  void projectTransposedToTangentSpace(const ConstMatrixRefType &Y_T,
+                                       const ConstMatrixRefType &V_T,
+                                       MatrixRefType R_T) const;
+
+  /** Subtracts the transpose of A_T^T * BlockDiag(S) (cf. BlockDiagProduct())
+   * from R_T, i.e., R_T -= BlockDiag(S)^T * A_T. R_T must not alias A_T. */
+  void subtractTransposedBlockDiagProduct(const MatrixType &S,
+                                          const ConstMatrixRefType &A_T,
+                                          MatrixRefType R_T) const;
+
   /** Sample a random point on M, using the (optional) passed seed to initialize
    * the random number generator.  */
-  Matrix random_sample(const std::default_random_engine::result_type &seed =
-                           std::default_random_engine::default_seed) const;
+  MatrixType
+  random_sample(const std::default_random_engine::result_type &seed =
+                    std::default_random_engine::default_seed) const;
 };
 
+extern template class StiefelProductT<double>;
+#ifdef CORA_FLOAT_MANIFOLDS
+extern template class StiefelProductT<float>;
+#endif
+
+using StiefelProduct = StiefelProductT<Scalar>;
+
 } // namespace CORA
@@ -11,6 +11,7 @@
 
 #pragma once
 
+#include <functional>
 #include <string>
 #include <utility>
 
@@ -52,6 +53,32 @@ public:
 };
 
 using SymbolPair = std::pair<Symbol, Symbol>;
+
+/** Hash for a SymbolPair that ignores the order of the two symbols, so that
+ * (a, b) and (b, a) hash identically. This matches the equality used by
+ * PairMeasurement, which treats measurements as undirected edges. */
+struct UnorderedSymbolPairHash {
+  size_t operator()(const SymbolPair &pair) const {
+    Key lo = pair.first.key();
+    Key hi = pair.second.key();
+    if (hi < lo) {
+      std::swap(lo, hi);
+    }
+    size_t seed = std::hash<Key>()(lo);
+    seed ^= std::hash<Key>()(hi) + 0x9e3779b97f4a7c15ULL + (seed << 6) +
+            (seed >> 2);
+    return seed;
+  }
+};
+
+/** Equality for a SymbolPair that ignores the order of the two symbols */
+struct UnorderedSymbolPairEqual {
+  bool operator()(const SymbolPair &a, const SymbolPair &b) const {
+    return (a.first == b.first && a.second == b.second) ||
+           (a.first == b.second && a.second == b.first);
+  }
+};
+
 inline uint64_t symIndex(Key key) { return Symbol(key).index(); }
 inline unsigned char symChar(Key key) { return Symbol(key).chr(); }
 inline Key symbol(unsigned char c, uint64_t j) { return Symbol(c, j).key(); }
@@ -26,8 +26,12 @@ namespace CORA {
  * CORA::Problem object
  *
  * @param filename the name of the file to parse
+ * @param data_matrix_operator how the problem computes products with its
+ * data matrix
  * @return CORA::Problem the parsed problem
  */
-Problem parsePyfgTextToProblem(const std::string &filename);
+Problem parsePyfgTextToProblem(
+    const std::string &filename,
+    DataMatrixOperator data_matrix_operator = DataMatrixOperator::Assembled);
 
 } // namespace CORA
@@ -1,6 +1,8 @@
 #include <CORA/CORA.h>
 #include <CORA/CORA_utils.h>
 
+#include <memory>
+
 #include <Optimization/Base/Concepts.h>
 #include <Optimization/Riemannian/TNT.h>
 
@@ -23,6 +25,82 @@ CORA::Scalar thresholdVal(CORA::Scalar val, CORA::Scalar lower_bound,
 
 namespace CORA {
 
+namespace {
+
+/** The storage reused by the solver functions across calls */
+struct TntWorkspace {
+  explicit TntWorkspace(const Problem &problem) : problem(problem) {}
+
+  const Problem &problem;
+  // the Lagrange multiplier blocks at the iterate of the last quadratic model
+  Problem::LambdaBlocks Lambda_blocks;
+  Matrix HYdot;
+  Matrix precon_Ydot;
+};
+
+} // namespace
+
+CoraTntFunctions getTntFunctions(const Problem &problem) {
+  auto workspace = std::make_shared<TntWorkspace>(problem);
+  CoraTntFunctions functions;
+
+  functions.f = [workspace](const Matrix &Y, const Matrix &NablaF_Y) {
+    return workspace->problem.evaluateObjective(Y);
+  };
+
+  functions.QM =
+      [workspace](const Matrix &Y, Matrix &grad,
+                  Optimization::Riemannian::LinearOperator<Matrix, Matrix,
+                                                           Matrix> &HessOp,
+                  Matrix &NablaF_Y) {
+        const Problem &problem = workspace->problem;
+        // Compute and cache Euclidean gradient at the current iterate (in
+        // place, reusing the storage of the previous iterate's gradients)
+        problem.Euclidean_gradient(Y, NablaF_Y);
+
+        // Compute Riemannian gradient from Euclidean gradient
+        problem.Riemannian_gradient(Y, NablaF_Y, grad);
+
+        // Define linear operator for computing Riemannian Hessian-vector
+        // products (cf. eq. (44) in the SE-Sync tech report). The Lagrange
+        // multiplier blocks only depend on the current iterate, so they are
+        // computed once here rather than in every Hessian-vector product. The
+        // operator only captures a pointer to the workspace, which
+        // std::function stores without allocating
+        problem.compute_Lambda_blocks(Y, NablaF_Y, workspace->Lambda_blocks);
+        HessOp = [workspace = workspace.get()](const Matrix &Y,
+                                               const Matrix &Ydot,
+                                               const Matrix &NablaF_Y) {
+          workspace->problem.Riemannian_Hessian_vector_product(
+              Y, workspace->Lambda_blocks, Ydot, workspace->HYdot);
+          return workspace->HYdot;
+        };
+      };
+
+  // metric over the tangent space is the standard matrix trace inner product
+  // (computed without forming V1^T * V2)
+  functions.metric = [](const Matrix &Y, const Matrix &V1, const Matrix &V2,
+                        const Matrix &NablaF_Y) {
+    return V1.cwiseProduct(V2).sum();
+  };
+
+  functions.retract = [workspace](const Matrix &Y, const Matrix &V,
+                                  const Matrix &NablaF_Y) {
+    return workspace->problem.retract(Y, V);
+  };
+
+  functions.precon = [workspace](const Matrix &Y, const Matrix &Ydot,
+                                 const Matrix &NablaF_Y) {
+    const Problem &problem = workspace->problem;
+    problem.precondition(Ydot, workspace->precon_Ydot);
+    problem.tangent_space_projection(Y, workspace->precon_Ydot,
+                                     workspace->precon_Ydot);
+    return workspace->precon_Ydot;
+  };
+
+  return functions;
+}
+
 CoraResult solveCORA(Problem &problem, // NOLINT(runtime/references)
                      const Matrix &x0, int max_relaxation_rank, bool verbose,
                      bool log_iterates, bool show_iterates) {
@@ -48,49 +126,12 @@ CoraResult solveCORA(Problem &problem, // NOLINT(runtime/references)
         << std::endl;
   }
 
-  // objective function
-  Optimization::Objective<Matrix, Scalar, Matrix> f =
-      [&problem](const Matrix &Y, const Matrix &NablaF_Y) {
-        return problem.evaluateObjective(Y);
-      };
-
-  // quadratic model
-  Optimization::Riemannian::QuadraticModel<Matrix, Matrix, Matrix> QM =
-      [&problem](const Matrix &Y, Matrix &grad,
-                 Optimization::Riemannian::LinearOperator<Matrix, Matrix,
-                                                          Matrix> &HessOp,
-                 Matrix &NablaF_Y) {
-        // Compute and cache Euclidean gradient at the current iterate
-        NablaF_Y = problem.Euclidean_gradient(Y);
-
-        // Compute Riemannian gradient from Euclidean gradient
-        grad = problem.Riemannian_gradient(Y, NablaF_Y);
-
-        // Define linear operator for computing Riemannian Hessian-vector
-        // products (cf. eq. (44) in the SE-Sync tech report)
-        HessOp = [&problem](const Matrix &Y, const Matrix &Ydot,
-                            const Matrix &NablaF_Y) {
-          return problem.Riemannian_Hessian_vector_product(Y, NablaF_Y, Ydot);
-        };
-      };
-
-  // get retraction from problem
-  Optimization::Riemannian::Retraction<Matrix, Matrix, Matrix> retract =
-      [&problem](const Matrix &Y, const Matrix &V, const Matrix &NablaF_Y) {
-        return problem.retract(Y, V);
-      };
+  CoraTntFunctions functions = getTntFunctions(problem);
+  const auto &[f, QM, metric, retract, precon] = functions;
 
   // Euclidean gradient (is passed by reference to QM for caching purposes)
   Matrix NablaF_Y;
 
-  // get preconditioner from problem
-  std::optional<
-      Optimization::Riemannian::LinearOperator<Matrix, Matrix, Matrix>>
-      precon = [&problem](const Matrix &Y, const Matrix &Ydot,
-                          const Matrix &NablaF_Y) {
-        return problem.tangent_space_projection(Y, problem.precondition(Ydot));
-      };
-
   // default TNT parameters for CORA
   Optimization::Riemannian::TNTParams<Scalar> params;
   params.Delta0 = 5;
@@ -115,12 +156,6 @@ CoraResult solveCORA(Problem &problem, // NOLINT(runtime/references)
   const int LOBPCG_BLOCK_SIZE = 10;
   Scalar eta;
 
-  // metric over the tangent space is the standard matrix trace inner product
-  Optimization::Riemannian::RiemannianMetric<Matrix, Matrix, Scalar, Matrix>
-      metric =
-          [](const Matrix &Y, const Matrix &V1, const Matrix &V2,
-             const Matrix &NablaF_Y) { return (V1.transpose() * V2).trace(); };
-
   // no custom instrumentation function for now
   std::optional<InstrumentationFunction> user_function = std::nullopt;
 
@@ -357,16 +392,11 @@ Matrix projectSolution(const Problem &problem, const Matrix &Y, bool verbose) {
   checkMatrixShape("projectSolution", problem.getExpectedVariableSize(),
                    Y.cols(), Y.rows(), Y.cols());
 
-  // First, compute a thin SVD of Y
-  Eigen::JacobiSVD<Matrix> svd(Y, Eigen::ComputeThinU);
-
-  Vector sigmas = svd.singularValues();
-  // Construct a diagonal matrix comprised of the first d singular values
-  DiagonalMatrix Sigma_d(d);
-  DiagonalMatrix::DiagonalVectorType &diagonal = Sigma_d.diagonal();
-  for (size_t i = 0; i < d; ++i) {
-    diagonal(i) = sigmas(i);
-  }
+  // First, compute the singular values and right singular vectors of Y from
+  // its (r x r) Gram matrix
+  Vector sigmas;
+  Matrix V;
+  thinSvdFromGram(Y, sigmas, V);
 
   // print all singular values
   printIfVerbose(verbose, "Singular values of Y: ");
@@ -374,8 +404,9 @@ Matrix projectSolution(const Problem &problem, const Matrix &Y, bool verbose) {
     printIfVerbose(verbose, std::to_string(sigmas(i)));
   }
 
-  // First, construct a rank-d truncated singular value decomposition for Y
-  Matrix Yd = svd.matrixU().leftCols(d) * Sigma_d;
+  // First, construct a rank-d truncated singular value decomposition for Y:
+  // U_d * Sigma_d = Y * V_d
+  Matrix Yd = Y * V.leftCols(d);
   Vector determinants(n);
 
   size_t ng0 = 0; // This will count the number of blocks whose
@@ -429,8 +460,9 @@ Matrix projectSolution(const Problem &problem, const Matrix &Y, bool verbose) {
 
   // print the singular values of the projected solution
   if (verbose) {
-    Eigen::JacobiSVD<Matrix> svd_Yd(Yd, Eigen::ComputeThinU);
-    Vector sigmas_Yd = svd_Yd.singularValues();
+    Vector sigmas_Yd;
+    Matrix V_Yd;
+    thinSvdFromGram(Yd, sigmas_Yd, V_Yd);
     printIfVerbose(verbose, "Singular values of Yd: ");
     for (size_t i = 0; i < sigmas_Yd.size(); ++i) {
       printIfVerbose(verbose, std::to_string(sigmas_Yd(i)));
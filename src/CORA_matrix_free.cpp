@@ -0,0 +1,369 @@
+#include <CORA/CORA_dim_dispatch.h>
+#include <CORA/CORA_matrix_free.h>
+#include <CORA/CORA_parallel.h>
+#include <CORA/CORA_spmm.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace CORA {
+
+namespace {
+
+// the number of edges handled per chunk of the parallel loops
+constexpr Index kEdgeGrainSize = 256;
+
+// the number of rows of the per-thread sums reduced per chunk
+constexpr Index kHubRowGrainSize = 64;
+
+// variables touched by more edges are not colored, but accumulated per thread
+// (e.g., landmarks measured from every pose, or the origin pose of the priors)
+constexpr Index kMaxColoredDegree = 64;
+
+/**
+ * @brief Greedily assigns each edge the smallest color that is not used by an
+ * earlier edge touching one of its colored variables, then sorts the edges by
+ * color. The colors used at each variable are marked with the index of the
+ * edge being colored, so that coloring m edges takes O(m * max degree).
+ *
+ * @param hub_offsets the offset of each variable (row) among the rows that are
+ * accumulated per thread, or -1 for the variables that are colored
+ * @param get_vertices callable as get_vertices(edge_idx, vertices) that fills
+ * the (up to 4) variables touched by an edge, and returns how many there are
+ * @param permute callable as permute(order) that reorders the edges so that
+ * the new edge k is the old edge order[k]
+ * @return the start of each color in the sorted edges (and one past the end)
+ */
+template <typename VerticesFunc, typename PermuteFunc>
+std::vector<Index> colorEdges(Index num_edges,
+                              const std::vector<int> &hub_offsets,
+                              VerticesFunc &&get_vertices,
+                              PermuteFunc &&permute) {
+  // the colors of the edges touching each variable so far
+  std::vector<std::vector<Index>> vertex_colors(hub_offsets.size());
+  // the last edge that found each color used at one of its variables
+  std::vector<Index> color_stamps;
+  std::vector<Index> edge_colors(num_edges);
+  std::vector<Index> color_counts;
+  Index vertices[4];
+  for (Index edge_idx = 0; edge_idx < num_edges; edge_idx++) {
+    int num_edge_vertices = get_vertices(edge_idx, vertices);
+    for (int v = 0; v < num_edge_vertices; v++) {
+      if (hub_offsets[vertices[v]] < 0) {
+        for (Index used_color : vertex_colors[vertices[v]]) {
+          color_stamps[used_color] = edge_idx;
+        }
+      }
+    }
+    Index color = 0;
+    while (color < static_cast<Index>(color_stamps.size()) &&
+           color_stamps[color] == edge_idx) {
+      color++;
+    }
+    if (color == static_cast<Index>(color_stamps.size())) {
+      color_stamps.push_back(-1);
+      color_counts.push_back(0);
+    }
+    for (int v = 0; v < num_edge_vertices; v++) {
+      if (hub_offsets[vertices[v]] < 0) {
+        vertex_colors[vertices[v]].push_back(color);
+      }
+    }
+    edge_colors[edge_idx] = color;
+    color_counts[color]++;
+  }
+
+  std::vector<Index> color_starts(color_counts.size() + 1, 0);
+  for (size_t color = 0; color < color_counts.size(); color++) {
+    color_starts[color + 1] = color_starts[color] + color_counts[color];
+  }
+  std::vector<Index> order(num_edges);
+  std::vector<Index> next_slot(color_starts.begin(), color_starts.end() - 1);
+  for (Index edge_idx = 0; edge_idx < num_edges; edge_idx++) {
+    order[next_slot[edge_colors[edge_idx]]++] = edge_idx;
+  }
+  permute(order);
+  return color_starts;
+}
+
+} // namespace
+
+MatrixFreeDataMatrix::MatrixFreeDataMatrix(Index dim, Index size)
+    : dim_(dim), size_(size) {}
+
+void MatrixFreeDataMatrix::addPoseEdge(Index rot_i, Index rot_j, Index trans_a,
+                                       Index trans_b, const Matrix &R,
+                                       const Vector &t, Scalar kappa,
+                                       Scalar tau) {
+  checkMatrixShape("MatrixFreeDataMatrix::addPoseEdge::R", dim_, dim_,
+                   R.rows(), R.cols());
+  checkMatrixShape("MatrixFreeDataMatrix::addPoseEdge::t", dim_, 1, t.rows(),
+                   t.cols());
+  pose_edges_.push_back({rot_i, rot_j, trans_a, trans_b, kappa, tau});
+  pose_edge_params_.insert(pose_edge_params_.end(), R.data(),
+                           R.data() + R.size());
+  pose_edge_params_.insert(pose_edge_params_.end(), t.data(),
+                           t.data() + t.size());
+}
+
+void MatrixFreeDataMatrix::addTranslationEdge(Index rot_i, Index trans_a,
+                                              Index trans_b, const Vector &t,
+                                              Scalar tau) {
+  // the rotation is never read, as there is no second rotation
+  addPoseEdge(rot_i, -1, trans_a, trans_b, Matrix::Zero(dim_, dim_), t, 0,
+              tau);
+}
+
+void MatrixFreeDataMatrix::addRangeEdge(Index range_row, Index trans_a,
+                                        Index trans_b, Scalar r,
+                                        Scalar omega) {
+  range_edges_.push_back({range_row, trans_a, trans_b, r, omega});
+}
+
+void MatrixFreeDataMatrix::finalize() {
+  auto get_pose_vertices = [this](Index edge_idx, Index *vertices) {
+    const PoseEdge &edge = pose_edges_[edge_idx];
+    vertices[0] = edge.rot_i;
+    vertices[1] = edge.trans_a;
+    vertices[2] = edge.trans_b;
+    vertices[3] = edge.rot_j;
+    return edge.rot_j >= 0 ? 4 : 3;
+  };
+  auto get_range_vertices = [this](Index edge_idx, Index *vertices) {
+    const RangeEdge &edge = range_edges_[edge_idx];
+    vertices[0] = edge.range_row;
+    vertices[1] = edge.trans_a;
+    vertices[2] = edge.trans_b;
+    return 3;
+  };
+
+  // the degree of each variable and its number of rows (d for the rotations
+  // of the pose edges, which are their first and last variables, 1 otherwise)
+  std::vector<Index> degrees(size_, 0);
+  std::vector<Index> widths(size_, 1);
+  Index vertices[4];
+  for (Index edge_idx = 0; edge_idx < static_cast<Index>(pose_edges_.size());
+       edge_idx++) {
+    int num_edge_vertices = get_pose_vertices(edge_idx, vertices);
+    for (int v = 0; v < num_edge_vertices; v++) {
+      degrees[vertices[v]]++;
+    }
+    widths[vertices[0]] = dim_;
+    if (num_edge_vertices == 4) {
+      widths[vertices[3]] = dim_;
+    }
+  }
+  for (Index edge_idx = 0; edge_idx < static_cast<Index>(range_edges_.size());
+       edge_idx++) {
+    int num_edge_vertices = get_range_vertices(edge_idx, vertices);
+    for (int v = 0; v < num_edge_vertices; v++) {
+      degrees[vertices[v]]++;
+    }
+  }
+
+  hub_offsets_.assign(size_, -1);
+  hub_rows_.clear();
+  for (Index row = 0; row < size_; row++) {
+    if (degrees[row] > kMaxColoredDegree) {
+      hub_offsets_[row] = static_cast<int>(hub_rows_.size());
+      for (Index k = 0; k < widths[row]; k++) {
+        hub_rows_.push_back(row + k);
+      }
+    }
+  }
+
+  const Index param_size = dim_ * dim_ + dim_;
+  pose_color_starts_ = colorEdges(
+      pose_edges_.size(), hub_offsets_, get_pose_vertices,
+      [&](const std::vector<Index> &order) {
+        std::vector<PoseEdge> edges(order.size());
+        std::vector<Scalar> params(pose_edge_params_.size());
+        for (size_t k = 0; k < order.size(); k++) {
+          edges[k] = pose_edges_[order[k]];
+          std::copy_n(pose_edge_params_.begin() + order[k] * param_size,
+                      param_size, params.begin() + k * param_size);
+        }
+        pose_edges_ = std::move(edges);
+        pose_edge_params_ = std::move(params);
+      });
+
+  range_color_starts_ = colorEdges(
+      range_edges_.size(), hub_offsets_, get_range_vertices,
+      [this](const std::vector<Index> &order) {
+        std::vector<RangeEdge> edges(order.size());
+        for (size_t k = 0; k < order.size(); k++) {
+          edges[k] = range_edges_[order[k]];
+        }
+        range_edges_ = std::move(edges);
+      });
+
+  // the offsets are only looked up if there are rows to sum per thread
+  if (hub_rows_.empty()) {
+    hub_offsets_.clear();
+    hub_offsets_.shrink_to_fit();
+  }
+}
+
+template <int D, int Cols>
+void MatrixFreeDataMatrix::multiplyFixed(const RowMajorMatrix &Y,
+                                         RowMajorMatrix &QY,
+                                         Index num_slots) const {
+  using RowVector = Eigen::Matrix<Scalar, 1, Cols>;
+  // d consecutive rows (a column vector must be stored column-major)
+  using Rows = Eigen::Matrix<Scalar, D, Cols,
+                             Cols == 1 ? Eigen::ColMajor : Eigen::RowMajor>;
+  const Index d = dim_;
+  const Index cols = Y.cols();
+  const Index param_size = d * d + d;
+  const Scalar *Y_data = Y.data();
+  Scalar *QY_data = QY.data();
+  auto y_rows = [&](Index row) {
+    return Eigen::Map<const Rows>(Y_data + row * cols, d, cols);
+  };
+  auto qy_rows = [&](Index row) {
+    return Eigen::Map<Rows>(QY_data + row * cols, d, cols);
+  };
+  auto y_row = [&](Index row) {
+    return Eigen::Map<const RowVector>(Y_data + row * cols, cols);
+  };
+  auto qy_row = [&](Index row) {
+    return Eigen::Map<RowVector>(QY_data + row * cols, cols);
+  };
+
+  // the rows of QY updated for a variable: with several slots, the rows of
+  // the variables that are not colored are summed separately for each slot,
+  // in the rows of QY starting at hub_base
+  const Index num_hub_rows = hub_rows_.size();
+  const bool use_hub_sums = num_slots > 1 && num_hub_rows > 0;
+  auto target_row = [&](Index row, Index hub_base) {
+    if (use_hub_sums && hub_offsets_[row] >= 0) {
+      return hub_base + hub_offsets_[row];
+    }
+    return row;
+  };
+
+  // the edges of the same color touch disjoint colored rows of QY, so each
+  // color is split into (at most) one contiguous range of edges per slot
+  auto for_each_slot = [&](const std::vector<Index> &color_starts,
+                           const auto &apply_edges) {
+    for (size_t color = 0; color + 1 < color_starts.size(); color++) {
+      const Index begin = color_starts[color];
+      const Index num_edges = color_starts[color + 1] - begin;
+      const Index num_color_slots = std::min(
+          num_slots, (num_edges + kEdgeGrainSize - 1) / kEdgeGrainSize);
+      parallelFor(
+          0, num_color_slots,
+          [&](Index slot) {
+            apply_edges(begin + num_edges * slot / num_color_slots,
+                        begin + num_edges * (slot + 1) / num_color_slots,
+                        size_ + slot * num_hub_rows);
+          },
+          1);
+    }
+  };
+
+  for_each_slot(pose_color_starts_, [&](Index begin, Index end,
+                                        Index hub_base) {
+    RowVector e(1, cols);
+    for (Index k = begin; k < end; k++) {
+      const PoseEdge &edge = pose_edges_[k];
+      const Scalar *params = pose_edge_params_.data() + k * param_size;
+      Eigen::Map<const DimMatrix<D>> R(params, d, d);
+      Eigen::Map<const Eigen::Matrix<Scalar, D, 1>> t(params + d * d, d);
+      auto Y_i = y_rows(edge.rot_i);
+      auto QY_i = qy_rows(target_row(edge.rot_i, hub_base));
+
+      // translation terms: with e = y_a - y_b + t^T Y_i, these add
+      // tau * t * e to QY_i, tau * e to QY_a and -tau * e to QY_b
+      e = y_row(edge.trans_a) - y_row(edge.trans_b);
+      e.noalias() += t.transpose() * Y_i;
+      QY_i.noalias() += (edge.tau * t) * e;
+      qy_row(target_row(edge.trans_a, hub_base)) += edge.tau * e;
+      qy_row(target_row(edge.trans_b, hub_base)) -= edge.tau * e;
+
+      // rotation terms: kappa * (Y_i - R Y_j) and kappa * (Y_j - R^T Y_i)
+      if (edge.rot_j >= 0) {
+        auto Y_j = y_rows(edge.rot_j);
+        auto QY_j = qy_rows(target_row(edge.rot_j, hub_base));
+        QY_i += edge.kappa * Y_i;
+        QY_i.noalias() -= (edge.kappa * R) * Y_j;
+        QY_j += edge.kappa * Y_j;
+        QY_j.noalias() -= (edge.kappa * R.transpose()) * Y_i;
+      }
+    }
+  });
+
+  for_each_slot(range_color_starts_, [&](Index begin, Index end,
+                                         Index hub_base) {
+    RowVector e(1, cols);
+    for (Index k = begin; k < end; k++) {
+      const RangeEdge &edge = range_edges_[k];
+      // with e = y_a - y_b - r * y_range, these add -omega * r * e to
+      // QY_range, omega * e to QY_a and -omega * e to QY_b
+      e = y_row(edge.trans_a) - y_row(edge.trans_b) -
+          edge.r * y_row(edge.range_row);
+      qy_row(target_row(edge.range_row, hub_base)) -= (edge.omega * edge.r) * e;
+      qy_row(target_row(edge.trans_a, hub_base)) += edge.omega * e;
+      qy_row(target_row(edge.trans_b, hub_base)) -= edge.omega * e;
+    }
+  });
+
+  if (use_hub_sums) {
+    parallelForRange(
+        0, num_hub_rows,
+        [&](Index begin, Index end) {
+          for (Index h = begin; h < end; h++) {
+            auto QY_h = qy_row(hub_rows_[h]);
+            for (Index slot = 0; slot < num_slots; slot++) {
+              QY_h += qy_row(size_ + slot * num_hub_rows + h);
+            }
+          }
+        },
+        kHubRowGrainSize);
+  }
+}
+
+void MatrixFreeDataMatrix::multiply(const Matrix &Y, Matrix &QY,
+                                    RowMajorMatrix &Y_rows,
+                                    RowMajorMatrix &QY_rows) const {
+  checkMatrixShape("MatrixFreeDataMatrix::multiply::Y", size_, Y.cols(),
+                   Y.rows(), Y.cols());
+  Y_rows = Y;
+  // one slot per thread; if some variables are not colored, each slot has its
+  // own sums of their rows, stored below the rows of QY
+  const Index num_slots = internal::in_parallel_loop ? 1 : getNumThreads();
+  const Index num_sum_rows =
+      num_slots > 1 && !hub_rows_.empty()
+          ? num_slots * static_cast<Index>(hub_rows_.size())
+          : 0;
+  QY_rows.setZero(size_ + num_sum_rows, Y.cols());
+  dispatchOnDim(dim_, [&](auto dim_constant) {
+    constexpr int D = decltype(dim_constant)::value;
+    if (Y.cols() >= 1 && Y.cols() <= kMaxThinProductCols) {
+      dispatchOnThinCols(Y.cols(), [&](auto cols_constant) {
+        constexpr int Cols = decltype(cols_constant)::value;
+        multiplyFixed<D, Cols>(Y_rows, QY_rows, num_slots);
+      });
+    } else {
+      multiplyFixed<D, Eigen::Dynamic>(Y_rows, QY_rows, num_slots);
+    }
+  });
+  QY = QY_rows.topRows(size_);
+}
+
+void MatrixFreeDataMatrix::multiply(const Matrix &Y, Matrix &QY) const {
+  RowMajorMatrix Y_rows, QY_rows;
+  multiply(Y, QY, Y_rows, QY_rows);
+}
+
+size_t MatrixFreeDataMatrix::memoryUsage() const {
+  return pose_edges_.capacity() * sizeof(PoseEdge) +
+         range_edges_.capacity() * sizeof(RangeEdge) +
+         pose_edge_params_.capacity() * sizeof(Scalar) +
+         (pose_color_starts_.capacity() + range_color_starts_.capacity() +
+          hub_rows_.capacity()) *
+             sizeof(Index) +
+         hub_offsets_.capacity() * sizeof(int);
+}
+
+} // namespace CORA
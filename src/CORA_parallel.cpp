@@ -0,0 +1,98 @@
+#include <CORA/CORA_parallel.h>
+
+namespace CORA {
+namespace internal {
+
+ThreadPool::~ThreadPool() { stopWorkers(); }
+
+int ThreadPool::size() const { return static_cast<int>(workers_.size()); }
+
+void ThreadPool::resize(int num_workers) {
+  num_workers = std::max(0, num_workers);
+  std::lock_guard<std::mutex> run_lock(run_mutex_);
+  if (num_workers == size()) {
+    return;
+  }
+  stopWorkers();
+  std::lock_guard<std::mutex> lock(mutex_);
+  stop_ = false;
+  for (int worker_idx = 0; worker_idx < num_workers; worker_idx++) {
+    workers_.emplace_back(&ThreadPool::workerLoop, this, worker_idx,
+                          job_generation_);
+  }
+}
+
+void ThreadPool::run(int num_workers, const std::function<void()> &job) {
+  // the pool is busy with a job of another thread (or there is nothing to
+  // share), so the calling thread does all of the work
+  std::unique_lock<std::mutex> run_lock(run_mutex_, std::try_to_lock);
+  if (num_workers <= 0 || !run_lock.owns_lock()) {
+    job();
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // grow the pool if setNumThreads() has not been called with the Threads
+    // backend selected, e.g., for the default number of threads
+    for (int worker_idx = size(); worker_idx < num_workers; worker_idx++) {
+      workers_.emplace_back(&ThreadPool::workerLoop, this, worker_idx,
+                            job_generation_);
+    }
+    job_ = &job;
+    num_job_workers_ = num_workers;
+    num_pending_workers_ = num_workers;
+    job_generation_++;
+  }
+  job_ready_.notify_all();
+
+  job();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  job_done_.wait(lock, [this]() { return num_pending_workers_ == 0; });
+  job_ = nullptr;
+}
+
+void ThreadPool::workerLoop(int worker_idx, size_t seen_generation) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    job_ready_.wait(lock, [&]() {
+      return stop_ || job_generation_ != seen_generation;
+    });
+    if (stop_) {
+      return;
+    }
+    seen_generation = job_generation_;
+    if (worker_idx >= num_job_workers_) {
+      continue;
+    }
+
+    const std::function<void()> *job = job_;
+    lock.unlock();
+    (*job)();
+    lock.lock();
+    if (--num_pending_workers_ == 0) {
+      job_done_.notify_one();
+    }
+  }
+}
+
+void ThreadPool::stopWorkers() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  job_ready_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+}
+
+ThreadPool &getThreadPool() {
+  static ThreadPool pool;
+  return pool;
+}
+
+} // namespace internal
+} // namespace CORA
@@ -11,10 +11,80 @@
 
 #include <CORA/CORA_preconditioners.h>
 
+#include <CORA/CORA_parallel.h>
+
+#include <algorithm>
+
 namespace CORA {
 
+namespace {
+
+// the offset of each block along the diagonal, given the block sizes
+VectorXi getBlockStarts(const VectorXi &block_sizes) {
+  VectorXi block_starts = VectorXi::Zero(block_sizes.size());
+  for (Index block_idx = 1; block_idx < block_sizes.size(); block_idx++) {
+    block_starts(block_idx) =
+        block_starts(block_idx - 1) + block_sizes(block_idx - 1);
+  }
+  return block_starts;
+}
+
+} // namespace
+
+template <typename Decomposition>
+bool CholeskyFactorizationT<Decomposition>::refactorize(const SparseMatrix &A) {
+  if (!A.isCompressed()) {
+    SparseMatrix A_compressed = A;
+    A_compressed.makeCompressed();
+    return refactorize(A_compressed);
+  }
+
+  const auto *outer_begin = A.outerIndexPtr();
+  const auto *outer_end = outer_begin + A.outerSize() + 1;
+  const auto *inner_begin = A.innerIndexPtr();
+  const auto *inner_end = inner_begin + A.nonZeros();
+  bool same_pattern =
+      A.rows() == analyzed_rows_ &&
+      std::equal(outer_begin, outer_end, analyzed_outer_idxs_.begin(),
+                 analyzed_outer_idxs_.end()) &&
+      std::equal(inner_begin, inner_end, analyzed_inner_idxs_.begin(),
+                 analyzed_inner_idxs_.end());
+
+  if (!same_pattern) {
+    this->analyzePattern(A);
+    num_analyses_++;
+    analyzed_rows_ = A.rows();
+    analyzed_outer_idxs_.assign(outer_begin, outer_end);
+    analyzed_inner_idxs_.assign(inner_begin, inner_end);
+  }
+  this->factorize(A);
+  return same_pattern;
+}
+
+template class CholeskyFactorizationT<
+    Eigen::CholmodDecomposition<SparseMatrix, Eigen::Upper>>;
+template class CholeskyFactorizationT<
+    Eigen::CholmodSupernodalLLT<SparseMatrix, Eigen::Upper>>;
+
+bool refactorizeCholesky(CholFactorPtr &chol_factor_ptr,
+                         const SparseMatrix &A) {
+  if (!chol_factor_ptr || chol_factor_ptr.use_count() > 1) {
+    chol_factor_ptr = std::make_shared<CholeskyFactorization>(A);
+    return false;
+  }
+  return chol_factor_ptr->refactorize(A);
+}
+
 CholFactorPtrVector getBlockCholeskyFactorization(const SparseMatrix &A,
                                                   const VectorXi &block_sizes) {
+  CholFactorPtrVector block_cholesky_factors;
+  updateBlockCholeskyFactorization(block_cholesky_factors, A, block_sizes);
+  return block_cholesky_factors;
+}
+
+int updateBlockCholeskyFactorization(
+    CholFactorPtrVector &block_chol_factor_ptrs, const SparseMatrix &A,
+    const VectorXi &block_sizes) {
   if (block_sizes.sum() != A.rows()) {
     throw std::invalid_argument(
         "The block sizes must sum to A.rows() for the "
@@ -23,28 +93,44 @@ CholFactorPtrVector getBlockCholeskyFactorization(const SparseMatrix &A,
         ", A.rows(): " + std::to_string(A.rows()));
   }
 
+  // the existing factors can only be reused if they match the blocks
+  if (block_chol_factor_ptrs.size() !=
+      static_cast<size_t>(block_sizes.size())) {
+    block_chol_factor_ptrs.assign(block_sizes.size(), nullptr);
+  }
+
   // for each block along the diagonal of A compute the Cholesky decomposition
   // of the block and store the Cholesky factor and the permutation
   // ordering. The default AMD ordering is used to minimize fill-in during
-  // the Cholesky decomposition.
-  int block_start = 0;
-  CholFactorPtrVector block_cholesky_factors;
-  for (int block_idx = 0; block_idx < block_sizes.size(); block_idx++) {
-    int blockSize = block_sizes[block_idx];
+  // the Cholesky decomposition. The blocks are independent, so they are
+  // extracted and factorized concurrently.
+  VectorXi block_starts = getBlockStarts(block_sizes);
+  std::vector<char> analysis_reused(block_sizes.size(), false);
+  parallelFor(0, block_sizes.size(), [&](Index block_idx) {
+    int block_size = block_sizes(block_idx);
+    int block_start = block_starts(block_idx);
     // extract the block from A
-    SparseMatrix block =
-        A.block(block_start, block_start, blockSize, blockSize);
+    SparseMatrix block = A.block(block_start, block_start, block_size,
+                                 block_size);
 
     // compute the Cholesky decomposition of the block
-    block_cholesky_factors.emplace_back(
-        std::make_shared<CholeskyFactorization>(block));
-  }
+    analysis_reused[block_idx] =
+        refactorizeCholesky(block_chol_factor_ptrs[block_idx], block);
+  });
 
-  return block_cholesky_factors;
+  return static_cast<int>(
+      std::count(analysis_reused.begin(), analysis_reused.end(), true));
 }
 
 Matrix blockCholeskySolve(const CholFactorPtrVector &block_chol_factor_ptrs,
                           const Matrix &rhs) {
+  Matrix result;
+  blockCholeskySolve(block_chol_factor_ptrs, rhs, result);
+  return result;
+}
+
+void blockCholeskySolve(const CholFactorPtrVector &block_chol_factor_ptrs,
+                        const Matrix &rhs, Matrix &result) {
   // sum # rows of each block
   int num_result_rows = 0;
   for (auto &block_chol_factor_ptr : block_chol_factor_ptrs) {
@@ -63,23 +149,24 @@ Matrix blockCholeskySolve(const CholFactorPtrVector &block_chol_factor_ptrs,
         "than the sum of the number of rows in the block Cholesky factors.");
   }
 
-  Matrix result(rhs.rows(), rhs.cols());
-  int block_start = 0;
-  for (auto &block_chol_factor_ptr : block_chol_factor_ptrs) {
-    // perform the solves in a block-wise ordering
-    int block_size = block_chol_factor_ptr->rows();
-    result.block(block_start, 0, block_size, rhs.cols()) =
-        block_chol_factor_ptr->solve(
-            rhs.block(block_start, 0, block_size, rhs.cols()));
-    block_start += block_size;
-  }
+  // the blocks of the result are independent, so the solves run concurrently
+  // (the handful of block starts are summed for each block rather than stored)
+  result.resize(rhs.rows(), rhs.cols());
+  parallelFor(0, block_chol_factor_ptrs.size(), [&](Index block_idx) {
+    Index block_start = 0;
+    for (Index prev_idx = 0; prev_idx < block_idx; prev_idx++) {
+      block_start += block_chol_factor_ptrs[prev_idx]->rows();
+    }
+    Index block_size = block_chol_factor_ptrs[block_idx]->rows();
+    result.middleRows(block_start, block_size) =
+        block_chol_factor_ptrs[block_idx]->solve(
+            rhs.middleRows(block_start, block_size));
+  });
 
   // if rhs has one more row then set the last row of the result to zero
   if(rhs_one_more_row) {
     result.bottomRows(1).setZero();
   }
-
-  return result;
 }
 
 } // namespace CORA
@@ -9,7 +9,10 @@
  *
  */
 
+#include <CORA/CORA_dim_dispatch.h>
+#include <CORA/CORA_parallel.h>
 #include <CORA/CORA_problem.h>
+#include <CORA/CORA_spmm.h>
 #include <CORA/CORA_utils.h>
 #include <Optimization/LinearAlgebra/LOBPCG.h>
 
@@ -36,11 +39,14 @@ void Problem::addLandmarkVariable(const Symbol &landmark_id) {
   }
   landmark_symbol_idxs_.insert(
       std::make_pair(landmark_id, landmark_symbol_idxs_.size()));
+  problem_data_up_to_date_ = false;
 }
 
 void Problem::addRangeMeasurement(const RangeMeasurement &range_measurement) {
-  if (std::find(range_measurements_.begin(), range_measurements_.end(),
-                range_measurement) != range_measurements_.end()) {
+  if (!range_measurement_idxs_
+           .emplace(range_measurement.getSymbolPair(),
+                    static_cast<int>(range_measurements_.size()))
+           .second) {
     std::cout << "Found duplicate measure: "
               << range_measurement.first_id.string() << " -> "
               << range_measurement.second_id.string() << std::endl;
@@ -53,9 +59,10 @@ void Problem::addRangeMeasurement(const RangeMeasurement &range_measurement) {
 
 void Problem::addRelativePoseMeasurement(
     const RelativePoseMeasurement &rel_pose_measure) {
-  if (std::find(rel_pose_pose_measurements_.begin(),
-                rel_pose_pose_measurements_.end(),
-                rel_pose_measure) != rel_pose_pose_measurements_.end()) {
+  if (!rel_pose_pose_measurement_idxs_
+           .emplace(rel_pose_measure.getSymbolPair(),
+                    static_cast<int>(rel_pose_pose_measurements_.size()))
+           .second) {
     throw std::invalid_argument("Relative pose measurement already exists: " +
                                 rel_pose_measure.first_id.string() + " -> " +
                                 rel_pose_measure.second_id.string());
@@ -66,10 +73,10 @@ void Problem::addRelativePoseMeasurement(
 
 void Problem::addRelativePoseLandmarkMeasurement(
     const RelativePoseLandmarkMeasurement &rel_pose_landmark_measure) {
-  if (std::find(rel_pose_landmark_measurements_.begin(),
-                rel_pose_landmark_measurements_.end(),
-                rel_pose_landmark_measure) !=
-      rel_pose_landmark_measurements_.end()) {
+  if (!rel_pose_landmark_measurement_idxs_
+           .emplace(rel_pose_landmark_measure.getSymbolPair(),
+                    static_cast<int>(rel_pose_landmark_measurements_.size()))
+           .second) {
     throw std::invalid_argument(
         "Relative pose landmark measurement already exists");
   }
@@ -86,8 +93,9 @@ void Problem::addOriginPose() {
 }
 
 void Problem::addPosePrior(const PosePrior &pose_prior) {
-  if (std::find(pose_priors_.begin(), pose_priors_.end(), pose_prior) !=
-      pose_priors_.end()) {
+  if (!pose_prior_idxs_
+           .emplace(pose_prior.id.key(), static_cast<int>(pose_priors_.size()))
+           .second) {
     throw std::invalid_argument("Pose prior already exists");
   }
   pose_priors_.push_back(pose_prior);
@@ -100,8 +108,10 @@ void Problem::addPosePrior(const PosePrior &pose_prior) {
 }
 
 void Problem::addLandmarkPrior(const LandmarkPrior &landmark_prior) {
-  if (std::find(landmark_priors_.begin(), landmark_priors_.end(),
-                landmark_prior) != landmark_priors_.end()) {
+  if (!landmark_prior_idxs_
+           .emplace(landmark_prior.id.key(),
+                    static_cast<int>(landmark_priors_.size()))
+           .second) {
     throw std::invalid_argument("Landmark prior already exists");
   }
   landmark_priors_.push_back(landmark_prior);
@@ -112,6 +122,39 @@ void Problem::addLandmarkPrior(const LandmarkPrior &landmark_prior) {
   }
 }
 
+namespace {
+
+using Triplets = std::vector<Eigen::Triplet<Scalar>>;
+
+/** Builds a (compressed) rows x cols sparse matrix from a list of triplets,
+ * summing any duplicate entries */
+SparseMatrix sparseMatrixFromTriplets(Index rows, Index cols,
+                                      const Triplets &triplets) {
+  SparseMatrix mat(rows, cols);
+  mat.setFromTriplets(triplets.begin(), triplets.end());
+  return mat;
+}
+
+/** Returns Q - Lambda for the symmetric matrices Q (stored as given by
+ * storage) and Lambda (stored in full), stored like Q */
+SparseMatrix subtractSymmetric(const SparseMatrix &Q,
+                               const SparseMatrix &Lambda,
+                               MatrixStorage storage) {
+  if (storage == MatrixStorage::Full) {
+    return Q - Lambda;
+  }
+  SparseMatrix Lambda_upper = Lambda.triangularView<Eigen::Upper>();
+  return Q - Lambda_upper;
+}
+
+// the position of the variable added with index idx, given the positions set
+// by the last reordering
+inline Index getPosition(const std::vector<Index> &positions, Index idx) {
+  return idx < static_cast<Index>(positions.size()) ? positions[idx] : idx;
+}
+
+} // namespace
+
 void Problem::fillRangeSubmatrices() {
   // need to account for the fact that the indices will be offset by the
   // dimension of the rotation and the range variables that precede the
@@ -119,39 +162,43 @@ void Problem::fillRangeSubmatrices() {
   auto translation_offset = rotAndRangeMatrixSize();
   auto num_range_measurements = numRangeMeasurements();
   auto num_translations = numTranslationalStates();
-  // initialize the submatrices to the correct sizes
-  data_submatrices_.range_incidence_matrix =
-      SparseMatrix(num_range_measurements, num_translations);
-  data_submatrices_.range_dist_matrix =
-      SparseMatrix(num_range_measurements, num_range_measurements);
-  data_submatrices_.range_precision_matrix =
-      SparseMatrix(num_range_measurements, num_range_measurements);
-
-  // for diagonal matrices, get the diagonal vector and set the values
-  for (int measure_idx = 0; measure_idx < range_measurements_.size();
+
+  // each range measurement contributes one entry to each of the diagonal
+  // matrices and two entries to the incidence matrix
+  Triplets dist_triplets, precision_triplets, incidence_triplets;
+  dist_triplets.reserve(num_range_measurements);
+  precision_triplets.reserve(num_range_measurements);
+  incidence_triplets.reserve(2 * num_range_measurements);
+
+  for (int measure_idx = 0; measure_idx < num_range_measurements;
        measure_idx++) {
-    RangeMeasurement measure = range_measurements_[measure_idx];
+    const RangeMeasurement &measure = range_measurements_[measure_idx];
+    // the rows follow the order of the range variables
+    Index range_idx = getRangePosition(measure_idx);
 
     // update the diagonal matrices
-    data_submatrices_.range_dist_matrix.insert(measure_idx, measure_idx) =
-        measure.r;
-    data_submatrices_.range_precision_matrix.insert(measure_idx, measure_idx) =
-        measure.getPrecision();
+    dist_triplets.emplace_back(range_idx, range_idx, measure.r);
+    precision_triplets.emplace_back(range_idx, range_idx,
+                                    measure.getPrecision());
 
     // update the incidence matrix
     auto id1 = getTranslationIdx(measure.first_id) - translation_offset;
     auto id2 = getTranslationIdx(measure.second_id) - translation_offset;
-    data_submatrices_.range_incidence_matrix.insert(measure_idx, id1) = -1.0;
-    data_submatrices_.range_incidence_matrix.insert(measure_idx, id2) = 1.0;
+    incidence_triplets.emplace_back(range_idx, id1, -1.0);
+    incidence_triplets.emplace_back(range_idx, id2, 1.0);
   }
+
+  data_submatrices_.range_incidence_matrix = sparseMatrixFromTriplets(
+      num_range_measurements, num_translations, incidence_triplets);
+  data_submatrices_.range_dist_matrix = sparseMatrixFromTriplets(
+      num_range_measurements, num_range_measurements, dist_triplets);
+  data_submatrices_.range_precision_matrix = sparseMatrixFromTriplets(
+      num_range_measurements, num_range_measurements, precision_triplets);
 }
 
 void Problem::fillRelPoseSubmatrices() {
   fillRotConnLaplacian();
   auto num_pose_pose_measurements = numPosePoseMeasurements();
-  data_submatrices_.rel_pose_rotation_precision_matrix =
-      SparseMatrix(num_pose_pose_measurements, num_pose_pose_measurements);
-
   auto num_pose_landmark_measurements = numPoseLandmarkMeasurements();
   auto num_translations = numTranslationalStates();
   auto num_pose_measurements =
@@ -166,132 +213,98 @@ void Problem::fillRelPoseSubmatrices() {
   std::cout << "Num pose-pose, pose-landmark, and priors: "
             << num_pose_measurements << std::endl;
 
-  // if there are priors (landmark or pose), throw an error because we don't
-  // support them yet
-  if (pose_priors_.size() > 0 || landmark_priors_.size() > 0) {
-    // throw std::runtime_error("Priors are not yet supported");
-  }
+  // only pose-pose measurements and pose priors carry a rotational component
+  auto num_rot_measurements = num_pose_pose_measurements + num_pose_priors;
 
   // need to account for the fact that the indices will be offset by the
   // dimension of the rotation and the range variables that precede the
   // translations
   auto translation_offset = rotAndRangeMatrixSize();
 
-  // initialize the submatrices to the correct sizes
-  data_submatrices_.rel_pose_incidence_matrix =
-      SparseMatrix(num_pose_measurements, num_translations);
-  data_submatrices_.rel_pose_translation_data_matrix =
-      SparseMatrix(num_pose_measurements, numPosesDim());
-  data_submatrices_.rel_pose_translation_precision_matrix =
-      SparseMatrix(num_pose_measurements, num_pose_measurements);
-
-  int measures_added = 0;
-
-  // pose-pose measures
-  // std::cout << "adding pose-pose measures" << std::endl;
-  for (int measure_idx = 0; measure_idx < num_pose_pose_measurements;
-       measure_idx++) {
-    RelativePoseMeasurement rpm = rel_pose_pose_measurements_[measure_idx];
-
-    // fill in precision matrices
-    data_submatrices_.rel_pose_translation_precision_matrix.insert(
-        measure_idx, measure_idx) = rpm.getTransPrecision();
-    data_submatrices_.rel_pose_rotation_precision_matrix.insert(
-        measure_idx, measure_idx) = rpm.getRotPrecision();
+  // every measurement contributes one entry to the translation precision
+  // matrix, two entries to the incidence matrix and dim_ entries to the
+  // translation data matrix
+  Triplets trans_precision_triplets, rot_precision_triplets,
+      incidence_triplets, trans_data_triplets;
+  trans_precision_triplets.reserve(num_pose_measurements);
+  rot_precision_triplets.reserve(num_rot_measurements);
+  incidence_triplets.reserve(2 * num_pose_measurements);
+  trans_data_triplets.reserve(dim_ * num_pose_measurements);
+
+  // fills in the row of the translation submatrices corresponding to a
+  // measurement of the translation t from the pose 'from' to the variable 'to'
+  auto addTranslationMeasurement = [&](int measure_idx, const Symbol &from,
+                                       const Symbol &to, const Vector &t,
+                                       Scalar trans_precision) {
+    // fill in precision matrix
+    trans_precision_triplets.emplace_back(measure_idx, measure_idx,
+                                          trans_precision);
 
     // fill in incidence matrix
-    Index id1 = getTranslationIdx(rpm.first_id) - translation_offset;
-    Index id2 = getTranslationIdx(rpm.second_id) - translation_offset;
-    data_submatrices_.rel_pose_incidence_matrix.insert(measure_idx, id1) = -1.0;
-    data_submatrices_.rel_pose_incidence_matrix.insert(measure_idx, id2) = 1.0;
+    Index id1 = getTranslationIdx(from) - translation_offset;
+    Index id2 = getTranslationIdx(to) - translation_offset;
+    incidence_triplets.emplace_back(measure_idx, id1, -1.0);
+    incidence_triplets.emplace_back(measure_idx, id2, 1.0);
 
     // fill in translation data matrix where the id1-th (1 x dim_) block is
-    // -rpm.t and all other blocks are 0
+    // -t and all other blocks are 0
     for (int k = 0; k < dim_; k++) {
-      data_submatrices_.rel_pose_translation_data_matrix.insert(
-          measure_idx, id1 * dim_ + k) = -rpm.t(k);
+      trans_data_triplets.emplace_back(measure_idx, id1 * dim_ + k, -t(k));
     }
+  };
+
+  int measures_added = 0;
+
+  // pose-pose measures
+  for (int i = 0; i < num_pose_pose_measurements; i++) {
+    const RelativePoseMeasurement &rpm = rel_pose_pose_measurements_[i];
+    int measure_idx = measures_added + i;
+    rot_precision_triplets.emplace_back(measure_idx, measure_idx,
+                                        rpm.getRotPrecision());
+    addTranslationMeasurement(measure_idx, rpm.first_id, rpm.second_id, rpm.t,
+                              rpm.getTransPrecision());
   }
   measures_added += num_pose_pose_measurements;
 
   // pose priors
-  // std::cout << "adding pose priors" << std::endl;
-  for (int measure_idx = measures_added;
-       measure_idx < measures_added + num_pose_priors; measure_idx++) {
-    PosePrior pp = pose_priors_[measure_idx - measures_added];
-
-    // fill in precision matrices
-    data_submatrices_.rel_pose_translation_precision_matrix.insert(
-        measure_idx, measure_idx) = pp.getTransPrecision();
-    data_submatrices_.rel_pose_rotation_precision_matrix.insert(
-        measure_idx, measure_idx) = pp.getRotPrecision();
-
-    // fill in incidence matrix
-    Index id1 = getTranslationIdx(origin_symbol_) - translation_offset;
-    Index id2 = getTranslationIdx(pp.id) - translation_offset;
-    data_submatrices_.rel_pose_incidence_matrix.insert(measure_idx, id1) = -1.0;
-    data_submatrices_.rel_pose_incidence_matrix.insert(measure_idx, id2) = 1.0;
-
-    // fill in translation data matrix where the id1-th (1 x dim_) block is
-    // -pp.t and all other blocks are 0
-    for (int k = 0; k < dim_; k++) {
-      data_submatrices_.rel_pose_translation_data_matrix.insert(
-          measure_idx, id1 * dim_ + k) = -pp.t(k);
-    }
+  for (int i = 0; i < num_pose_priors; i++) {
+    const PosePrior &pp = pose_priors_[i];
+    int measure_idx = measures_added + i;
+    rot_precision_triplets.emplace_back(measure_idx, measure_idx,
+                                        pp.getRotPrecision());
+    addTranslationMeasurement(measure_idx, origin_symbol_, pp.id, pp.t,
+                              pp.getTransPrecision());
   }
   measures_added += num_pose_priors;
 
   // pose-landmark measures
-  // std::cout << "adding pose-landmark measures" << std::endl;
-  for (int measure_idx = measures_added;
-       measure_idx < measures_added + num_pose_landmark_measurements;
-       measure_idx++) {
-    RelativePoseLandmarkMeasurement rplm =
-        rel_pose_landmark_measurements_[measure_idx - measures_added];
-
-    // fill in precision matrices
-    data_submatrices_.rel_pose_translation_precision_matrix.insert(
-        measure_idx, measure_idx) = rplm.getTransPrecision();
-
-    // fill in incidence matrix
-    Index id1 = getTranslationIdx(rplm.first_id) - translation_offset;
-    Index id2 = getTranslationIdx(rplm.second_id) - translation_offset;
-    data_submatrices_.rel_pose_incidence_matrix.insert(measure_idx, id1) = -1.0;
-    data_submatrices_.rel_pose_incidence_matrix.insert(measure_idx, id2) = 1.0;
-
-    // fill in translation data matrix where the id1-th (1 x dim_) block is
-    // -rpm.t and all other blocks are 0
-    for (int k = 0; k < dim_; k++) {
-      data_submatrices_.rel_pose_translation_data_matrix.insert(
-          measure_idx, id1 * dim_ + k) = -rplm.t(k);
-    }
+  for (int i = 0; i < num_pose_landmark_measurements; i++) {
+    const RelativePoseLandmarkMeasurement &rplm =
+        rel_pose_landmark_measurements_[i];
+    addTranslationMeasurement(measures_added + i, rplm.first_id,
+                              rplm.second_id, rplm.t,
+                              rplm.getTransPrecision());
   }
   measures_added += num_pose_landmark_measurements;
 
   // landmark priors
-  // std::cout << "adding landmark priors" << std::endl;
-  for (int measure_idx = measures_added;
-       measure_idx < measures_added + num_landmark_priors; measure_idx++) {
-    LandmarkPrior lp = landmark_priors_[measure_idx - measures_added];
-
-    // fill in precision matrices
-    data_submatrices_.rel_pose_translation_precision_matrix.insert(
-        measure_idx, measure_idx) = lp.getTransPrecision();
-
-    // fill in incidence matrix
-    Index id1 = getTranslationIdx(origin_symbol_) - translation_offset;
-    Index id2 = getTranslationIdx(lp.id) - translation_offset;
-    data_submatrices_.rel_pose_incidence_matrix.insert(measure_idx, id1) = -1.0;
-    data_submatrices_.rel_pose_incidence_matrix.insert(measure_idx, id2) = 1.0;
-
-    // fill in translation data matrix where the id1-th (1 x dim_) block is
-    // -lp.t and all other blocks are 0
-    for (int k = 0; k < dim_; k++) {
-      data_submatrices_.rel_pose_translation_data_matrix.insert(
-          measure_idx, id1 * dim_ + k) = -lp.p(k);
-    }
+  for (int i = 0; i < num_landmark_priors; i++) {
+    const LandmarkPrior &lp = landmark_priors_[i];
+    addTranslationMeasurement(measures_added + i, origin_symbol_, lp.id, lp.p,
+                              lp.getTransPrecision());
   }
   measures_added += num_landmark_priors;
+
+  data_submatrices_.rel_pose_incidence_matrix = sparseMatrixFromTriplets(
+      num_pose_measurements, num_translations, incidence_triplets);
+  data_submatrices_.rel_pose_translation_data_matrix = sparseMatrixFromTriplets(
+      num_pose_measurements, numPosesDim(), trans_data_triplets);
+  data_submatrices_.rel_pose_translation_precision_matrix =
+      sparseMatrixFromTriplets(num_pose_measurements, num_pose_measurements,
+                               trans_precision_triplets);
+  data_submatrices_.rel_pose_rotation_precision_matrix =
+      sparseMatrixFromTriplets(num_rot_measurements, num_rot_measurements,
+                               rot_precision_triplets);
 }
 
 void Problem::fillRotConnLaplacian() {
@@ -303,7 +316,7 @@ void Problem::fillRotConnLaplacian() {
 
   size_t measurement_stride = 2 * (d + d * d);
 
-  std::vector<Eigen::Triplet<Scalar>> triplets;
+  Triplets triplets;
   auto num_pose_pose_measures = numPosePoseMeasurements();
   auto num_pose_priors = numPosePriors();
   auto num_measurements = num_pose_pose_measures + num_pose_priors;
@@ -371,9 +384,7 @@ void Problem::fillRotConnLaplacian() {
 
   // Construct and return a sparse matrix from these triplets
   data_submatrices_.rotation_conn_laplacian =
-      SparseMatrix(numPosesDim(), numPosesDim());
-  data_submatrices_.rotation_conn_laplacian.setFromTriplets(triplets.begin(),
-                                                            triplets.end());
+      sparseMatrixFromTriplets(numPosesDim(), numPosesDim(), triplets);
 }
 
 template <typename... Matrices>
@@ -491,24 +502,157 @@ void Problem::printProblem() const {
 }
 
 SparseMatrix Problem::getDataMatrix() {
-  if (data_matrix_.nonZeros() == 0 || !problem_data_up_to_date_) {
+  if (!problem_data_up_to_date_ ||
+      (data_matrix_operator_ == DataMatrixOperator::Assembled &&
+       data_matrix_.nonZeros() == 0)) {
     updateProblemData();
   }
-  return data_matrix_;
+  SparseMatrix assembled;
+  return getFullSymmetricMatrix(getAssembledDataMatrix(assembled),
+                                data_matrix_storage_);
 }
 
 void Problem::updateProblemData() {
-  // update the relevant submatrices
-  fillRangeSubmatrices();
-  fillRelPoseSubmatrices();
-  fillDataMatrix();
+  if (data_matrix_operator_ == DataMatrixOperator::MatrixFree) {
+    updateMatrixFreeProblemData();
+    return;
+  }
+
+  // assemble the data matrix directly from the measurements, or only add the
+  // new measurements if it has already been assembled
+  bool implicit_blocks_patched = false;
+  if (incremental_updates_ && data_matrix_.rows() > 0) {
+    implicit_blocks_patched = patchDataMatrix();
+  } else {
+    updateVariableOrdering();
+    fillDataMatrix();
+  }
+  assembled_counts_ = getProblemCounts();
+  data_product_cache_.valid = false;
+
   updatePreconditioner();
   if (formulation_ == Formulation::Implicit) {
-    fillImplicitFormulationMatrices();
+    fillImplicitFormulationMatrices(!implicit_blocks_patched);
+  }
+  if (block_sparse_rotations_) {
+    fillBlockSparseRotationSplit();
+  } else {
+    block_sparse_rotation_split_ = BlockSparseRotationSplit();
+  }
+  problem_data_up_to_date_ = true;
+}
+
+void Problem::updateMatrixFreeProblemData() {
+  if (formulation_ != Formulation::Explicit) {
+    throw std::invalid_argument(
+        "Matrix-free products with the data matrix are only available in the "
+        "explicit formulation");
+  }
+
+  // the edges are rebuilt from scratch, which is linear in the number of
+  // measurements, so there is nothing to gain from incremental updates
+  updateVariableOrdering();
+  fillMatrixFreeDataMatrix();
+  assembled_counts_ = getProblemCounts();
+  data_product_cache_.valid = false;
+  data_matrix_pattern_changed_ = true;
+  block_sparse_rotation_split_ = BlockSparseRotationSplit();
+
+  if (preconditioner_ == Preconditioner::Jacobi) {
+    // the diagonal is accumulated without assembling the data matrix
+    Vector diagonal = Vector::Zero(getDataMatrixSize());
+    forEachDataMatrixEntry([&diagonal](Index row, Index col, Scalar val) {
+      if (row == col) {
+        diagonal(row) += val;
+      }
+    });
+    preconditioner_matrices_.jacobi_preconditioner_ =
+        diagonal.cwiseInverse().asDiagonal();
+  } else {
+    // the Cholesky preconditioners factor the data matrix, so it is only
+    // assembled for as long as it takes to factor it
+    fillDataMatrix();
+    updatePreconditioner();
+    data_matrix_ = SparseMatrix();
   }
   problem_data_up_to_date_ = true;
 }
 
+void Problem::updateVariableOrdering() {
+  pose_positions_.clear();
+  landmark_positions_.clear();
+  range_positions_.clear();
+  if (variable_ordering_ == VariableOrdering::Insertion) {
+    return;
+  }
+
+  // the factor graph has a vertex for each pose, landmark and range variable
+  // (in that order) and connects the variables of each measurement
+  const Index num_poses = numPoses();
+  const Index num_landmarks = numLandmarks();
+  const Index num_ranges = numRangeMeasurements();
+  std::vector<std::vector<Index>> adjacency(num_poses + num_landmarks +
+                                            num_ranges);
+  auto vertex = [&](const Symbol &sym) -> Index {
+    auto pose_search_it = pose_symbol_idxs_.find(sym);
+    if (pose_search_it != pose_symbol_idxs_.end()) {
+      return pose_search_it->second;
+    }
+    return num_poses + landmark_symbol_idxs_.at(sym);
+  };
+  auto connect = [&adjacency](Index a, Index b) {
+    adjacency[a].push_back(b);
+    adjacency[b].push_back(a);
+  };
+
+  for (const RelativePoseMeasurement &rpm : rel_pose_pose_measurements_) {
+    connect(vertex(rpm.first_id), vertex(rpm.second_id));
+  }
+  for (const RelativePoseLandmarkMeasurement &rplm :
+       rel_pose_landmark_measurements_) {
+    connect(vertex(rplm.first_id), vertex(rplm.second_id));
+  }
+  // priors are implemented as measurements from the origin pose
+  for (const PosePrior &pp : pose_priors_) {
+    connect(vertex(origin_symbol_), vertex(pp.id));
+  }
+  for (const LandmarkPrior &lp : landmark_priors_) {
+    connect(vertex(origin_symbol_), vertex(lp.id));
+  }
+  for (Index k = 0; k < num_ranges; k++) {
+    const RangeMeasurement &measure = range_measurements_[k];
+    Index range_vertex = num_poses + num_landmarks + k;
+    Index a = vertex(measure.first_id);
+    Index b = vertex(measure.second_id);
+    connect(range_vertex, a);
+    connect(range_vertex, b);
+    connect(a, b);
+  }
+  // repeated measurements between the same variables are a single edge
+  for (auto &neighbors : adjacency) {
+    std::sort(neighbors.begin(), neighbors.end());
+    neighbors.erase(std::unique(neighbors.begin(), neighbors.end()),
+                    neighbors.end());
+  }
+
+  // each block keeps the relative order of its variables in the ordering
+  pose_positions_.resize(num_poses);
+  landmark_positions_.resize(num_landmarks);
+  range_positions_.resize(num_ranges);
+  Index num_poses_placed = 0;
+  Index num_landmarks_placed = 0;
+  Index num_ranges_placed = 0;
+  for (Index v : reverseCuthillMcKee(adjacency)) {
+    if (v < num_poses) {
+      pose_positions_[v] = num_poses_placed++;
+    } else if (v < num_poses + num_landmarks) {
+      landmark_positions_[v - num_poses] = num_landmarks_placed++;
+    } else {
+      range_positions_[v - num_poses - num_landmarks] = num_ranges_placed++;
+    }
+  }
+}
+
 void Problem::updatePreconditioner() {
   if (preconditioner_ == Preconditioner::BlockCholesky) {
     // blocks are rots: n*d, ranges: r, and translations: n + l
@@ -531,15 +675,16 @@ void Problem::updatePreconditioner() {
     epsilonPosDefUpdate *= 1e-3;
     SparseMatrix regularized_data_matrix = data_matrix_ + epsilonPosDefUpdate;
     if (pin_last_translation_) {
-      preconditioner_matrices_.block_chol_factor_ptrs_ =
-          getBlockCholeskyFactorization(
-              regularized_data_matrix.block(0, 0,
-                                            regularized_data_matrix.rows() - 1,
-                                            regularized_data_matrix.cols() - 1),
-              block_sizes);
+      num_symbolic_analyses_skipped_ += updateBlockCholeskyFactorization(
+          preconditioner_matrices_.block_chol_factor_ptrs_,
+          regularized_data_matrix.block(0, 0,
+                                        regularized_data_matrix.rows() - 1,
+                                        regularized_data_matrix.cols() - 1),
+          block_sizes);
     } else {
-      preconditioner_matrices_.block_chol_factor_ptrs_ =
-          getBlockCholeskyFactorization(regularized_data_matrix, block_sizes);
+      num_symbolic_analyses_skipped_ += updateBlockCholeskyFactorization(
+          preconditioner_matrices_.block_chol_factor_ptrs_,
+          regularized_data_matrix, block_sizes);
     }
   } else if (preconditioner_ == Preconditioner::RegularizedCholesky) {
     // add a small value to the diagonal of the data matrix to ensure that it is
@@ -553,9 +698,13 @@ void Problem::updatePreconditioner() {
     // Here we use the fact that D >= 0, so that
     // ||D||_2 = lambda_max(D) = - lambda_min(-D)
 
-    CORA::SparseMatrix D = data_matrix_;
+    const SparseMatrix &D = data_matrix_;
     Optimization::LinearAlgebra::SymmetricLinearOperator<Matrix> neg_D_op =
-        [&D](const Matrix &X) -> Matrix { return -(D * X); };
+        [this, &D](const Matrix &X) -> Matrix {
+      Matrix DX;
+      symmetricThinDenseProduct(D, data_matrix_storage_, X, DX);
+      return -DX;
+    };
 
     // Estimate the algebraically-smallest eigenvalue of -D using LOBPCG
 
@@ -601,16 +750,17 @@ void Problem::updatePreconditioner() {
 
     if (pin_last_translation_) {
       block_sizes(0) = data_matrix_.rows() - 1;
-      preconditioner_matrices_.block_chol_factor_ptrs_ =
-          getBlockCholeskyFactorization(
-              regularized_data_matrix.block(0, 0,
-                                            regularized_data_matrix.rows() - 1,
-                                            regularized_data_matrix.cols() - 1),
-              block_sizes);
+      num_symbolic_analyses_skipped_ += updateBlockCholeskyFactorization(
+          preconditioner_matrices_.block_chol_factor_ptrs_,
+          regularized_data_matrix.block(0, 0,
+                                        regularized_data_matrix.rows() - 1,
+                                        regularized_data_matrix.cols() - 1),
+          block_sizes);
     } else {
       block_sizes(0) = data_matrix_.rows();
-      preconditioner_matrices_.block_chol_factor_ptrs_ =
-          getBlockCholeskyFactorization(regularized_data_matrix, block_sizes);
+      num_symbolic_analyses_skipped_ += updateBlockCholeskyFactorization(
+          preconditioner_matrices_.block_chol_factor_ptrs_,
+          regularized_data_matrix, block_sizes);
     }
 
   } else if (preconditioner_ == Preconditioner::Jacobi) {
@@ -622,151 +772,447 @@ void Problem::updatePreconditioner() {
   }
 }
 
-void Problem::fillDataMatrix() {
-  auto data_matrix_size = getDataMatrixSize();
-  data_matrix_ = SparseMatrix(data_matrix_size, data_matrix_size);
-
-  /**
-   * @brief From here we form the sub blocks of the data matrix Q
-   * and then assemble them into the full data matrix by adding the
-   * triplets together.
-   */
-
-  // Q11
-  // upper-left dn x dn block is:
-  // rotation connection Laplacian + T^T * Omega_t * T
-  // print the size of a, b, and c
-  SparseMatrix Q11 =
-      data_submatrices_.rotation_conn_laplacian +
-      data_submatrices_.rel_pose_translation_data_matrix.transpose() *
-          data_submatrices_.rel_pose_translation_precision_matrix *
-          data_submatrices_.rel_pose_translation_data_matrix;
-
-  // Q12 is all zeros
-
-  // Q13
-  // upper-right dn x (n+l) block is: T^T * Omega_t * A_t
-  SparseMatrix Q13 =
-      data_submatrices_.rel_pose_translation_data_matrix.transpose() *
-      data_submatrices_.rel_pose_translation_precision_matrix *
-      data_submatrices_.rel_pose_incidence_matrix;
-
-  // Q22
-  // the next (r x r) block on the diagonal is: Omega_r * D * D
-  SparseMatrix OmegaRD = data_submatrices_.range_precision_matrix *
-                         data_submatrices_.range_dist_matrix;
-  SparseMatrix Q22 = OmegaRD * data_submatrices_.range_dist_matrix;
-
-  // Q23
-  // the next (r x (n+l)) block to the right of the (r x r) block on the
-  // diagonal is D * Omega_r * A_r
-  SparseMatrix Q23 = OmegaRD * data_submatrices_.range_incidence_matrix;
-
-  // Q33
-  // the bottom-right block on the diagonal is: L_r + L_t
-  SparseMatrix Q33 = (data_submatrices_.rel_pose_incidence_matrix.transpose() *
-                      data_submatrices_.rel_pose_translation_precision_matrix *
-                      data_submatrices_.rel_pose_incidence_matrix) +
-                     (data_submatrices_.range_incidence_matrix.transpose() *
-                      data_submatrices_.range_precision_matrix *
-                      data_submatrices_.range_incidence_matrix);
-
-  /**
-   * @brief Now we join all of the triplets together, properly offsetting the
-   * indices of the triplets to account for the fact that the submatrices are
-   * located in different parts of the data matrix.
-   */
-  std::vector<Eigen::Triplet<Scalar>> combined_triplets;
-  combined_triplets.reserve(Q11.nonZeros() + 2 * Q13.nonZeros() +
-                            Q22.nonZeros() + 2 * Q23.nonZeros() +
-                            Q33.nonZeros());
-
-  // lambda function to add triplets to the combined triplets vector
-  auto addTriplets = [&combined_triplets](const SparseMatrix &matrix,
-                                          size_t row_offset,
-                                          size_t col_offset) {
-    for (int k = 0; k < matrix.outerSize(); ++k) {
-      for (SparseMatrix::InnerIterator it(matrix, k); it; ++it) {
-        combined_triplets.emplace_back(it.row() + row_offset,
-                                       it.col() + col_offset, it.value());
+template <typename EntryFunc>
+void Problem::forEachDataMatrixEntry(EntryFunc &&add_any_entry,
+                                     const ProblemCounts &start) const {
+  const Index d = dim_;
+  const bool upper_only =
+      data_matrix_storage_ == MatrixStorage::UpperTriangular;
+  auto add_entry = [&](Index row, Index col, Scalar val) {
+    if (!upper_only || col >= row) {
+      add_any_entry(row, col, val);
+    }
+  };
+
+  // adds the connection Laplacian terms of a relative rotation R (with
+  // precision kappa) from the i-th to the j-th rotation
+  auto addRotationTerms = [&](Index i, Index j, const Matrix &R,
+                              Scalar kappa) {
+    for (Index k = 0; k < d; k++) {
+      add_entry(d * i + k, d * i + k, kappa);
+      add_entry(d * j + k, d * j + k, kappa);
+    }
+    for (Index r = 0; r < d; r++) {
+      for (Index c = 0; c < d; c++) {
+        add_entry(d * i + r, d * j + c, -kappa * R(r, c));
+        add_entry(d * j + c, d * i + r, -kappa * R(r, c));
       }
     }
   };
 
-  auto rot_mat_sz = numPosesDim();
+  // adds the terms of a translation t (with precision tau) measured in the
+  // frame of the i-th rotation, from translation a to translation b. These are
+  // the contributions of the measurement to T^T * Omega_t * T (Q11),
+  // T^T * Omega_t * A_t (Q13) and A_t^T * Omega_t * A_t (Q33)
+  auto addTranslationTerms = [&](Index i, Index a, Index b, const Vector &t,
+                                 Scalar tau) {
+    for (Index r = 0; r < d; r++) {
+      for (Index c = 0; c < d; c++) {
+        add_entry(d * i + r, d * i + c, tau * t(r) * t(c));
+      }
+      add_entry(d * i + r, a, tau * t(r));
+      add_entry(a, d * i + r, tau * t(r));
+      add_entry(d * i + r, b, -tau * t(r));
+      add_entry(b, d * i + r, -tau * t(r));
+    }
+    add_entry(a, a, tau);
+    add_entry(b, b, tau);
+    add_entry(a, b, -tau);
+    add_entry(b, a, -tau);
+  };
+
+  // pose-pose measures
+  for (auto rpm_it =
+           rel_pose_pose_measurements_.begin() + start.num_pose_pose_measurements;
+       rpm_it != rel_pose_pose_measurements_.end(); ++rpm_it) {
+    const RelativePoseMeasurement &rpm = *rpm_it;
+    Index i = getRotationIdx(rpm.first_id);
+    addRotationTerms(i, getRotationIdx(rpm.second_id), rpm.R,
+                     rpm.getRotPrecision());
+    addTranslationTerms(i, getTranslationIdx(rpm.first_id),
+                        getTranslationIdx(rpm.second_id), rpm.t,
+                        rpm.getTransPrecision());
+  }
+
+  // pose priors are implemented as measurements from the origin pose
+  for (auto pp_it = pose_priors_.begin() + start.num_pose_priors;
+       pp_it != pose_priors_.end(); ++pp_it) {
+    const PosePrior &pp = *pp_it;
+    Index i = getRotationIdx(origin_symbol_);
+    addRotationTerms(i, getRotationIdx(pp.id), pp.R, pp.getRotPrecision());
+    addTranslationTerms(i, getTranslationIdx(origin_symbol_),
+                        getTranslationIdx(pp.id), pp.t,
+                        pp.getTransPrecision());
+  }
+
+  // pose-landmark measures
+  for (auto rplm_it = rel_pose_landmark_measurements_.begin() +
+                      start.num_pose_landmark_measurements;
+       rplm_it != rel_pose_landmark_measurements_.end(); ++rplm_it) {
+    const RelativePoseLandmarkMeasurement &rplm = *rplm_it;
+    addTranslationTerms(getRotationIdx(rplm.first_id),
+                        getTranslationIdx(rplm.first_id),
+                        getTranslationIdx(rplm.second_id), rplm.t,
+                        rplm.getTransPrecision());
+  }
+
+  // landmark priors are implemented as measurements from the origin pose
+  for (auto lp_it = landmark_priors_.begin() + start.num_landmark_priors;
+       lp_it != landmark_priors_.end(); ++lp_it) {
+    const LandmarkPrior &lp = *lp_it;
+    addTranslationTerms(getRotationIdx(origin_symbol_),
+                        getTranslationIdx(origin_symbol_),
+                        getTranslationIdx(lp.id), lp.p,
+                        lp.getTransPrecision());
+  }
+
+  // range measures contribute to Omega_r * D * D (Q22),
+  // D * Omega_r * A_r (Q23) and A_r^T * Omega_r * A_r (Q33)
+  const Index range_offset = numPosesDim();
+  for (Index k = start.num_range_measurements; k < numRangeMeasurements();
+       k++) {
+    const RangeMeasurement &measure = range_measurements_[k];
+    Index row = range_offset + getRangePosition(k);
+    Index a = getTranslationIdx(measure.first_id);
+    Index b = getTranslationIdx(measure.second_id);
+    Scalar omega = measure.getPrecision();
+    Scalar omega_r = omega * measure.r;
+
+    add_entry(row, row, omega_r * measure.r);
+    add_entry(row, a, -omega_r);
+    add_entry(a, row, -omega_r);
+    add_entry(row, b, omega_r);
+    add_entry(b, row, omega_r);
+    add_entry(a, a, omega);
+    add_entry(b, b, omega);
+    add_entry(a, b, -omega);
+    add_entry(b, a, -omega);
+  }
+}
+
+void Problem::fillDataMatrix() {
+  data_matrix_ = assembleDataMatrix();
+  data_matrix_pattern_changed_ = true;
+}
+
+SparseMatrix Problem::assembleDataMatrix() const {
+  auto data_matrix_size = getDataMatrixSize();
+
+  // First pass: count the number of contributions to each row. Repeated
+  // contributions to the same coefficient are counted separately, so this is
+  // an upper bound on the number of nonzeros of each row
+  VectorXi row_nnz = VectorXi::Zero(data_matrix_size);
+  forEachDataMatrixEntry(
+      [&row_nnz](Index row, Index, Scalar) { row_nnz(row)++; });
+
+  // Second pass: scatter the contributions directly into the reserved rows of
+  // the data matrix, summing repeated contributions in place
+  SparseMatrix Q(data_matrix_size, data_matrix_size);
+  Q.reserve(row_nnz);
+  forEachDataMatrixEntry(
+      [&Q](Index row, Index col, Scalar val) { Q.coeffRef(row, col) += val; });
+  Q.makeCompressed();
+  return Q;
+}
+
+const SparseMatrix &
+Problem::getAssembledDataMatrix(SparseMatrix &assembled) const {
+  if (data_matrix_operator_ == DataMatrixOperator::Assembled) {
+    return data_matrix_;
+  }
+  assembled = assembleDataMatrix();
+  return assembled;
+}
+
+void Problem::fillMatrixFreeDataMatrix() {
+  const Index d = dim_;
+  matrix_free_data_matrix_ = MatrixFreeDataMatrix(d, getDataMatrixSize());
+
+  // the edges mirror the measurements visited by forEachDataMatrixEntry()
+  for (const RelativePoseMeasurement &rpm : rel_pose_pose_measurements_) {
+    matrix_free_data_matrix_.addPoseEdge(
+        d * getRotationIdx(rpm.first_id), d * getRotationIdx(rpm.second_id),
+        getTranslationIdx(rpm.first_id), getTranslationIdx(rpm.second_id),
+        rpm.R, rpm.t, rpm.getRotPrecision(), rpm.getTransPrecision());
+  }
+
+  // pose priors are implemented as measurements from the origin pose
+  for (const PosePrior &pp : pose_priors_) {
+    matrix_free_data_matrix_.addPoseEdge(
+        d * getRotationIdx(origin_symbol_), d * getRotationIdx(pp.id),
+        getTranslationIdx(origin_symbol_), getTranslationIdx(pp.id), pp.R,
+        pp.t, pp.getRotPrecision(), pp.getTransPrecision());
+  }
+
+  for (const RelativePoseLandmarkMeasurement &rplm :
+       rel_pose_landmark_measurements_) {
+    matrix_free_data_matrix_.addTranslationEdge(
+        d * getRotationIdx(rplm.first_id), getTranslationIdx(rplm.first_id),
+        getTranslationIdx(rplm.second_id), rplm.t, rplm.getTransPrecision());
+  }
+
+  // landmark priors are implemented as measurements from the origin pose
+  for (const LandmarkPrior &lp : landmark_priors_) {
+    matrix_free_data_matrix_.addTranslationEdge(
+        d * getRotationIdx(origin_symbol_), getTranslationIdx(origin_symbol_),
+        getTranslationIdx(lp.id), lp.p, lp.getTransPrecision());
+  }
+
+  const Index range_offset = numPosesDim();
+  for (Index k = 0; k < numRangeMeasurements(); k++) {
+    const RangeMeasurement &measure = range_measurements_[k];
+    matrix_free_data_matrix_.addRangeEdge(
+        range_offset + getRangePosition(k), getTranslationIdx(measure.first_id),
+        getTranslationIdx(measure.second_id), measure.r,
+        measure.getPrecision());
+  }
+
+  matrix_free_data_matrix_.finalize();
+}
+
+Problem::ProblemCounts Problem::getProblemCounts() const {
+  ProblemCounts counts;
+  counts.num_poses = numPoses();
+  counts.num_landmarks = numLandmarks();
+  counts.num_range_measurements = numRangeMeasurements();
+  counts.num_pose_pose_measurements = numPosePoseMeasurements();
+  counts.num_pose_landmark_measurements = numPoseLandmarkMeasurements();
+  counts.num_pose_priors = numPosePriors();
+  counts.num_landmark_priors = numLandmarkPriors();
+  return counts;
+}
+
+bool Problem::patchDataMatrix() {
+  const ProblemCounts &old_counts = assembled_counts_;
+  auto data_matrix_size = getDataMatrixSize();
   auto rot_range_mat_sz = rotAndRangeMatrixSize();
-  // Q11, Q13, Q22, Q23, Q33
-  addTriplets(Q11, 0, 0);
-  addTriplets(Q13, 0, rot_range_mat_sz);
-  addTriplets(Q22, rot_mat_sz, rot_mat_sz);
-  addTriplets(Q23, rot_mat_sz, rot_range_mat_sz);
-  addTriplets(Q33, rot_range_mat_sz, rot_range_mat_sz);
 
-  // also add Q13 and Q23 transposed to the triplets
-  addTriplets(Q13.transpose(), rot_range_mat_sz, 0);
-  addTriplets(Q23.transpose(), rot_range_mat_sz, rot_mat_sz);
+  // the implicit formulation blocks can only be patched if they were
+  // assembled at the last update
+  bool patch_implicit_blocks =
+      formulation_ == Formulation::Implicit &&
+      Qmain_.rows() == rot_range_mat_sz &&
+      TransOffDiagRed_.cols() == numTranslationalStates() - 1;
+
+  // if no variables were added and every new contribution falls on an
+  // existing nonzero, the values can be updated in place
+  if (data_matrix_size == data_matrix_.rows()) {
+    bool pattern_unchanged = true;
+    forEachDataMatrixEntry(
+        [this, &pattern_unchanged](Index row, Index col, Scalar) {
+          const auto *row_begin =
+              data_matrix_.innerIndexPtr() + data_matrix_.outerIndexPtr()[row];
+          const auto *row_end = data_matrix_.innerIndexPtr() +
+                                data_matrix_.outerIndexPtr()[row + 1];
+          pattern_unchanged &= std::binary_search(row_begin, row_end, col);
+        },
+        old_counts);
+
+    if (pattern_unchanged) {
+      forEachDataMatrixEntry(
+          [&](Index row, Index col, Scalar val) {
+            data_matrix_.coeffRef(row, col) += val;
+            if (!patch_implicit_blocks || row >= rot_range_mat_sz) {
+              return;
+            }
+            if (col < rot_range_mat_sz) {
+              Qmain_.coeffRef(row, col) += val;
+            } else if (col < data_matrix_size - 1) {
+              TransOffDiagRed_.coeffRef(row, col - rot_range_mat_sz) += val;
+            }
+          },
+          old_counts);
+      data_matrix_pattern_changed_ = false;
+      return patch_implicit_blocks;
+    }
+  }
 
-  // construct the data matrix
-  data_matrix_.setFromTriplets(combined_triplets.begin(),
-                               combined_triplets.end());
+  // Otherwise, relabel the existing rows into the new variable ordering. The
+  // relabelling is monotone (the old variables keep their relative order), so
+  // the column indices of each row stay sorted and can be appended directly
+  const Index old_rot_mat_sz = dim_ * old_counts.num_poses;
+  const Index old_rot_range_mat_sz =
+      old_rot_mat_sz + old_counts.num_range_measurements;
+  const Index old_pose_trans_end =
+      old_rot_range_mat_sz + old_counts.num_poses;
+  const Index rot_shift = numPosesDim() - old_rot_mat_sz;
+  const Index trans_shift = rot_range_mat_sz - old_rot_range_mat_sz;
+  const Index landmark_shift =
+      trans_shift + numPoses() - old_counts.num_poses;
+  auto relabel = [&](Index idx) -> Index {
+    if (idx < old_rot_mat_sz) {
+      return idx;
+    } else if (idx < old_rot_range_mat_sz) {
+      return idx + rot_shift;
+    } else if (idx < old_pose_trans_end) {
+      return idx + trans_shift;
+    }
+    return idx + landmark_shift;
+  };
+
+  // reserve room for the existing nonzeros of each row plus (an upper bound
+  // on) the new contributions
+  VectorXi row_nnz = VectorXi::Zero(data_matrix_size);
+  for (Index row = 0; row < data_matrix_.outerSize(); row++) {
+    row_nnz(relabel(row)) = data_matrix_.outerIndexPtr()[row + 1] -
+                            data_matrix_.outerIndexPtr()[row];
+  }
+  forEachDataMatrixEntry(
+      [&row_nnz](Index row, Index, Scalar) { row_nnz(row)++; }, old_counts);
+
+  SparseMatrix patched_data_matrix(data_matrix_size, data_matrix_size);
+  patched_data_matrix.reserve(row_nnz);
+  for (Index row = 0; row < data_matrix_.outerSize(); row++) {
+    Index new_row = relabel(row);
+    for (SparseMatrix::InnerIterator it(data_matrix_, row); it; ++it) {
+      patched_data_matrix.insert(new_row, relabel(it.col())) = it.value();
+    }
+  }
+  forEachDataMatrixEntry(
+      [&patched_data_matrix](Index row, Index col, Scalar val) {
+        patched_data_matrix.coeffRef(row, col) += val;
+      },
+      old_counts);
+  patched_data_matrix.makeCompressed();
+
+  data_matrix_ = std::move(patched_data_matrix);
+  data_matrix_pattern_changed_ = true;
+  return false;
 }
 
-void Problem::fillImplicitFormulationMatrices() {
+void Problem::fillImplicitFormulationMatrices(bool extract_blocks) {
   if (formulation_ != Formulation::Implicit) {
     throw std::invalid_argument("Implicit formulation matrices should only be "
                                 "filled when the problem is in implicit "
                                 "formulation mode");
   }
 
-  // Qmain_ is the upper-left (dn + r) x (dn + r) block of Q
-  // Qmain_ = [Q11 0; 0 Q22]
-  Qmain_ = data_matrix_.block(0, 0, rotAndRangeMatrixSize(),
-                              rotAndRangeMatrixSize());
-
-  // Translational off-diagonal blocks (reduced by ignoring the last column)
-  // TransOffDiag = [Q13; Q23]
-  // TransOffDiagRed_ = TransOffDiag(:, 1:end-1)
-  TransOffDiagRed_ =
-      data_matrix_.block(0, rotAndRangeMatrixSize(), rotAndRangeMatrixSize(),
-                         numTranslationalStates() - 1);
+  if (extract_blocks) {
+    // Qmain_ is the upper-left (dn + r) x (dn + r) block of Q
+    // Qmain_ = [Q11 0; 0 Q22]
+    Qmain_ = data_matrix_.block(0, 0, rotAndRangeMatrixSize(),
+                                rotAndRangeMatrixSize());
+
+    // Translational off-diagonal blocks (reduced by ignoring the last column)
+    // TransOffDiag = [Q13; Q23]
+    // TransOffDiagRed_ = TransOffDiag(:, 1:end-1)
+    TransOffDiagRed_ =
+        data_matrix_.block(0, rotAndRangeMatrixSize(), rotAndRangeMatrixSize(),
+                           numTranslationalStates() - 1);
+  }
 
   // Want to be able to apply the inverse of the bottom-right block of Q (via a
   // Cholesky solve)
   // Ltrans = Q33;
   // LtransCholRed_ = chol(Ltrans(1:end-1, 1:end-1), 'lower');
-  LtransCholRed_ = std::make_shared<CholeskyFactorization>(data_matrix_.block(
-      rotAndRangeMatrixSize(), rotAndRangeMatrixSize(),
-      numTranslationalStates() - 1, numTranslationalStates() - 1));
+  if (refactorizeCholesky(
+          LtransCholRed_,
+          data_matrix_.block(rotAndRangeMatrixSize(), rotAndRangeMatrixSize(),
+                             numTranslationalStates() - 1,
+                             numTranslationalStates() - 1))) {
+    num_symbolic_analyses_skipped_++;
+  }
+}
+
+void Problem::fillBlockSparseRotationSplit() {
+  const SparseMatrix &A =
+      formulation_ == Formulation::Explicit ? data_matrix_ : Qmain_;
+  const Index rot_mat_sz = numPosesDim();
+
+  // the rotation block is stored in full, whatever the storage of A
+  SparseMatrix rotation_block = A.topLeftCorner(rot_mat_sz, rot_mat_sz);
+  block_sparse_rotation_split_.rotations = BlockSparseMatrix(
+      getFullSymmetricMatrix(rotation_block, data_matrix_storage_), dim_);
+
+  block_sparse_rotation_split_.remainder = A;
+  block_sparse_rotation_split_.remainder.prune(
+      [rot_mat_sz](Index row, Index col, Scalar) {
+        return row >= rot_mat_sz || col >= rot_mat_sz;
+      });
+}
+
+void Problem::mainDataMatrixProduct(const Matrix &Y, Matrix &QY) const {
+  const SparseMatrix &A =
+      formulation_ == Formulation::Explicit ? data_matrix_ : Qmain_;
+  if (!block_sparse_rotations_) {
+    symmetricThinDenseProduct(A, data_matrix_storage_, Y, QY,
+                              workspace_.thin_product_rows,
+                              workspace_.thin_product_result_rows);
+    return;
+  }
+
+  symmetricThinDenseProduct(block_sparse_rotation_split_.remainder,
+                            data_matrix_storage_, Y, QY,
+                            workspace_.thin_product_rows,
+                            workspace_.thin_product_result_rows);
+  const Index rot_mat_sz = numPosesDim();
+  addBlockSparseProduct(block_sparse_rotation_split_.rotations,
+                        Y.topRows(rot_mat_sz), QY.topRows(rot_mat_sz));
 }
 
 Matrix Problem::dataMatrixProduct(const Matrix &Y) const {
+  Matrix QY;
+  dataMatrixProduct(Y, QY);
+  return QY;
+}
+
+void Problem::dataMatrixProduct(const Matrix &Y, Matrix &QY) const {
   checkMatrixShape("Problem::dataMatrixProduct::Y", getExpectedVariableSize(),
                    Y.cols(), Y.rows(), Y.cols());
   if (formulation_ == Formulation::Explicit) {
-    return data_matrix_ * Y;
+    if (data_matrix_operator_ == DataMatrixOperator::MatrixFree) {
+      matrix_free_data_matrix_.multiply(Y, QY, workspace_.thin_product_rows,
+                                        workspace_.thin_product_result_rows);
+    } else {
+      mainDataMatrixProduct(Y, QY);
+    }
   } else if (formulation_ == Formulation::Implicit) {
-    Matrix QY = (Qmain_ * Y);
-    Matrix P1 = TransOffDiagRed_.transpose() * Y;
-    Matrix P2 = LtransCholRed_->solve(P1);
-    Matrix P3 = TransOffDiagRed_ * P2;
-
-    return QY - P3;
+    // QY = Qmain * Y - TransOffDiagRed * LtransCholRed^{-1} *
+    // TransOffDiagRed^T * Y
+    workspace_.trans_rhs.noalias() = TransOffDiagRed_.transpose() * Y;
+    workspace_.trans_solution = LtransCholRed_->solve(workspace_.trans_rhs);
+    mainDataMatrixProduct(Y, QY);
+    sparseThinDenseProduct(TransOffDiagRed_, workspace_.trans_solution,
+                           workspace_.trans_product,
+                           workspace_.thin_product_rows);
+    QY -= workspace_.trans_product;
   } else {
     throw std::invalid_argument("Unknown formulation");
   }
 }
 
+const Matrix &Problem::cachedDataMatrixProduct(const Matrix &Y) const {
+  // the sizes are checked first, as Eigen only compares same-sized matrices
+  bool is_cached_point = data_product_cache_.valid &&
+                         data_product_cache_.Y.rows() == Y.rows() &&
+                         data_product_cache_.Y.cols() == Y.cols() &&
+                         data_product_cache_.Y == Y;
+  if (!is_cached_point) {
+    data_product_cache_.num_misses++;
+    dataMatrixProduct(Y, data_product_cache_.QY);
+    data_product_cache_.Y = Y;
+    data_product_cache_.valid = true;
+  }
+  return data_product_cache_.QY;
+}
+
 Scalar Problem::evaluateObjective(const Matrix &Y) const {
   checkUpToDate();
-  return 0.5 * (Y.transpose() * dataMatrixProduct(Y)).trace();
+  // f(Y) = 0.5 * tr(Y^T Q Y) = 0.5 * <Y, QY>
+  return 0.5 * Y.cwiseProduct(cachedDataMatrixProduct(Y)).sum();
 }
 
 Matrix Problem::Euclidean_gradient(const Matrix &Y) const {
+  Matrix egrad;
+  Euclidean_gradient(Y, egrad);
+  return egrad;
+}
+
+void Problem::Euclidean_gradient(const Matrix &Y, Matrix &NablaF_Y) const {
   checkUpToDate();
-  Matrix egrad = dataMatrixProduct(Y);
+  NablaF_Y = cachedDataMatrixProduct(Y);
   checkMatrixShape("Problem::Euclidean_gradient", Y.rows(), Y.cols(),
-                   egrad.rows(), egrad.cols());
-  return egrad;
+                   NablaF_Y.rows(), NablaF_Y.cols());
 }
 
 Matrix Problem::Riemannian_gradient(const Matrix &Y) const {
@@ -779,8 +1225,21 @@ Matrix Problem::Riemannian_gradient(const Matrix &Y,
   return tangent_space_projection(Y, NablaF_Y);
 }
 
+void Problem::Riemannian_gradient(const Matrix &Y, const Matrix &NablaF_Y,
+                                  Matrix &grad_F_Y) const {
+  checkUpToDate();
+  tangent_space_projection(Y, NablaF_Y, grad_F_Y);
+}
+
 Matrix Problem::tangent_space_projection(const Matrix &Y,
                                          const Matrix &Ydot) const {
+  Matrix result;
+  tangent_space_projection(Y, Ydot, result);
+  return result;
+}
+
+void Problem::tangent_space_projection(const Matrix &Y, const Matrix &Ydot,
+                                       Matrix &result) const {
   // similar to projectToManifold, we treat this projection block-wise. The
   // first n*d columns are Stiefel elements, and thus use the Stiefel
   // projection. The next r columns are range measurements, and thus use the
@@ -795,28 +1254,18 @@ Matrix Problem::tangent_space_projection(const Matrix &Y,
                    getExpectedVariableSize(), relaxation_rank_, Ydot.rows(),
                    Ydot.cols());
 
-  Matrix result = Ydot;
+  // the translational component is untouched
+  result = Ydot;
 
-  // Stiefel component
+  // Stiefel and oblique components, projected in place in the layout of Y
   auto rot_mat_sz = numPosesDim();
-  result.block(0, 0, rot_mat_sz, relaxation_rank_) =
-      manifolds_.stiefel_prod_manifold_
-          .projectToTangentSpace(
-              Y.block(0, 0, rot_mat_sz, relaxation_rank_).transpose(),
-              result.block(0, 0, rot_mat_sz, relaxation_rank_).transpose())
-          .transpose();
-
-  // Oblique component
   int r = numRangeMeasurements();
-  result.block(rot_mat_sz, 0, r, relaxation_rank_) =
-      manifolds_.oblique_manifold_
-          .projectToTangentSpace(
-              Y.block(rot_mat_sz, 0, r, relaxation_rank_).transpose(),
-              result.block(rot_mat_sz, 0, r, relaxation_rank_).transpose())
-          .transpose();
-
-  // remaining component is untouched
-  return result;
+  auto rot_rows = result.topRows(rot_mat_sz);
+  manifolds_.stiefel_prod_manifold_.projectTransposedToTangentSpace(
+      Y.topRows(rot_mat_sz), rot_rows, rot_rows);
+  auto range_rows = result.middleRows(rot_mat_sz, r);
+  manifolds_.oblique_manifold_.projectTransposedToTangentSpace(
+      Y.middleRows(rot_mat_sz, r), range_rows, range_rows);
 }
 
 Matrix Problem::Riemannian_Hessian_vector_product(const Matrix &Y,
@@ -828,65 +1277,81 @@ Matrix Problem::Riemannian_Hessian_vector_product(const Matrix &Y,
   checkMatrixShape("Problem::Riemannian_Hessian_vector_product::nablaF_Y",
                    getExpectedVariableSize(), relaxation_rank_, nablaF_Y.rows(),
                    nablaF_Y.cols());
+  return Riemannian_Hessian_vector_product(
+      Y, compute_Lambda_blocks(Y, nablaF_Y), dotY);
+}
+
+Matrix Problem::Riemannian_Hessian_vector_product(
+    const Matrix &Y, const LambdaBlocks &Lambda_blocks,
+    const Matrix &dotY) const {
+  Matrix H_dotY;
+  Riemannian_Hessian_vector_product(Y, Lambda_blocks, dotY, H_dotY);
+  return H_dotY;
+}
+
+void Problem::Riemannian_Hessian_vector_product(
+    const Matrix &Y, const LambdaBlocks &Lambda_blocks, const Matrix &dotY,
+    Matrix &H_dotY) const {
+  checkMatrixShape("Problem::Riemannian_Hessian_vector_product::Y",
+                   getExpectedVariableSize(), relaxation_rank_, Y.rows(),
+                   Y.cols());
   checkMatrixShape("Problem::Riemannian_Hessian_vector_product::dotY",
                    getExpectedVariableSize(), relaxation_rank_, dotY.rows(),
                    dotY.cols());
 
-  Matrix H_dotY = dataMatrixProduct(dotY);
+  dataMatrixProduct(dotY, H_dotY);
 
+  // Stiefel component: subtract the curvature term BlockDiag(Lambda) * dotY
+  // and project onto the tangent space, in place in the layout of Y
   auto rot_mat_sz = numPosesDim();
-  // Stiefel component
-  H_dotY.block(0, 0, rot_mat_sz, relaxation_rank_) =
-      manifolds_.stiefel_prod_manifold_
-          .projectToTangentSpace(
-              Y.block(0, 0, rot_mat_sz, relaxation_rank_).transpose(),
-              H_dotY.block(0, 0, rot_mat_sz, relaxation_rank_).transpose() -
-                  manifolds_.stiefel_prod_manifold_.SymBlockDiagProduct(
-                      dotY.block(0, 0, rot_mat_sz, relaxation_rank_)
-                          .transpose(),
-                      Y.block(0, 0, rot_mat_sz, relaxation_rank_),
-                      nablaF_Y.block(0, 0, rot_mat_sz, relaxation_rank_)
-                          .transpose()))
-          .transpose();
-
-  // Oblique component
+  auto rot_rows = H_dotY.topRows(rot_mat_sz);
+  manifolds_.stiefel_prod_manifold_.subtractTransposedBlockDiagProduct(
+      Lambda_blocks.first, dotY.topRows(rot_mat_sz), rot_rows);
+  manifolds_.stiefel_prod_manifold_.projectTransposedToTangentSpace(
+      Y.topRows(rot_mat_sz), rot_rows, rot_rows);
+
+  // Oblique component: subtract the rows of dotY weighted by the oblique
+  // multipliers (the diagonal of Q*Y*Y^T restricted to the range variables)
   int r = numRangeMeasurements();
-  Vector diagQXXT = (nablaF_Y.array() * Y.array()).rowwise().sum();
-  // weight the rows of dotY by the diagonal of QXXT (which is a vector)
-  Matrix weightedDotY = dotY.array().colwise() * diagQXXT.array();
-  Matrix euclidean_hessian = H_dotY.block(rot_mat_sz, 0, r, relaxation_rank_) =
-      manifolds_.oblique_manifold_
-          .projectToTangentSpace(
-              Y.block(rot_mat_sz, 0, r, relaxation_rank_).transpose(),
-              (H_dotY.block(rot_mat_sz, 0, r, relaxation_rank_) -
-               weightedDotY.block(rot_mat_sz, 0, r, relaxation_rank_))
-                  .transpose())
-          .transpose();
-
-  return H_dotY;
+  auto range_rows = H_dotY.middleRows(rot_mat_sz, r);
+  range_rows.noalias() -=
+      Lambda_blocks.second.asDiagonal() * dotY.middleRows(rot_mat_sz, r);
+  manifolds_.oblique_manifold_.projectTransposedToTangentSpace(
+      Y.middleRows(rot_mat_sz, r), range_rows, range_rows);
 }
 
 Matrix Problem::precondition(const Matrix &V) const {
+  Matrix res;
+  precondition(V, res);
+  return res;
+}
+
+void Problem::precondition(const Matrix &V, Matrix &res) const {
   checkMatrixShape("Problem::precondition::input", getExpectedVariableSize(),
                    relaxation_rank_, V.rows(), V.cols());
-  Matrix res;
   if (preconditioner_ == Preconditioner::BlockCholesky ||
       preconditioner_ == Preconditioner::RegularizedCholesky) {
     if (formulation_ == Formulation::Explicit) {
-      res = blockCholeskySolve(preconditioner_matrices_.block_chol_factor_ptrs_,
-                               V);
+      blockCholeskySolve(preconditioner_matrices_.block_chol_factor_ptrs_, V,
+                         res);
     } else if (formulation_ == Formulation::Implicit) {
-      Matrix V_lift = Matrix::Zero(getDataMatrixSize(), relaxation_rank_);
-      // the upper block of V_lift is V
+      // the upper block of the lifted vector is V, the rest is zero
+      Matrix &V_lift = workspace_.lifted_rhs;
+      V_lift.resize(getDataMatrixSize(), relaxation_rank_);
       V_lift.topRows(rotAndRangeMatrixSize()) = V;
-      Matrix res_lift = blockCholeskySolve(
-          preconditioner_matrices_.block_chol_factor_ptrs_, V_lift);
-      res = res_lift.topRows(rotAndRangeMatrixSize());
+      V_lift.bottomRows(getDataMatrixSize() - rotAndRangeMatrixSize())
+          .setZero();
+      blockCholeskySolve(preconditioner_matrices_.block_chol_factor_ptrs_,
+                         V_lift, workspace_.lifted_solution);
+      res = workspace_.lifted_solution.topRows(rotAndRangeMatrixSize());
     } else {
       throw std::invalid_argument("Unknown formulation");
     }
   } else if (preconditioner_ == Preconditioner::Jacobi) {
-    res = preconditioner_matrices_.jacobi_preconditioner_ * V;
+    // scale the rows of V coefficient-wise (a product with the DiagonalMatrix
+    // itself would copy its diagonal), so res may alias V
+    res = V.array().colwise() *
+          preconditioner_matrices_.jacobi_preconditioner_.diagonal().array();
   } else {
     throw std::invalid_argument("The desired preconditioner is not "
                                 "implemented");
@@ -899,7 +1364,6 @@ Matrix Problem::precondition(const Matrix &V) const {
     std::cout << "NaNs in preconditioned vector:\n" << res << std::endl;
     throw std::runtime_error("NaNs in preconditioned vector");
   }
-  return res;
 }
 
 Matrix Problem::projectToManifold(const Matrix &A) const {
@@ -907,34 +1371,46 @@ Matrix Problem::projectToManifold(const Matrix &A) const {
                    relaxation_rank_, A.rows(), A.cols());
 
   Matrix result = A;
+  projectToManifoldInPlace(result);
+  return result;
+}
 
-  // the first n*d rows are obtained from
-  // manifolds_.stiefel_prod.projectToManifoldresult(1:n*d, :))
+void Problem::projectToManifoldInPlace(Matrix &A) const {
+  checkMatrixShape("Problem::projectToManifoldInPlace",
+                   getExpectedVariableSize(), relaxation_rank_, A.rows(),
+                   A.cols());
 
+  // the first n*d rows are obtained from
+  // manifolds_.stiefel_prod.projectToManifold(A(1:n*d, :)^T)^T
   auto rot_mat_sz = numPosesDim();
-  result.block(0, 0, rot_mat_sz, relaxation_rank_) =
-      manifolds_.stiefel_prod_manifold_
-          .projectToManifold(
-              result.block(0, 0, rot_mat_sz, relaxation_rank_).transpose())
-          .transpose();
+  auto rot_rows = A.topRows(rot_mat_sz);
+  manifolds_.stiefel_prod_manifold_.projectTransposedToManifold(rot_rows,
+                                                                rot_rows);
 
   // the next r rows are obtained from
-  // manifolds_.oblique_manifold.retract(Y(n*d+1:n*d+r, :), V(n*d+1:n*d+r, :))
+  // manifolds_.oblique_manifold.projectToManifold(A(n*d+1:n*d+r, :)^T)^T
   int r = numRangeMeasurements();
-  result.block(rot_mat_sz, 0, r, relaxation_rank_) =
-      manifolds_.oblique_manifold_
-          .projectToManifold(
-              result.block(rot_mat_sz, 0, r, relaxation_rank_).transpose())
-          .transpose();
+  auto range_rows = A.middleRows(rot_mat_sz, r);
+  manifolds_.oblique_manifold_.projectTransposedToManifold(range_rows,
+                                                           range_rows);
 
   // if there are remaining rows, they should be translational variables and
   // thus belong to the Euclidean manifold and do not need rounding.
+}
 
+Matrix Problem::retract(const Matrix &Y, const Matrix &V) const {
+  Matrix result;
+  retract(Y, V, result);
   return result;
 }
 
-Matrix Problem::retract(const Matrix &Y, const Matrix &V) const {
-  return projectToManifold(Y + V);
+void Problem::retract(const Matrix &Y, const Matrix &V, Matrix &Y_plus) const {
+  checkMatrixShape("Problem::retract::Y", getExpectedVariableSize(),
+                   relaxation_rank_, Y.rows(), Y.cols());
+  checkMatrixShape("Problem::retract::V", getExpectedVariableSize(),
+                   relaxation_rank_, V.rows(), V.cols());
+  Y_plus = Y + V;
+  projectToManifoldInPlace(Y_plus);
 }
 
 int Problem::getDataMatrixSize() const {
@@ -964,7 +1440,7 @@ std::vector<Symbol> Problem::getPoseSymbols(unsigned char chr) const {
 Index Problem::getRotationIdx(const Symbol &pose_symbol) const {
   auto rotation_search_it = pose_symbol_idxs_.find(pose_symbol);
   if (rotation_search_it != pose_symbol_idxs_.end()) {
-    return rotation_search_it->second;
+    return getPosition(pose_positions_, rotation_search_it->second);
   }
 
   // if we get here, we didn't find the pose symbol
@@ -973,22 +1449,22 @@ Index Problem::getRotationIdx(const Symbol &pose_symbol) const {
                               pose_symbol.string());
 }
 
+Index Problem::getRangePosition(Index k) const {
+  return getPosition(range_positions_, k);
+}
+
 Index Problem::getRangeIdx(const SymbolPair &range_symbol_pair) const {
   // all range measurements come after the rotations
   auto rot_offset = numPosesDim();
 
-  // search for the range symbol
-  auto range_search_it = std::find_if(
-      range_measurements_.begin(), range_measurements_.end(),
-      [&range_symbol_pair](const RangeMeasurement &rangeMeasurement) {
-        return rangeMeasurement.hasSymbolPair(range_symbol_pair);
-      });
+  // search for the range symbol (the index is agnostic to the ordering of the
+  // symbols in the pair)
+  auto range_search_it = range_measurement_idxs_.find(range_symbol_pair);
 
   // if we found the range symbol, return the index of the symbol in
   // range_measurements_ plus the offset
-  if (range_search_it != range_measurements_.end()) {
-    return std::distance(range_measurements_.begin(), range_search_it) +
-           rot_offset;
+  if (range_search_it != range_measurement_idxs_.end()) {
+    return getRangePosition(range_search_it->second) + rot_offset;
   }
 
   // if we get here, we didn't find the range symbol
@@ -1004,7 +1480,8 @@ Index Problem::getTranslationIdx(const Symbol &trans_symbol) const {
   // is a pose translation
   auto pose_search_it = pose_symbol_idxs_.find(trans_symbol);
   if (pose_search_it != pose_symbol_idxs_.end()) {
-    return static_cast<Index>(pose_search_it->second + idx_offset);
+    return static_cast<Index>(
+        getPosition(pose_positions_, pose_search_it->second) + idx_offset);
   }
 
   // is a landmark translation
@@ -1012,8 +1489,9 @@ Index Problem::getTranslationIdx(const Symbol &trans_symbol) const {
   if (landmark_search_it != landmark_symbol_idxs_.end()) {
     // need to offset by the number of poses because the landmark variables
     // come after the pose translations
-    return static_cast<Index>(landmark_search_it->second + idx_offset +
-                              numPoses());
+    return static_cast<Index>(
+        getPosition(landmark_positions_, landmark_search_it->second) +
+        idx_offset + numPoses());
   }
 
   // if we get here, we didn't find the translation symbol
@@ -1035,9 +1513,11 @@ CertResults Problem::certify_solution(const Matrix &Y, Scalar eta, size_t nx,
   /// Construct certificate matrix S
 
   // check the ratio of singular values of Y, if greater than 10^6, then
-  // lets also consider this certified
-  auto svd = Y.jacobiSvd(Eigen::ComputeThinU | Eigen::ComputeThinV);
-  auto sv = svd.singularValues();
+  // lets also consider this certified. Only the singular values are needed,
+  // which are computed from the (r x r) Gram matrix of Y
+  Vector sv;
+  Matrix V;
+  thinSvdFromGram(Y, sv, V);
   if (sv(0) / sv(Y.cols() - 1) > 1e6) {
     CertResults results;
     results.is_certified = true;
@@ -1048,30 +1528,37 @@ CertResults Problem::certify_solution(const Matrix &Y, Scalar eta, size_t nx,
     return results;
   }
 
-  LambdaBlocks Lambda_blocks;
-  SparseMatrix S;
-
   // We compute the certificate matrix corresponding to the *full* (i.e.
-  // translation-explicit) form of the problem
-  Lambda_blocks = compute_Lambda_blocks(Y);
-  S = data_matrix_ -
-      compute_Lambda_from_Lambda_blocks(Lambda_blocks, getDataMatrixSize());
+  // translation-explicit) form of the problem. It is only assembled when
+  // fast_verification() factorizes it; LOBPCG multiplies with it in operator
+  // form. The gradient Q*Y at the final iterate of the optimizer is usually
+  // still cached, so the multipliers take no additional product with Q
+  LambdaBlocks Lambda_blocks =
+      compute_Lambda_blocks(Y, cachedDataMatrixProduct(Y));
+  CertificateOperator S = get_certificate_operator(Lambda_blocks);
 
   /// Test positive-semidefiniteness of certificate matrix S using fast
   /// verification method
-  auto num_eigvecs =
-      std::min(std::max(Eigen::Index(nx), Y.cols() + 2), S.rows());
-  if (S.rows() < Y.cols()) {
+  auto num_eigvecs = std::min(std::max(Eigen::Index(nx), Y.cols() + 2), S.size);
+  if (S.size < Y.cols()) {
     throw std::invalid_argument(
         "The number of rows of S must be greater than or "
         "equal to the number of columns of Y");
   }
-  Matrix init_eigvec_guess = Matrix::Random(S.rows(), num_eigvecs);
-  init_eigvec_guess.block(0, 0, S.rows(), eigvec_bootstrap.cols()) =
+  Matrix init_eigvec_guess = Matrix::Random(S.size, num_eigvecs);
+  init_eigvec_guess.block(0, 0, S.size, eigvec_bootstrap.cols()) =
       eigvec_bootstrap;
 
-  CertResults results = fast_verification(
-      S, eta, init_eigvec_guess, max_LOBPCG_iters, max_fill_factor, drop_tol);
+  // the values of a factorization shared with a copy of this problem must not
+  // change under it
+  auto &factorization = certification_context_.factorization;
+  if (!factorization || factorization.use_count() > 1) {
+    factorization = std::make_shared<CertificateFactorization>();
+  }
+
+  CertResults results =
+      fast_verification(S, eta, init_eigvec_guess, max_LOBPCG_iters,
+                        max_fill_factor, drop_tol, factorization.get());
 
   while (std::isnan(results.theta)) {
     // this seems to happen when there is a clustering of eigenvalues around
@@ -1079,7 +1566,8 @@ CertResults Problem::certify_solution(const Matrix &Y, Scalar eta, size_t nx,
     std::cout << "NaN in theta -- result not certified" << std::endl;
     eta *= 2;
     results = fast_verification(S, eta, init_eigvec_guess, max_LOBPCG_iters,
-                                max_fill_factor, drop_tol);
+                                max_fill_factor, drop_tol,
+                                factorization.get());
   }
 
   if (!results.is_certified && (formulation_ == Formulation::Implicit)) {
@@ -1105,29 +1593,42 @@ CertResults Problem::certify_solution(const Matrix &Y, Scalar eta, size_t nx,
 Problem::LambdaBlocks Problem::compute_Lambda_blocks(const Matrix &Y) const {
   // Compute S * Y, where S is the data matrix defining the quadratic form
   // for the specific version of the SE-Sync problem we're solving
-  Matrix QY = dataMatrixProduct(Y);
-
-  // Preallocate storage for diagonal blocks of Lambda
-  Matrix stiefel_Lambda_blocks(dim_, numPosesDim());
+  return compute_Lambda_blocks(Y, dataMatrixProduct(Y));
+}
 
-  for (auto i = 0; i < numPoses(); ++i) {
-    Matrix P = QY.block(i * dim_, 0, dim_, Y.cols()) *
-               Y.block(i * dim_, 0, dim_, Y.cols()).transpose();
-    stiefel_Lambda_blocks.block(0, i * dim_, dim_, dim_) =
-        .5 * (P + P.transpose());
-  }
+Problem::LambdaBlocks Problem::compute_Lambda_blocks(const Matrix &Y,
+                                                     const Matrix &QY) const {
+  LambdaBlocks Lambda_blocks;
+  compute_Lambda_blocks(Y, QY, Lambda_blocks);
+  return Lambda_blocks;
+}
 
-  Vector oblique_Lambda_blocks(numRangeMeasurements());
+void Problem::compute_Lambda_blocks(const Matrix &Y, const Matrix &QY,
+                                    LambdaBlocks &Lambda_blocks) const {
+  // diagonal blocks of Lambda
+  Matrix &stiefel_Lambda_blocks = Lambda_blocks.first;
+  stiefel_Lambda_blocks.resize(dim_, numPosesDim());
+
+  dispatchOnDim(dim_, [&](auto dim_constant) {
+    constexpr int D = decltype(dim_constant)::value;
+    parallelFor(
+        0, numPoses(),
+        [&](Index i) {
+          DimMatrix<D> P = QY.middleRows<D>(i * dim_, dim_) *
+                           Y.middleRows<D>(i * dim_, dim_).transpose();
+          stiefel_Lambda_blocks.block<D, D>(0, i * dim_, dim_, dim_) =
+              .5 * (P + P.transpose());
+        },
+        getManifoldGrainSize());
+  });
+
+  // (r x 1) vector of inner products of the range rows of Y and QY
   auto rot_mat_sz = numPosesDim();
-  Vector oblique_inner_prods =
-      (Y.block(rot_mat_sz, 0, numRangeMeasurements(), Y.cols()).array() *
-       QY.block(rot_mat_sz, 0, numRangeMeasurements(),
-                Y.cols())
-           .array())
-          .rowwise()
-          .sum(); // (r x 1) vector of inner products
-
-  return std::make_pair(stiefel_Lambda_blocks, oblique_inner_prods);
+  int r = numRangeMeasurements();
+  Lambda_blocks.second = (Y.middleRows(rot_mat_sz, r).array() *
+                          QY.middleRows(rot_mat_sz, r).array())
+                             .rowwise()
+                             .sum();
 }
 
 SparseMatrix
@@ -1161,8 +1662,62 @@ Problem::compute_Lambda_from_Lambda_blocks(const LambdaBlocks &Lambda_blocks,
 
 SparseMatrix Problem::get_certificate_matrix(const Matrix &Y) const {
   LambdaBlocks Lambda_blocks = compute_Lambda_blocks(Y);
-  return data_matrix_ -
-         compute_Lambda_from_Lambda_blocks(Lambda_blocks, getDataMatrixSize());
+  SparseMatrix assembled;
+  return subtractSymmetric(
+      getAssembledDataMatrix(assembled),
+      compute_Lambda_from_Lambda_blocks(Lambda_blocks, getDataMatrixSize()),
+      data_matrix_storage_);
+}
+
+CertificateOperator
+Problem::get_certificate_operator(const LambdaBlocks &Lambda_blocks) const {
+  CertificateOperator S;
+  S.size = getDataMatrixSize();
+  S.storage = data_matrix_storage_;
+
+  S.multiply = [this, &Lambda_blocks](const Matrix &X, Matrix &SX) {
+    // the certificate matrix is that of the *full* (i.e. translation-explicit)
+    // form of the problem, which is what dataMatrixProduct() multiplies with
+    // in the explicit formulation
+    if (formulation_ == Formulation::Explicit) {
+      dataMatrixProduct(X, SX);
+    } else {
+      symmetricThinDenseProduct(data_matrix_, data_matrix_storage_, X, SX,
+                                workspace_.thin_product_rows,
+                                workspace_.thin_product_result_rows);
+    }
+
+    // subtract the products with the diagonal blocks of Lambda
+    const Matrix &stiefel_Lambda_blocks = Lambda_blocks.first;
+    dispatchOnDim(dim_, [&](auto dim_constant) {
+      constexpr int D = decltype(dim_constant)::value;
+      parallelFor(
+          0, numPoses(),
+          [&](Index i) {
+            SX.middleRows<D>(i * dim_, dim_).noalias() -=
+                stiefel_Lambda_blocks.block<D, D>(0, i * dim_, dim_, dim_) *
+                X.middleRows<D>(i * dim_, dim_);
+          },
+          getManifoldGrainSize());
+    });
+    auto rot_mat_sz = numPosesDim();
+    int r = numRangeMeasurements();
+    SX.middleRows(rot_mat_sz, r) -=
+        Lambda_blocks.second.asDiagonal() * X.middleRows(rot_mat_sz, r);
+  };
+
+  S.assembleRegularized = [this, &Lambda_blocks](Scalar eta) {
+    // Q - (Lambda - eta * I) takes a single copy of Q
+    SparseMatrix Lambda =
+        compute_Lambda_from_Lambda_blocks(Lambda_blocks, getDataMatrixSize());
+    SparseMatrix Id(Lambda.rows(), Lambda.cols());
+    Id.setIdentity();
+    Lambda -= eta * Id;
+    SparseMatrix assembled;
+    return subtractSymmetric(getAssembledDataMatrix(assembled), Lambda,
+                             data_matrix_storage_);
+  };
+  return S;
 }
 
 Matrix Problem::getTranslationExplicitSolution(const Matrix &Y) const {
@@ -1239,11 +1794,12 @@ Matrix Problem::alignEstimateToOrigin(const Matrix &Y) const {
 
   checkVariablesAreValid(Y);
 
-  // start by rotating everything such that the first dxd block is the identity
-  // of course, only do this if we have poses
+  // start by rotating everything such that the rotation of the first pose is
+  // the identity of course, only do this if we have poses
   Matrix Y_aligned = Y;
   if (numPoses() > 0) {
-    Matrix first_rot = Y.block(0, 0, dim_, dim_);
+    Matrix first_rot =
+        Y.block(getPosition(pose_positions_, 0) * dim_, 0, dim_, dim_);
     Y_aligned = Y * first_rot.transpose();
   }
 
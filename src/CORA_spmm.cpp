@@ -0,0 +1,353 @@
+#include <CORA/CORA_dim_dispatch.h>
+#include <CORA/CORA_parallel.h>
+#include <CORA/CORA_spmm.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace CORA {
+
+namespace {
+
+// the number of rows of A handled per chunk of the parallel loop
+constexpr Index kRowGrainSize = 2048;
+
+template <int Cols> using ThinRowVector = Eigen::Matrix<Scalar, 1, Cols>;
+
+// the range [row_begin, row_end) of the nonzeros of a row of A, which may be
+// uncompressed
+inline std::pair<Index, Index> getRowRange(const SparseMatrix &A, Index row) {
+  Index row_begin = A.outerIndexPtr()[row];
+  Index row_end = A.innerNonZeroPtr() ? row_begin + A.innerNonZeroPtr()[row]
+                                      : A.outerIndexPtr()[row + 1];
+  return {row_begin, row_end};
+}
+
+template <int Cols>
+void sparseThinDenseProductFixed(const SparseMatrix &A,
+                                 const RowMajorMatrix &X_rows, Matrix &AX) {
+  using RowVector = ThinRowVector<Cols>;
+  const auto *inner_idxs = A.innerIndexPtr();
+  const Scalar *values = A.valuePtr();
+  const Scalar *X_data = X_rows.data();
+
+  parallelForRange(
+      0, A.rows(),
+      [&](Index begin, Index end) {
+        for (Index row = begin; row < end; row++) {
+          auto [row_begin, row_end] = getRowRange(A, row);
+          RowVector acc = RowVector::Zero();
+          for (Index k = row_begin; k < row_end; k++) {
+            acc.noalias() +=
+                values[k] *
+                Eigen::Map<const RowVector>(X_data + inner_idxs[k] * Cols);
+          }
+          AX.row(row) = acc;
+        }
+      },
+      kRowGrainSize);
+}
+
+// the number of contiguous row blocks the upper-triangular product is split
+// into: one per thread, each of at least kRowGrainSize rows
+Index getNumUpperProductBlocks(Index num_rows) {
+  Index num_threads = internal::in_parallel_loop ? 1 : getNumThreads();
+  return std::max<Index>(1, std::min(num_threads, num_rows / kRowGrainSize));
+}
+
+// the first row of each block; block_start(num_blocks) is num_rows
+inline Index getUpperProductBlockStart(Index block, Index num_blocks,
+                                       Index num_rows) {
+  return block * num_rows / num_blocks;
+}
+
+// the number of rows of AX_rows: the product, followed by the partial sums of
+// each block for the rows below it
+Index getUpperProductAccumulatorRows(Index num_rows, Index num_blocks) {
+  Index accumulator_rows = num_rows;
+  for (Index block = 0; block < num_blocks; block++) {
+    accumulator_rows +=
+        num_rows - getUpperProductBlockStart(block + 1, num_blocks, num_rows);
+  }
+  return accumulator_rows;
+}
+
+// A holds the upper triangle of a symmetric matrix. Each stored nonzero a_ij
+// (i < j) contributes a_ij * x_j to row i and a_ij * x_i to row j, so both
+// halves are applied in a single pass over A. The rows are split into
+// contiguous blocks that run concurrently. The contributions of a block to its
+// own rows are accumulated in place, while those to the rows below the block
+// are scattered into the block's partial sums (stored below the product in
+// AX_rows), which are added to the product once every block is done.
+template <int Cols>
+void upperSymmetricThinDenseProductFixed(const SparseMatrix &A,
+                                         Index num_blocks,
+                                         const RowMajorMatrix &X_rows,
+                                         RowMajorMatrix &AX_rows) {
+  using RowVector = ThinRowVector<Cols>;
+  const Index num_rows = A.rows();
+  const auto *inner_idxs = A.innerIndexPtr();
+  const Scalar *values = A.valuePtr();
+  const Scalar *X_data = X_rows.data();
+  Scalar *AX_data = AX_rows.data();
+
+  // the row of AX_rows holding the partial sum of a block for the first row
+  // below it
+  auto get_partial_sums_start = [&](Index block) {
+    Index partial_sums_start = num_rows;
+    for (Index prev_block = 0; prev_block < block; prev_block++) {
+      partial_sums_start +=
+          num_rows -
+          getUpperProductBlockStart(prev_block + 1, num_blocks, num_rows);
+    }
+    return partial_sums_start;
+  };
+
+  parallelFor(0, num_blocks, [&](Index block) {
+    const Index block_begin =
+        getUpperProductBlockStart(block, num_blocks, num_rows);
+    const Index block_end =
+        getUpperProductBlockStart(block + 1, num_blocks, num_rows);
+    // row col >= block_end of the product is accumulated in row
+    // col + partial_sums_offset of AX_rows
+    const Index partial_sums_offset =
+        get_partial_sums_start(block) - block_end;
+    AX_rows.middleRows(block_begin, block_end - block_begin).setZero();
+    AX_rows
+        .middleRows(partial_sums_offset + block_end, num_rows - block_end)
+        .setZero();
+
+    for (Index row = block_begin; row < block_end; row++) {
+      auto [row_begin, row_end] = getRowRange(A, row);
+      Eigen::Map<const RowVector> x_row(X_data + row * Cols);
+      // the contributions of the rows above this one (in this block) are
+      // already in AX_rows
+      Eigen::Map<RowVector> ax_row(AX_data + row * Cols);
+      RowVector acc = ax_row;
+      for (Index k = row_begin; k < row_end; k++) {
+        Index col = inner_idxs[k];
+        acc.noalias() +=
+            values[k] * Eigen::Map<const RowVector>(X_data + col * Cols);
+        if (col != row) {
+          Index target = col < block_end ? col : col + partial_sums_offset;
+          Eigen::Map<RowVector>(AX_data + target * Cols).noalias() +=
+              values[k] * x_row;
+        }
+      }
+      ax_row = acc;
+    }
+  });
+
+  if (num_blocks == 1) {
+    return;
+  }
+  // add the partial sums of the blocks above each row
+  parallelForRange(
+      getUpperProductBlockStart(1, num_blocks, num_rows), num_rows,
+      [&](Index begin, Index end) {
+        for (Index block = 0; block + 1 < num_blocks; block++) {
+          const Index block_end =
+              getUpperProductBlockStart(block + 1, num_blocks, num_rows);
+          const Index partial_sums_offset =
+              get_partial_sums_start(block) - block_end;
+          for (Index row = std::max(begin, block_end); row < end; row++) {
+            Eigen::Map<RowVector>(AX_data + row * Cols).noalias() +=
+                Eigen::Map<const RowVector>(AX_data +
+                                            (row + partial_sums_offset) * Cols);
+          }
+        }
+      },
+      kRowGrainSize);
+}
+
+template <int D, int Cols>
+void addBlockSparseProductFixed(const BlockSparseMatrix &A,
+                                const ConstMatrixRef &X, MatrixRef AX) {
+  using BlockRows = Eigen::Matrix<Scalar, D, Cols>;
+  const Index d = A.blockSize();
+  const Index *block_row_starts = A.blockRowStarts();
+  const Index *block_col_idxs = A.blockColIdxs();
+  const Scalar *values = A.blockValues();
+
+  parallelForRange(
+      0, A.numBlockRows(),
+      [&](Index begin, Index end) {
+        for (Index block_row = begin; block_row < end; block_row++) {
+          BlockRows acc = BlockRows::Zero(d, X.cols());
+          for (Index k = block_row_starts[block_row];
+               k < block_row_starts[block_row + 1]; k++) {
+            Eigen::Map<const DimMatrix<D>> block(values + k * d * d, d, d);
+            acc.noalias() +=
+                block * X.middleRows<D>(block_col_idxs[k] * d, d);
+          }
+          AX.middleRows<D>(block_row * d, d) += acc;
+        }
+      },
+      std::max<Index>(1, kRowGrainSize / d));
+}
+
+} // namespace
+
+void sparseThinDenseProduct(const SparseMatrix &A, const Matrix &X, Matrix &AX,
+                            RowMajorMatrix &X_rows) {
+  checkMatrixShape("sparseThinDenseProduct::X", A.cols(), X.cols(), X.rows(),
+                   X.cols());
+  if (X.cols() < 1 || X.cols() > kMaxThinProductCols) {
+    AX.noalias() = A * X;
+    return;
+  }
+
+  X_rows = X;
+  AX.resize(A.rows(), X.cols());
+  dispatchOnThinCols(X.cols(), [&](auto cols_constant) {
+    constexpr int Cols = decltype(cols_constant)::value;
+    sparseThinDenseProductFixed<Cols>(A, X_rows, AX);
+  });
+}
+
+void sparseThinDenseProduct(const SparseMatrix &A, const Matrix &X,
+                            Matrix &AX) {
+  RowMajorMatrix X_rows;
+  sparseThinDenseProduct(A, X, AX, X_rows);
+}
+
+void symmetricThinDenseProduct(const SparseMatrix &A, MatrixStorage storage,
+                               const Matrix &X, Matrix &AX,
+                               RowMajorMatrix &X_rows,
+                               RowMajorMatrix &AX_rows) {
+  if (storage == MatrixStorage::Full) {
+    sparseThinDenseProduct(A, X, AX, X_rows);
+    return;
+  }
+
+  checkMatrixShape("symmetricThinDenseProduct::X", A.cols(), X.cols(),
+                   X.rows(), X.cols());
+  if (X.cols() < 1 || X.cols() > kMaxThinProductCols) {
+    AX.noalias() = A.selfadjointView<Eigen::Upper>() * X;
+    return;
+  }
+
+  X_rows = X;
+  Index num_blocks = getNumUpperProductBlocks(A.rows());
+  AX_rows.resize(getUpperProductAccumulatorRows(A.rows(), num_blocks),
+                 X.cols());
+  dispatchOnThinCols(X.cols(), [&](auto cols_constant) {
+    constexpr int Cols = decltype(cols_constant)::value;
+    upperSymmetricThinDenseProductFixed<Cols>(A, num_blocks, X_rows, AX_rows);
+  });
+  AX = AX_rows.topRows(A.rows());
+}
+
+void symmetricThinDenseProduct(const SparseMatrix &A, MatrixStorage storage,
+                               const Matrix &X, Matrix &AX) {
+  RowMajorMatrix X_rows, AX_rows;
+  symmetricThinDenseProduct(A, storage, X, AX, X_rows, AX_rows);
+}
+
+SparseMatrix getFullSymmetricMatrix(const SparseMatrix &A,
+                                    MatrixStorage storage) {
+  if (storage == MatrixStorage::Full) {
+    return A;
+  }
+  return A.selfadjointView<Eigen::Upper>();
+}
+
+BlockSparseMatrix::BlockSparseMatrix(const SparseMatrix &A, Index block_size)
+    : block_size_(block_size), block_rows_(A.rows() / block_size),
+      block_cols_(A.cols() / block_size) {
+  if (block_size < 1 || A.rows() % block_size != 0 ||
+      A.cols() % block_size != 0) {
+    throw std::invalid_argument(
+        "The dimensions of a block sparse matrix must be multiples of the "
+        "block size. Block size: " +
+        std::to_string(block_size) + ", rows: " + std::to_string(A.rows()) +
+        ", cols: " + std::to_string(A.cols()));
+  }
+
+  // the index of each block column's block in the current block row, or -1
+  std::vector<Index> block_slots(block_cols_, -1);
+  const Index block_numel = block_size * block_size;
+  block_row_starts_.reserve(block_rows_ + 1);
+  for (Index block_row = 0; block_row < block_rows_; block_row++) {
+    Index row_start = block_row_starts_.back();
+    for (Index row = block_row * block_size;
+         row < (block_row + 1) * block_size; row++) {
+      for (SparseMatrix::InnerIterator it(A, row); it; ++it) {
+        Index block_col = it.col() / block_size;
+        if (block_slots[block_col] < 0) {
+          block_slots[block_col] = 0;
+          block_col_idxs_.push_back(block_col);
+        }
+      }
+    }
+
+    // sort the blocks of this block row by column and scatter their values
+    std::sort(block_col_idxs_.begin() + row_start, block_col_idxs_.end());
+    Index row_end = static_cast<Index>(block_col_idxs_.size());
+    values_.resize(row_end * block_numel, 0);
+    for (Index k = row_start; k < row_end; k++) {
+      block_slots[block_col_idxs_[k]] = k;
+    }
+    for (Index row = block_row * block_size;
+         row < (block_row + 1) * block_size; row++) {
+      for (SparseMatrix::InnerIterator it(A, row); it; ++it) {
+        Index k = block_slots[it.col() / block_size];
+        values_[k * block_numel + (it.col() % block_size) * block_size +
+                row % block_size] += it.value();
+      }
+    }
+    for (Index k = row_start; k < row_end; k++) {
+      block_slots[block_col_idxs_[k]] = -1;
+    }
+    block_row_starts_.push_back(row_end);
+  }
+}
+
+SparseMatrix BlockSparseMatrix::toSparse() const {
+  std::vector<Eigen::Triplet<Scalar>> triplets;
+  triplets.reserve(values_.size());
+  for (Index block_row = 0; block_row < block_rows_; block_row++) {
+    for (Index k = block_row_starts_[block_row];
+         k < block_row_starts_[block_row + 1]; k++) {
+      for (Index c = 0; c < block_size_; c++) {
+        for (Index r = 0; r < block_size_; r++) {
+          triplets.emplace_back(
+              block_row * block_size_ + r, block_col_idxs_[k] * block_size_ + c,
+              values_[(k * block_size_ + c) * block_size_ + r]);
+        }
+      }
+    }
+  }
+  SparseMatrix A(rows(), cols());
+  A.setFromTriplets(triplets.begin(), triplets.end());
+  return A;
+}
+
+size_t BlockSparseMatrix::memoryUsage() const {
+  return (block_row_starts_.capacity() + block_col_idxs_.capacity()) *
+             sizeof(Index) +
+         values_.capacity() * sizeof(Scalar);
+}
+
+void addBlockSparseProduct(const BlockSparseMatrix &A, const ConstMatrixRef &X,
+                           MatrixRef AX) {
+  checkMatrixShape("addBlockSparseProduct::X", A.cols(), X.cols(), X.rows(),
+                   X.cols());
+  checkMatrixShape("addBlockSparseProduct::AX", A.rows(), X.cols(), AX.rows(),
+                   AX.cols());
+  dispatchOnDim(A.blockSize(), [&](auto dim_constant) {
+    constexpr int D = decltype(dim_constant)::value;
+    if (X.cols() >= 1 && X.cols() <= kMaxThinProductCols) {
+      dispatchOnThinCols(X.cols(), [&](auto cols_constant) {
+        constexpr int Cols = decltype(cols_constant)::value;
+        addBlockSparseProductFixed<D, Cols>(A, X, AX);
+      });
+    } else {
+      addBlockSparseProductFixed<D, Eigen::Dynamic>(A, X, AX);
+    }
+  });
+}
+
+} // namespace CORA
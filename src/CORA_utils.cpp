@@ -1,8 +1,12 @@
 #include <CORA/CORA_utils.h>
 
+#include <CORA/CORA_polar.h>
+#include <CORA/CORA_spmm.h>
+
 #include <Eigen/CholmodSupport>
 #include <Eigen/Geometry>
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 
@@ -14,26 +18,55 @@ namespace CORA {
 using SymmetricLinOp =
     Optimization::LinearAlgebra::SymmetricLinearOperator<Matrix>;
 
+CertificateOperator getCertificateOperator(const SparseMatrix &S,
+                                           MatrixStorage storage) {
+  CertificateOperator S_op;
+  S_op.size = S.rows();
+  S_op.storage = storage;
+  S_op.multiply = [&S, storage](const Matrix &X, Matrix &SX) {
+    symmetricThinDenseProduct(S, storage, X, SX);
+  };
+  S_op.assembleRegularized = [&S](Scalar eta) -> SparseMatrix {
+    SparseMatrix Id(S.rows(), S.cols());
+    Id.setIdentity();
+    return S + eta * Id;
+  };
+  return S_op;
+}
+
 CertResults fast_verification(const SparseMatrix &S, Scalar eta,
                               const Matrix &X0, size_t max_iters,
-                              Scalar max_fill_factor, Scalar drop_tol) {
+                              Scalar max_fill_factor, Scalar drop_tol,
+                              MatrixStorage storage,
+                              CertificateFactorization *factorization) {
+  return fast_verification(getCertificateOperator(S, storage), eta, X0,
+                           max_iters, max_fill_factor, drop_tol,
+                           factorization);
+}
+
+CertResults fast_verification(const CertificateOperator &S, Scalar eta,
+                              const Matrix &X0, size_t max_iters,
+                              Scalar max_fill_factor, Scalar drop_tol,
+                              CertificateFactorization *factorization) {
   // Don't forget to set this on input!
   size_t num_iters = 0;
   Scalar theta = 0;
 
   Matrix X; // Matrix to hold eigenvector estimates for S
 
-  unsigned int n = S.rows();
+  unsigned int n = S.size;
+  const MatrixStorage storage = S.storage;
 
   /// STEP 1:  Test positive-semidefiniteness of regularized certificate matrix
   /// M := S + eta * Id via direct factorization
 
-  SparseMatrix Id(n, n);
-  Id.setIdentity();
-  SparseMatrix M = S + eta * Id;
+  SparseMatrix M = S.assembleRegularized(eta);
 
-  /// Test positive-semidefiniteness via direct Cholesky factorization
-  Eigen::CholmodSupernodalLLT<SparseMatrix> MChol;
+  /// Test positive-semidefiniteness via direct Cholesky factorization. Only
+  /// the upper triangle of M is read, so it may be stored either way
+  CertificateFactorization local_factorization;
+  CertificateFactorization &MChol =
+      factorization ? *factorization : local_factorization;
 
   /// Set various options for the factorization
 
@@ -44,8 +77,10 @@ CertResults fast_verification(const SparseMatrix &S, Scalar eta,
   // printed error output
   MChol.cholmod().print = 0;
 
-  // Calculate Cholesky decomposition!
-  MChol.compute(M);
+  // Calculate Cholesky decomposition! The symbolic analysis only depends on
+  // the sparsity pattern of M, so it is skipped if MChol already has one for
+  // this pattern
+  MChol.refactorize(M);
 
   // Test whether the Cholesky decomposition succeeded
   bool PSD = (MChol.info() == Eigen::Success);
@@ -61,7 +96,9 @@ CertResults fast_verification(const SparseMatrix &S, Scalar eta,
     // if the matrix is sufficiently small (i.e. n <= 100), then we can
     // directly compute the minimum eigenpair
     if (n <= 100) {
-      Eigen::SelfAdjointEigenSolver<Matrix> eigensolver(S);
+      Matrix S_dense = getFullSymmetricMatrix(M, storage);
+      S_dense.diagonal().array() -= eta;
+      Eigen::SelfAdjointEigenSolver<Matrix> eigensolver(S_dense);
       theta = eigensolver.eigenvalues()(0);
       num_iters = 0;
       CertResults results;
@@ -76,11 +113,26 @@ CertResults fast_verification(const SparseMatrix &S, Scalar eta,
     Vector Theta; // Vector to hold Ritz values of S
     size_t num_converged;
 
+    // LOBPCG only multiplies with M, so the assembled matrix is released
+    M = SparseMatrix();
+
     /// Set up matrix-vector multiplication operator with regularized
     /// certificate matrix M
 
     // Matrix-vector multiplication with regularized certificate matrix M
-    SymmetricLinOp Mop = [&M](const Matrix &X) -> Matrix { return M * X; };
+    SymmetricLinOp Mop = [&S, eta](const Matrix &X) -> Matrix {
+      Matrix MX;
+      S.multiply(X, MX);
+      MX += eta * X;
+      return MX;
+    };
+
+    // the curvature x' * S * x of S along x
+    auto curvature = [&S](const Vector &x) -> Scalar {
+      Matrix Sx;
+      S.multiply(x, Sx);
+      return x.dot(Sx.col(0));
+    };
 
     // Custom stopping criterion: terminate as soon as a direction of
     // sufficiently negative curvature is found:
@@ -88,13 +140,13 @@ CertResults fast_verification(const SparseMatrix &S, Scalar eta,
     // x'* S * x < - eta / 2
     //
     Optimization::LinearAlgebra::LOBPCGUserFunction<Vector, Matrix> stopfun =
-        [&S, eta](size_t i, const SymmetricLinOp &M,
+        [&curvature, eta](size_t i, const SymmetricLinOp &M,
                   const std::optional<SymmetricLinOp> &B,
                   const std::optional<SymmetricLinOp> &T, size_t nev,
                   const Vector &Theta, const Matrix &X, const Vector &r,
                   size_t nc) {
           // Calculate curvature along estimated minimum eigenvector
-          Scalar theta = X.col(0).dot(S * X.col(0));
+          Scalar theta = curvature(X.col(0));
           return (theta < -eta / 2);
         };
 
@@ -122,7 +174,7 @@ CertResults fast_verification(const SparseMatrix &S, Scalar eta,
     x = X.col(0);
 
     // Calculate curvature along x
-    theta = x.dot(S * x);
+    theta = curvature(x);
 
     if (theta >= -eta / 2) {
       /// STEP 3:  RUN PRECONDITIONED LOBPCG
@@ -141,14 +193,20 @@ CertResults fast_verification(const SparseMatrix &S, Scalar eta,
       ildl_opts.max_fill_factor = max_fill_factor;
       ildl_opts.drop_tol = drop_tol;
 
-      Preconditioners::ILDL Mfact(M, ildl_opts);
+      // the ILDL factorization is given both triangles of M
+      Preconditioners::ILDL Mfact(
+          getFullSymmetricMatrix(S.assembleRegularized(eta), storage),
+          ildl_opts);
 
       SymmetricLinOp T = [&Mfact](const Matrix &X) -> Matrix {
         // Preallocate output matrix TX
         Matrix TX(X.rows(), X.cols());
 
         for (unsigned int i = 0; i < X.cols(); ++i) {
-          // Calculate TX by preconditioning the columns of X one-by-one
+          // Calculate TX by preconditioning the columns of X one-by-one (the
+          // Preconditioners library does not document ILDL::solve() as
+          // reentrant; see the Parallel Certification section of
+          // design_decisions.md)
           TX.col(i) = Mfact.solve(X.col(i), true);
         }
 
@@ -170,7 +228,7 @@ CertResults fast_verification(const SparseMatrix &S, Scalar eta,
       x = X.col(0);
 
       // Calculate curvature along x
-      theta = x.dot(S * x);
+      theta = curvature(x);
 
       num_iters += static_cast<size_t>(unprecon_iter_frac * num_iters);
     } // if (!(theta < -eta / 2))
@@ -186,6 +244,31 @@ CertResults fast_verification(const SparseMatrix &S, Scalar eta,
 }
 
 Matrix projectToSOd(const Matrix &M) {
+  // For d = 2, 3 use the closed-form polar projection, reversing the smallest
+  // singular direction if M is a reflection
+  Matrix R;
+  bool projected =
+      M.rows() == M.cols() && dispatchOnDim(M.rows(), [&](auto dim_constant) {
+        constexpr int D = decltype(dim_constant)::value;
+        if constexpr (D != Eigen::Dynamic) {
+          DimMatrix<D> M_d = M;
+          DimMatrix<D> W;
+          bool needs_refinement;
+          if (inverseSqrtGram<D>(M_d.transpose() * M_d, W,
+                                 M_d.determinant() < 0, &needs_refinement)) {
+            R = M_d * W;
+            if (needs_refinement) {
+              R = R * newtonSchulzCorrection<D, Scalar>(R.transpose() * R);
+            }
+            return true;
+          }
+        }
+        return false;
+      });
+  if (projected) {
+    return R;
+  }
+
   // Compute the SVD of M
   Eigen::JacobiSVD<Matrix> svd(M, Eigen::ComputeFullU | Eigen::ComputeFullV);
 
@@ -201,6 +284,18 @@ Matrix projectToSOd(const Matrix &M) {
   }
 }
 
+void thinSvdFromGram(const Matrix &Y, Vector &singular_values, Matrix &V) {
+  Matrix G(Y.cols(), Y.cols());
+  G.setZero();
+  G.selfadjointView<Eigen::Lower>().rankUpdate(Y.transpose());
+  Eigen::SelfAdjointEigenSolver<Matrix> eig(G);
+
+  // the eigenvalues are in increasing order, and may be (slightly) negative
+  // if Y is rank-deficient
+  singular_values = eig.eigenvalues().reverse().cwiseMax(0).cwiseSqrt();
+  V = eig.eigenvectors().rowwise().reverse();
+}
+
 Matrix getTranslation(const Symbol &sym, const Problem &problem,
                       const Matrix &soln) {
   checkMatrixShape("getTranslation", problem.getDataMatrixSize(), problem.dim(),
@@ -349,4 +444,93 @@ void saveSolnToTum(const std::vector<Symbol> pose_symbols,
   // std::cout << "Saved robot poses to " << fpath << std::endl;
 }
 
+namespace {
+
+using Adjacency = std::vector<std::vector<Index>>;
+
+// visits the connected component of start breadth-first, setting the distance
+// of each of its vertices from start in levels (which must be -1 for all of
+// them). Returns the vertices in the order they were visited
+std::vector<Index> breadthFirstSearch(const Adjacency &adjacency, Index start,
+                                      std::vector<Index> &levels) {
+  std::vector<Index> visited = {start};
+  levels[start] = 0;
+  for (size_t head = 0; head < visited.size(); head++) {
+    Index vertex = visited[head];
+    for (Index neighbor : adjacency[vertex]) {
+      if (levels[neighbor] < 0) {
+        levels[neighbor] = levels[vertex] + 1;
+        visited.push_back(neighbor);
+      }
+    }
+  }
+  return visited;
+}
+
+// George and Liu's heuristic: repeatedly restart the search from a vertex of
+// minimum degree in the last level, until the depth stops increasing
+Index findPseudoPeripheralVertex(const Adjacency &adjacency, Index start,
+                                 std::vector<Index> &levels) {
+  Index eccentricity = -1;
+  while (true) {
+    std::vector<Index> visited = breadthFirstSearch(adjacency, start, levels);
+    Index depth = levels[visited.back()];
+    Index next = visited.back();
+    for (auto it = visited.rbegin(); it != visited.rend() && levels[*it] == depth;
+         ++it) {
+      if (adjacency[*it].size() < adjacency[next].size()) {
+        next = *it;
+      }
+    }
+    for (Index vertex : visited) {
+      levels[vertex] = -1;
+    }
+    if (depth <= eccentricity) {
+      return start;
+    }
+    eccentricity = depth;
+    start = next;
+  }
+}
+
+} // namespace
+
+std::vector<Index>
+reverseCuthillMcKee(const std::vector<std::vector<Index>> &adjacency) {
+  const Index num_vertices = static_cast<Index>(adjacency.size());
+  std::vector<Index> levels(num_vertices, -1);
+  std::vector<char> placed(num_vertices, false);
+  std::vector<Index> order;
+  order.reserve(num_vertices);
+  std::vector<Index> neighbors;
+  auto by_degree = [&adjacency](Index a, Index b) {
+    return adjacency[a].size() < adjacency[b].size();
+  };
+
+  for (Index vertex = 0; vertex < num_vertices; vertex++) {
+    if (placed[vertex]) {
+      continue;
+    }
+    // Cuthill-McKee: visit the component breadth-first, adding the unplaced
+    // neighbors of each vertex in order of increasing degree
+    Index start = findPseudoPeripheralVertex(adjacency, vertex, levels);
+    placed[start] = true;
+    order.push_back(start);
+    for (size_t head = order.size() - 1; head < order.size(); head++) {
+      neighbors.clear();
+      for (Index neighbor : adjacency[order[head]]) {
+        if (!placed[neighbor]) {
+          placed[neighbor] = true;
+          neighbors.push_back(neighbor);
+        }
+      }
+      std::stable_sort(neighbors.begin(), neighbors.end(), by_degree);
+      order.insert(order.end(), neighbors.begin(), neighbors.end());
+    }
+  }
+
+  std::reverse(order.begin(), order.end());
+  return order;
+}
+
 } // namespace CORA
@@ -1,39 +1,110 @@
 #include <CORA/CORA_types.h>
+#include <CORA/CORA_parallel.h>
 #include <CORA/ObliqueManifold.h>
 
 namespace CORA {
 
-Matrix ObliqueManifold::projectToManifold(const Matrix &A) const {
+template <typename ScalarType>
+typename ObliqueManifoldT<ScalarType>::MatrixType
+ObliqueManifoldT<ScalarType>::projectToManifold(const MatrixType &A) const {
   // check that the dimensions of A are as expected
   checkMatrixShape("ObliqueManifold::projectToManifold", r_, n_, A.rows(),
                    A.cols());
 
-  // in parallel, normalize each column of A to have unit norm
-  Matrix A_normalized = A.colwise().normalized();
+  // normalize each column of A to have unit norm, in parallel over chunks of
+  // columns
+  MatrixType A_normalized(A.rows(), A.cols());
+  parallelForRange(
+      0, A.cols(),
+      [&](Index begin, Index end) {
+        A_normalized.middleCols(begin, end - begin) =
+            A.middleCols(begin, end - begin).colwise().normalized();
+      },
+      getManifoldGrainSize());
   return A_normalized;
 }
 
-Matrix ObliqueManifold::projectToTangentSpace(const Matrix &Y,
-                                              const Matrix &V) const {
-  // get the inner product by taking the row-wise summation of the Hadamard
-  // product of Y and A
-  Vector inner_prods = (Y.array() * V.array()).colwise().sum();
+template <typename ScalarType>
+typename ObliqueManifoldT<ScalarType>::MatrixType
+ObliqueManifoldT<ScalarType>::projectToTangentSpace(const MatrixType &Y,
+                                                    const MatrixType &V) const {
+  // the columns are independent, so chunks of columns are projected in
+  // parallel
+  MatrixType V_tangent(V.rows(), V.cols());
+  parallelForRange(
+      0, V.cols(),
+      [&](Index begin, Index end) {
+        auto Y_chunk = Y.middleCols(begin, end - begin);
+        auto V_chunk = V.middleCols(begin, end - begin);
 
-  // we now want to scale each column of Y by the corresponding inner product
-  // and subtract the result from A
-  Matrix scaled_cols = Y.array().rowwise() * inner_prods.transpose().array();
+        // get the inner product by taking the column-wise summation of the
+        // Hadamard product of Y and V
+        Eigen::Array<ScalarType, 1, Eigen::Dynamic> inner_prods =
+            (Y_chunk.array() * V_chunk.array()).colwise().sum();
 
-  return V - scaled_cols;
+        // we now want to scale each column of Y by the corresponding inner
+        // product and subtract the result from V
+        V_tangent.middleCols(begin, end - begin) =
+            V_chunk.array() - Y_chunk.array().rowwise() * inner_prods;
+      },
+      getManifoldGrainSize());
+  return V_tangent;
 }
 
-Matrix ObliqueManifold::random_sample(
+template <typename ScalarType>
+void ObliqueManifoldT<ScalarType>::projectTransposedToManifold(
+    const ConstMatrixRefType &A_T, MatrixRefType P_T) const {
+  checkMatrixShape("ObliqueManifold::projectTransposedToManifold::A_T", n_, r_,
+                   A_T.rows(), A_T.cols());
+  checkMatrixShape("ObliqueManifold::projectTransposedToManifold::P_T", n_, r_,
+                   P_T.rows(), P_T.cols());
+
+  // normalize each row of A_T to have unit norm (leaving zero rows as they
+  // are, as normalized() does)
+  parallelFor(
+      0, A_T.rows(),
+      [&](Index i) {
+        ScalarType norm = A_T.row(i).norm();
+        if (norm > 0) {
+          P_T.row(i) = A_T.row(i) / norm;
+        } else {
+          P_T.row(i) = A_T.row(i);
+        }
+      },
+      getManifoldGrainSize());
+}
+
+template <typename ScalarType>
+void ObliqueManifoldT<ScalarType>::projectTransposedToTangentSpace(
+    const ConstMatrixRefType &Y_T, const ConstMatrixRefType &V_T,
+    MatrixRefType R_T) const {
+  checkMatrixShape("ObliqueManifold::projectTransposedToTangentSpace::Y_T", n_,
+                   r_, Y_T.rows(), Y_T.cols());
+  checkMatrixShape("ObliqueManifold::projectTransposedToTangentSpace::V_T", n_,
+                   r_, V_T.rows(), V_T.cols());
+  checkMatrixShape("ObliqueManifold::projectTransposedToTangentSpace::R_T", n_,
+                   r_, R_T.rows(), R_T.cols());
+
+  // subtract from each row of V_T its component along the row of Y_T
+  parallelFor(
+      0, V_T.rows(),
+      [&](Index i) {
+        ScalarType inner_prod = Y_T.row(i).dot(V_T.row(i));
+        R_T.row(i) = V_T.row(i) - inner_prod * Y_T.row(i);
+      },
+      getManifoldGrainSize());
+}
+
+template <typename ScalarType>
+typename ObliqueManifoldT<ScalarType>::MatrixType
+ObliqueManifoldT<ScalarType>::random_sample(
     const std::default_random_engine::result_type &seed) const {
   // initialize the random number generator
   std::default_random_engine generator(seed);
 
   // sample each column of the matrix from the standard normal distribution
-  std::normal_distribution<Scalar> g;
-  Matrix A(r_, n_);
+  std::normal_distribution<ScalarType> g;
+  MatrixType A(r_, n_);
   for (auto j = 0; j < A.cols(); j++) {
     for (auto i = 0; i < A.rows(); i++) {
       A(i, j) = g(generator);
@@ -42,4 +113,9 @@ Matrix ObliqueManifold::random_sample(
   return projectToManifold(A);
 }
 
+template class ObliqueManifoldT<double>;
+#ifdef CORA_FLOAT_MANIFOLDS
+template class ObliqueManifoldT<float>;
+#endif
+
 } // namespace CORA
@@ -2,16 +2,21 @@
 #include <Eigen/QR>
 #include <Eigen/SVD>
 
+#include "CORA/CORA_dim_dispatch.h"
+#include "CORA/CORA_parallel.h"
+#include "CORA/CORA_polar.h"
 #include "CORA/StiefelProduct.h"
 namespace CORA {
 
-Matrix StiefelProduct::projectToManifold(const Matrix &A) const {
+template <typename ScalarType>
+typename StiefelProductT<ScalarType>::MatrixType
+StiefelProductT<ScalarType>::projectToManifold(const MatrixType &A) const {
   // We use a generalization of the well-known SVD-based projection for the
   // orthogonal and special orthogonal groups; see for example Proposition 7
   // in the paper "Projection-Like Retractions on Matrix
   // Manifolds" by Absil and Malick.
 
-  Matrix P(p_, k_ * n_);
+  MatrixType P(p_, k_ * n_);
 
   // check that A is the correct size
   if (A.rows() != p_ || A.cols() != k_ * n_) {
@@ -23,48 +28,227 @@ Matrix StiefelProduct::projectToManifold(const Matrix &A) const {
                              std::to_string(k_ * n_));
   }
 
-  for (auto i = 0; i < n_; ++i) {
-    auto start_col = static_cast<Index>(i * k_);
-    // Compute the (thin) SVD of the ith block of A
-    Eigen::JacobiSVD<Matrix> SVD(A.block(0, start_col, p_, k_),
-                                 Eigen::ComputeThinU | Eigen::ComputeThinV);
+  dispatchOnDim(k_, [&](auto dim_constant) {
+    constexpr int K = decltype(dim_constant)::value;
+    // the blocks are independent, so they are projected concurrently
+    parallelFor(
+        0, n_,
+        [&](Index i) {
+          auto start_col = static_cast<Index>(i * k_);
+          auto A_i = A.template middleCols<K>(start_col, k_);
+          auto P_i = P.template middleCols<K>(start_col, k_);
 
-    // Set the ith block of P to the SVD-based projection of the ith block of A
-    P.block(0, start_col, p_, k_) = SVD.matrixU() * SVD.matrixV().transpose();
-  }
+          // For k = 2, 3 the projection A_i (A_i^T A_i)^{-1/2} is computed in
+          // closed form from the k x k Gram matrix of the block. If the block
+          // is not well-conditioned, a Newton-Schulz step restores the
+          // orthonormality of the columns of the result
+          if constexpr (K != Eigen::Dynamic) {
+            DimMatrix<K, ScalarType> W;
+            bool needs_refinement;
+            if (inverseSqrtGram<K>(A_i.transpose() * A_i, W, false,
+                                   &needs_refinement)) {
+              P_i.noalias() = A_i * W;
+              if (needs_refinement) {
+                DimMatrix<K, ScalarType> C =
+                    newtonSchulzCorrection<K, ScalarType>(P_i.transpose() *
+                                                          P_i);
+                P_i = P_i * C;
+              }
+              return;
+            }
+          }
+
+          // Otherwise (or if the block is nearly rank-deficient) compute the
+          // (thin) SVD of the transpose of the block, which has a fixed
+          // number of rows: A_i^T = U S V^T, so that the projection of A_i is
+          // V U^T
+          Eigen::JacobiSVD<DimRowsMatrix<K, ScalarType>> SVD(
+              A_i.transpose(), Eigen::ComputeThinU | Eigen::ComputeThinV);
+          P_i.noalias() = SVD.matrixV() * SVD.matrixU().transpose();
+        },
+        getManifoldGrainSize());
+  });
   return P;
 }
 
-Matrix StiefelProduct::SymBlockDiagProduct(const Matrix &A, const Matrix &BT,
-                                           const Matrix &C) const {
+template <typename ScalarType>
+typename StiefelProductT<ScalarType>::MatrixType
+StiefelProductT<ScalarType>::SymBlockDiagProduct(const MatrixType &A,
+                                                 const MatrixType &BT,
+                                                 const MatrixType &C) const {
   // Preallocate result matrix
-  Matrix R(p_, k_ * n_);
-  Matrix P(k_, k_);
-  Matrix S(k_, k_);
-
-  for (auto i = 0; i < n_; ++i) {
-    auto start_col = static_cast<Index>(i * k_);
-    // Compute block product Bi' * Ci
-    P = BT.block(start_col, 0, k_, p_) * C.block(0, start_col, p_, k_);
-    // Symmetrize this block
-    S = .5 * (P + P.transpose());
-    // Compute Ai * S and set corresponding block of R
-    R.block(0, start_col, p_, k_) = A.block(0, start_col, p_, k_) * S;
-  }
+  MatrixType R(p_, k_ * n_);
+
+  dispatchOnDim(k_, [&](auto dim_constant) {
+    constexpr int K = decltype(dim_constant)::value;
+    parallelFor(
+        0, n_,
+        [&](Index i) {
+          auto start_col = static_cast<Index>(i * k_);
+          // Compute block product Bi' * Ci
+          DimMatrix<K, ScalarType> P =
+              BT.template middleRows<K>(start_col, k_) *
+              C.template middleCols<K>(start_col, k_);
+          // Symmetrize this block
+          DimMatrix<K, ScalarType> S = ScalarType(0.5) * (P + P.transpose());
+          // Compute Ai * S and set corresponding block of R
+          R.template middleCols<K>(start_col, k_).noalias() =
+              A.template middleCols<K>(start_col, k_) * S;
+        },
+        getManifoldGrainSize());
+  });
   return R;
 }
 
-Matrix StiefelProduct::random_sample(
+template <typename ScalarType>
+typename StiefelProductT<ScalarType>::MatrixType
+StiefelProductT<ScalarType>::BlockDiagProduct(const MatrixType &A,
+                                              const MatrixType &S) const {
+  MatrixType R(p_, k_ * n_);
+  dispatchOnDim(k_, [&](auto dim_constant) {
+    constexpr int K = decltype(dim_constant)::value;
+    parallelFor(
+        0, n_,
+        [&](Index i) {
+          auto start_col = static_cast<Index>(i * k_);
+          R.template middleCols<K>(start_col, k_).noalias() =
+              A.template middleCols<K>(start_col, k_) *
+              S.template block<K, K>(0, start_col, k_, k_);
+        },
+        getManifoldGrainSize());
+  });
+  return R;
+}
+
+template <typename ScalarType>
+void StiefelProductT<ScalarType>::projectTransposedToManifold(
+    const ConstMatrixRefType &A_T, MatrixRefType P_T) const {
+  checkMatrixShape("StiefelProduct::projectTransposedToManifold::A_T", k_ * n_,
+                   p_, A_T.rows(), A_T.cols());
+  checkMatrixShape("StiefelProduct::projectTransposedToManifold::P_T", k_ * n_,
+                   p_, P_T.rows(), P_T.cols());
+
+  dispatchOnDim(k_, [&](auto dim_constant) {
+    constexpr int K = decltype(dim_constant)::value;
+    parallelFor(
+        0, n_,
+        [&](Index i) {
+          auto start_row = static_cast<Index>(i * k_);
+          auto A_i = A_T.template middleRows<K>(start_row, k_);
+          auto P_i = P_T.template middleRows<K>(start_row, k_);
+
+          // The projection of the frame A_i^T is A_i^T W with
+          // W = (A_i A_i^T)^{-1/2}, so its transpose is W A_i, refined if
+          // needed by the (transposed) Newton-Schulz step C P_i. These are
+          // computed one column at a time so that P_T may alias A_T
+          if constexpr (K != Eigen::Dynamic) {
+            DimMatrix<K, ScalarType> W;
+            bool needs_refinement;
+            if (inverseSqrtGram<K>(A_i * A_i.transpose(), W, false,
+                                   &needs_refinement)) {
+              for (Index col = 0; col < A_i.cols(); col++) {
+                Eigen::Matrix<ScalarType, K, 1> P_i_col = W * A_i.col(col);
+                P_i.col(col) = P_i_col;
+              }
+              if (needs_refinement) {
+                DimMatrix<K, ScalarType> C =
+                    newtonSchulzCorrection<K, ScalarType>(P_i *
+                                                          P_i.transpose());
+                for (Index col = 0; col < P_i.cols(); col++) {
+                  Eigen::Matrix<ScalarType, K, 1> P_i_col = C * P_i.col(col);
+                  P_i.col(col) = P_i_col;
+                }
+              }
+              return;
+            }
+          }
+
+          // Otherwise, with the SVD A_i = U S V^T the projection of A_i^T is
+          // V U^T, whose transpose is U V^T
+          Eigen::JacobiSVD<DimRowsMatrix<K, ScalarType>> SVD(
+              A_i, Eigen::ComputeThinU | Eigen::ComputeThinV);
+          P_i.noalias() = SVD.matrixU() * SVD.matrixV().transpose();
+        },
+        getManifoldGrainSize());
+  });
+}
+
+template <typename ScalarType>
+void StiefelProductT<ScalarType>::projectTransposedToTangentSpace(
+    const ConstMatrixRefType &Y_T, const ConstMatrixRefType &V_T,
+    MatrixRefType R_T) const {
+  checkMatrixShape("StiefelProduct::projectTransposedToTangentSpace::Y_T",
+                   k_ * n_, p_, Y_T.rows(), Y_T.cols());
+  checkMatrixShape("StiefelProduct::projectTransposedToTangentSpace::V_T",
+                   k_ * n_, p_, V_T.rows(), V_T.cols());
+  checkMatrixShape("StiefelProduct::projectTransposedToTangentSpace::R_T",
+                   k_ * n_, p_, R_T.rows(), R_T.cols());
+
+  dispatchOnDim(k_, [&](auto dim_constant) {
+    constexpr int K = decltype(dim_constant)::value;
+    parallelFor(
+        0, n_,
+        [&](Index i) {
+          auto start_row = static_cast<Index>(i * k_);
+          auto Y_i = Y_T.template middleRows<K>(start_row, k_);
+          auto V_i = V_T.template middleRows<K>(start_row, k_);
+          auto R_i = R_T.template middleRows<K>(start_row, k_);
+
+          // R_i = V_i - Sym(Y_i V_i^T) Y_i, the transpose of V_i^T -
+          // Y_i^T Sym(Y_i V_i^T) (cf. projectToTangentSpace())
+          DimMatrix<K, ScalarType> P = Y_i * V_i.transpose();
+          DimMatrix<K, ScalarType> S = ScalarType(0.5) * (P + P.transpose());
+          R_i = V_i;
+          R_i.noalias() -= S * Y_i;
+        },
+        getManifoldGrainSize());
+  });
+}
+
+template <typename ScalarType>
+void StiefelProductT<ScalarType>::subtractTransposedBlockDiagProduct(
+    const MatrixType &S, const ConstMatrixRefType &A_T,
+    MatrixRefType R_T) const {
+  checkMatrixShape("StiefelProduct::subtractTransposedBlockDiagProduct::S", k_,
+                   k_ * n_, S.rows(), S.cols());
+  checkMatrixShape("StiefelProduct::subtractTransposedBlockDiagProduct::A_T",
+                   k_ * n_, p_, A_T.rows(), A_T.cols());
+  checkMatrixShape("StiefelProduct::subtractTransposedBlockDiagProduct::R_T",
+                   k_ * n_, p_, R_T.rows(), R_T.cols());
+
+  dispatchOnDim(k_, [&](auto dim_constant) {
+    constexpr int K = decltype(dim_constant)::value;
+    parallelFor(
+        0, n_,
+        [&](Index i) {
+          auto start_row = static_cast<Index>(i * k_);
+          R_T.template middleRows<K>(start_row, k_).noalias() -=
+              S.template block<K, K>(0, start_row, k_, k_).transpose() *
+              A_T.template middleRows<K>(start_row, k_);
+        },
+        getManifoldGrainSize());
+  });
+}
+
+template <typename ScalarType>
+typename StiefelProductT<ScalarType>::MatrixType
+StiefelProductT<ScalarType>::random_sample(
     const std::default_random_engine::result_type &seed) const {
   // Generate a matrix of the appropriate dimension by sampling its elements
   // from the standard Gaussian
   std::default_random_engine generator(seed);
-  std::normal_distribution<Scalar> g;
+  std::normal_distribution<ScalarType> g;
 
-  Matrix R(p_, k_ * n_);
+  MatrixType R(p_, k_ * n_);
   for (size_t r = 0; r < p_; ++r)
     for (size_t c = 0; c < k_ * n_; ++c)
       R(static_cast<Index>(r), static_cast<Index>(c)) = g(generator);
   return projectToManifold(R);
 }
+
+template class StiefelProductT<double>;
+#ifdef CORA_FLOAT_MANIFOLDS
+template class StiefelProductT<float>;
+#endif
+
 } // namespace CORA
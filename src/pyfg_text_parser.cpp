@@ -107,9 +107,12 @@ int getDimFromPyfgFirstLine(const std::string &filename) {
  * e.g. (A0). It does not do any validation aside from the proper formatting of
  * the PyFG file.
  * @param filename Path to the PyFG file
+ * @param data_matrix_operator how the problem computes products with its data
+ * matrix
  * @return CORA::Problem The parsed problem
  */
-Problem parsePyfgTextToProblem(const std::string &filename) {
+Problem parsePyfgTextToProblem(const std::string &filename,
+                               DataMatrixOperator data_matrix_operator) {
   // Note: This currently ignores all groundtruth measurements embedded
   // in the file
   int dim = getDimFromPyfgFirstLine(filename);
@@ -117,7 +120,8 @@ Problem parsePyfgTextToProblem(const std::string &filename) {
   CORA::Formulation formulation = CORA::Formulation::Explicit;
   CORA::Preconditioner preconditioner =
       CORA::Preconditioner::RegularizedCholesky;
-  CORA::Problem problem(dim, relaxation_rank, formulation, preconditioner);
+  CORA::Problem problem(dim, relaxation_rank, formulation, preconditioner,
+                        data_matrix_operator);
 
   const std::map<std::string, PyFGType> PyFGStringToType{
       {"VERTEX_SE2", POSE_TYPE_2D},
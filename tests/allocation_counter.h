@@ -0,0 +1,61 @@
+/**
+ * @file allocation_counter.h
+ * @brief Counts the heap allocations made by a program (used by the tests and
+ * the benchmarks). The C allocation functions (which back both operator new
+ * and Eigen's allocations) are replaced by wrappers around the glibc
+ * implementations that increment a counter. Include this header in exactly one
+ * translation unit of a program.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+
+namespace CORA {
+namespace heap {
+
+inline std::atomic<size_t> num_allocations{0};
+
+/** Returns whether allocations are counted on this platform */
+constexpr bool countsAllocations() {
+#ifdef __GLIBC__
+  return true;
+#else
+  return false;
+#endif
+}
+
+/** Returns the number of heap allocations made by a single call to func */
+template <typename Func> size_t countAllocations(Func &&func) {
+  size_t num_allocations_before = num_allocations.load();
+  func();
+  return num_allocations.load() - num_allocations_before;
+}
+
+} // namespace heap
+} // namespace CORA
+
+#ifdef __GLIBC__
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t num, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) {
+  CORA::heap::num_allocations++;
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t num, size_t size) {
+  CORA::heap::num_allocations++;
+  return __libc_calloc(num, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  CORA::heap::num_allocations++;
+  return __libc_realloc(ptr, size);
+}
+}
+#endif
@@ -1,10 +1,14 @@
+#include <CORA/CORA_parallel.h>
 #include <CORA/CORA_preconditioners.h>
+#include <CORA/CORA_spmm.h>
 #include <CORA/CORA_types.h>
 
 #include <cstdint>
 #include <random>
+#include <vector>
 
 #include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
 #include <catch2/generators/catch_generators_adapters.hpp>
 #include <catch2/generators/catch_generators_random.hpp>
 
@@ -212,3 +216,228 @@ TEST_CASE("Block Cholesky solves work okay for fixed matrix",
   CORA::Vector expected_x = A_block_diags_inv * b;
   REQUIRE(x.isApprox(expected_x));
 }
+
+/**
+ * @brief Test that refactorizing a matrix reuses the symbolic analysis only
+ * when the sparsity pattern is unchanged, and that the blocks of a block
+ * Cholesky factorization are taken from along the diagonal (the blocks of the
+ * matrix differ, so factoring the wrong block gives the wrong solution)
+ */
+TEST_CASE("Cholesky refactorizations reuse the symbolic analysis",
+          "[cholesky][block cholesky]") {
+  int mat_size = 6;
+  CORA::Matrix A_dense = CORA::Matrix::Zero(mat_size, mat_size);
+  for (int i = 0; i < mat_size; i++) {
+    A_dense(i, i) = 2.0 + i;
+    if (i + 1 < mat_size) {
+      A_dense(i, i + 1) = A_dense(i + 1, i) = 0.5;
+    }
+  }
+  CORA::SparseMatrix A = A_dense.sparseView();
+  CORA::Vector b = CORA::Vector::LinSpaced(mat_size, 1.0, 6.0);
+
+  CORA::CholFactorPtr chol_factor_ptr;
+  REQUIRE_FALSE(CORA::refactorizeCholesky(chol_factor_ptr, A));
+  REQUIRE(chol_factor_ptr->solve(b).isApprox(A_dense.inverse() * b));
+
+  // same pattern, new values: only the numeric factorization is redone
+  CORA::SparseMatrix A_scaled = 3.0 * A;
+  REQUIRE(CORA::refactorizeCholesky(chol_factor_ptr, A_scaled));
+  REQUIRE(chol_factor_ptr->solve(b).isApprox((3.0 * A_dense).inverse() * b));
+
+  // a new nonzero changes the pattern
+  CORA::Matrix B_dense = A_dense;
+  B_dense(0, 2) = B_dense(2, 0) = 0.25;
+  CORA::SparseMatrix B = B_dense.sparseView();
+  REQUIRE_FALSE(CORA::refactorizeCholesky(chol_factor_ptr, B));
+  REQUIRE(chol_factor_ptr->solve(b).isApprox(B_dense.inverse() * b));
+
+  // a factorization shared with another owner is never modified
+  CORA::CholFactorPtr shared_ptr = chol_factor_ptr;
+  REQUIRE_FALSE(CORA::refactorizeCholesky(chol_factor_ptr, B));
+  REQUIRE(shared_ptr != chol_factor_ptr);
+
+  CORA::VectorXi block_sizes(2);
+  block_sizes << 2, 4;
+  CORA::Matrix A_block_diags = CORA::Matrix::Zero(mat_size, mat_size);
+  A_block_diags.topLeftCorner(2, 2) = A_dense.topLeftCorner(2, 2);
+  A_block_diags.bottomRightCorner(4, 4) = A_dense.bottomRightCorner(4, 4);
+
+  CORA::CholFactorPtrVector block_cholesky_factors;
+  REQUIRE(CORA::updateBlockCholeskyFactorization(block_cholesky_factors, A,
+                                                 block_sizes) == 0);
+  REQUIRE(CORA::blockCholeskySolve(block_cholesky_factors, b)
+              .isApprox(A_block_diags.inverse() * b));
+  REQUIRE(CORA::updateBlockCholeskyFactorization(block_cholesky_factors,
+                                                 A_scaled, block_sizes) == 2);
+  REQUIRE(CORA::blockCholeskySolve(block_cholesky_factors, b)
+              .isApprox((3.0 * A_block_diags).inverse() * b));
+}
+
+/**
+ * @brief Test that factorizing and solving the blocks concurrently gives the
+ * same result as doing so one block at a time
+ */
+TEST_CASE("Block Cholesky solves are the same in parallel",
+          "[block cholesky][parallel]") {
+  int mat_size = 40;
+  CORA::Matrix B = CORA::Matrix::Random(mat_size, mat_size);
+  CORA::Matrix A_dense = B * B.transpose() +
+                         mat_size * CORA::Matrix::Identity(mat_size, mat_size);
+  CORA::SparseMatrix A = A_dense.sparseView();
+  CORA::Matrix rhs = CORA::Matrix::Random(mat_size + 1, 3);
+
+  CORA::VectorXi block_sizes(4);
+  block_sizes << 15, 5, 12, 8;
+
+  CORA::setNumThreads(1);
+  CORA::Matrix serial_result = CORA::blockCholeskySolve(
+      CORA::getBlockCholeskyFactorization(A, block_sizes), rhs);
+
+  CORA::setNumThreads(4);
+  CORA::Matrix parallel_result = CORA::blockCholeskySolve(
+      CORA::getBlockCholeskyFactorization(A, block_sizes), rhs);
+  CORA::setNumThreads(0);
+
+  REQUIRE(parallel_result.isApprox(serial_result));
+  REQUIRE(parallel_result.bottomRows(1).isZero());
+}
+
+/**
+ * @brief Test that the thin sparse-dense product kernel matches Eigen's
+ * product for every number of columns (including those beyond the fixed-size
+ * kernels), for compressed and uncompressed matrices, and with threads
+ */
+TEST_CASE("Thin sparse-dense products match Eigen's products",
+          "[spmm][parallel]") {
+  int num_rows = 5000;
+  int num_cols = 3000;
+  int nnz_per_row = 5;
+  std::uniform_int_distribution<int> col_dist(0, num_cols - 1);
+  std::vector<Eigen::Triplet<double>> triplets;
+  for (int row = 0; row < num_rows; row++) {
+    for (int k = 0; k < nnz_per_row; k++) {
+      triplets.emplace_back(row, col_dist(re), get_random_double());
+    }
+  }
+  CORA::SparseMatrix A(num_rows, num_cols);
+  A.setFromTriplets(triplets.begin(), triplets.end());
+  CORA::SparseMatrix A_uncompressed = A;
+  A_uncompressed.uncompress();
+
+  CORA::ParallelBackend backend = CORA::getParallelBackend();
+  CORA::setParallelBackend(CORA::ParallelBackend::Threads);
+  for (int num_threads : {1, 3}) {
+    CORA::setNumThreads(num_threads);
+    for (int cols = 1; cols <= CORA::kMaxThinProductCols + 2; cols++) {
+      CORA::Matrix X = CORA::Matrix::Random(num_cols, cols);
+      CORA::Matrix expected = A * X;
+
+      CORA::Matrix AX;
+      CORA::sparseThinDenseProduct(A, X, AX);
+      REQUIRE(AX.isApprox(expected));
+
+      CORA::sparseThinDenseProduct(A_uncompressed, X, AX);
+      REQUIRE(AX.isApprox(expected));
+    }
+  }
+  CORA::setNumThreads(0);
+  CORA::setParallelBackend(backend);
+
+  CORA::Matrix X_wrong_rows = CORA::Matrix::Random(num_cols + 1, 3);
+  CORA::Matrix AX;
+  REQUIRE_THROWS_AS(CORA::sparseThinDenseProduct(A, X_wrong_rows, AX),
+                    MatrixShapeException);
+}
+
+/**
+ * @brief Test that the product with the upper triangle of a symmetric matrix
+ * matches Eigen's product with the full matrix
+ */
+TEST_CASE("Symmetric thin products from the upper triangle match Eigen's",
+          "[spmm]") {
+  // large enough to be split into row blocks on more than one thread
+  int mat_size = 5000;
+  int nnz_per_row = 4;
+  std::uniform_int_distribution<int> col_dist(0, mat_size - 1);
+  std::vector<Eigen::Triplet<double>> triplets;
+  for (int row = 0; row < mat_size; row++) {
+    triplets.emplace_back(row, row, get_random_double());
+    for (int k = 0; k < nnz_per_row; k++) {
+      int col = col_dist(re);
+      double val = get_random_double();
+      triplets.emplace_back(row, col, val);
+      triplets.emplace_back(col, row, val);
+    }
+  }
+  CORA::SparseMatrix A(mat_size, mat_size);
+  A.setFromTriplets(triplets.begin(), triplets.end());
+  CORA::SparseMatrix A_upper = A.triangularView<Eigen::Upper>();
+  REQUIRE(CORA::getFullSymmetricMatrix(A_upper,
+                                       CORA::MatrixStorage::UpperTriangular)
+              .isApprox(A));
+
+  CORA::ParallelBackend backend = CORA::getParallelBackend();
+  CORA::setParallelBackend(CORA::ParallelBackend::Threads);
+  for (int num_threads : {1, 3}) {
+    CORA::setNumThreads(num_threads);
+    for (int cols = 1; cols <= CORA::kMaxThinProductCols + 2; cols++) {
+      CORA::Matrix X = CORA::Matrix::Random(mat_size, cols);
+      CORA::Matrix expected = A * X;
+
+      CORA::Matrix AX;
+      CORA::symmetricThinDenseProduct(
+          A_upper, CORA::MatrixStorage::UpperTriangular, X, AX);
+      REQUIRE(AX.isApprox(expected));
+
+      CORA::symmetricThinDenseProduct(A, CORA::MatrixStorage::Full, X, AX);
+      REQUIRE(AX.isApprox(expected));
+    }
+  }
+  CORA::setNumThreads(0);
+  CORA::setParallelBackend(backend);
+}
+
+/**
+ * @brief Test the conversion to block sparse (BSR) format and that the blocked
+ * product matches Eigen's product, for the fixed (2, 3) and dynamic block
+ * sizes
+ */
+TEST_CASE("Block sparse products match Eigen's products", "[spmm][bsr]") {
+  int block_size = GENERATE(2, 3, 4);
+  int num_blocks = 300;
+  int blocks_per_row = 3;
+  std::uniform_int_distribution<int> block_dist(0, num_blocks - 1);
+  std::vector<Eigen::Triplet<double>> triplets;
+  for (int block_row = 0; block_row < num_blocks; block_row++) {
+    for (int k = 0; k < blocks_per_row; k++) {
+      int block_col = block_dist(re);
+      for (int r = 0; r < block_size; r++) {
+        for (int c = 0; c < block_size; c++) {
+          triplets.emplace_back(block_row * block_size + r,
+                                block_col * block_size + c,
+                                get_random_double());
+        }
+      }
+    }
+  }
+  int mat_size = num_blocks * block_size;
+  CORA::SparseMatrix A(mat_size, mat_size);
+  A.setFromTriplets(triplets.begin(), triplets.end());
+
+  CORA::BlockSparseMatrix A_bsr(A, block_size);
+  REQUIRE(A_bsr.rows() == mat_size);
+  REQUIRE(A_bsr.numBlocks() * block_size * block_size == A.nonZeros());
+  REQUIRE(A_bsr.toSparse().isApprox(A));
+
+  for (int cols = 1; cols <= CORA::kMaxThinProductCols + 2; cols++) {
+    CORA::Matrix X = CORA::Matrix::Random(mat_size, cols);
+    CORA::Matrix AX = CORA::Matrix::Ones(mat_size, cols);
+    CORA::addBlockSparseProduct(A_bsr, X, AX);
+    REQUIRE(AX.isApprox(A * X + CORA::Matrix::Ones(mat_size, cols)));
+  }
+
+  CORA::SparseMatrix A_not_blocked = A.topRows(mat_size - 1);
+  REQUIRE_THROWS_AS(CORA::BlockSparseMatrix(A_not_blocked, block_size),
+                    std::invalid_argument);
+}
@@ -0,0 +1,154 @@
+// cppcheck-suppress syntaxError
+#include <CORA/CORA.h>
+#include <CORA/CORA_parallel.h>
+#include <CORA/CORA_problem.h>
+#include <allocation_counter.h>
+#include <test_utils.h>
+
+#include <cmath>
+#include <utility>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+namespace CORA {
+
+TEST_CASE("In-place solver operations do not allocate in steady state",
+          "[problem::allocations]") {
+  Problem problem = getProblem("small_ra_slam_problem");
+  problem.setPreconditioner(Preconditioner::Jacobi);
+  problem.updateProblemData();
+  // the Threads and OpenMP backends allocate in their parallel loops, so only
+  // the serial backend is checked (see getTntFunctions())
+  setParallelBackend(ParallelBackend::Serial);
+
+  Matrix Y = getRandInit("small_ra_slam_problem");
+  Matrix V = problem.tangent_space_projection(
+      Y, getRandDX("small_ra_slam_problem"));
+  Matrix NablaF_Y, grad_F_Y, HV, precon_V, Y_plus;
+  Problem::LambdaBlocks Lambda_blocks;
+  Scalar f_Y = 0, f_Y_plus = 0;
+
+  // the operations of one trust-region iteration (with one inner iteration)
+  auto iteration = [&]() {
+    f_Y = problem.evaluateObjective(Y);
+    problem.Euclidean_gradient(Y, NablaF_Y);
+    problem.Riemannian_gradient(Y, NablaF_Y, grad_F_Y);
+    problem.compute_Lambda_blocks(Y, NablaF_Y, Lambda_blocks);
+    problem.Riemannian_Hessian_vector_product(Y, Lambda_blocks, V, HV);
+    problem.precondition(V, precon_V);
+    problem.tangent_space_projection(Y, precon_V, precon_V);
+    problem.retract(Y, V, Y_plus);
+    f_Y_plus = problem.evaluateObjective(Y_plus);
+  };
+
+  // the first iteration sizes the outputs and the workspace
+  iteration();
+  size_t num_allocations = heap::countAllocations(iteration);
+#ifdef __GLIBC__
+  CHECK(num_allocations == 0);
+#endif
+
+  // the in-place operations match the ones returning new matrices
+  CHECK(f_Y == problem.evaluateObjective(Y));
+  CHECK(NablaF_Y == problem.Euclidean_gradient(Y));
+  CHECK(grad_F_Y == problem.Riemannian_gradient(Y));
+  CHECK(HV == problem.Riemannian_Hessian_vector_product(Y, NablaF_Y, V));
+  CHECK(precon_V ==
+        problem.tangent_space_projection(Y, problem.precondition(V)));
+  CHECK(Y_plus == problem.retract(Y, V));
+  CHECK(f_Y_plus == problem.evaluateObjective(Y_plus));
+
+#ifdef CORA_USE_OPENMP
+  setParallelBackend(ParallelBackend::OpenMP);
+#endif
+}
+
+TEST_CASE("The solver functions only allocate the matrices they return",
+          "[problem::allocations]") {
+  // the Jacobi preconditioner is only built for the explicit formulation
+  auto [formulation, preconditioner] = GENERATE(
+      std::make_pair(Formulation::Explicit, Preconditioner::Jacobi),
+      std::make_pair(Formulation::Explicit,
+                     Preconditioner::RegularizedCholesky),
+      std::make_pair(Formulation::Implicit,
+                     Preconditioner::RegularizedCholesky));
+  Problem problem = getProblem("small_ra_slam_problem");
+  problem.setFormulation(formulation);
+  problem.setPreconditioner(preconditioner);
+  problem.updateProblemData();
+  setParallelBackend(ParallelBackend::Serial);
+
+  CoraTntFunctions functions = getTntFunctions(problem);
+  Matrix Y = problem.getRandomInitialGuess();
+  Matrix V = problem.tangent_space_projection(
+      Y, Matrix::Random(Y.rows(), Y.cols()));
+  Matrix NablaF_Y, grad;
+  Optimization::Riemannian::LinearOperator<Matrix, Matrix, Matrix> HessOp;
+
+  // the number of allocations of each function in one trust-region iteration
+  // (with one inner iteration), as called by the solver
+  struct IterationAllocations {
+    size_t f, QM, metric, HessOp, precon, retract;
+  };
+  auto iteration = [&]() {
+    IterationAllocations counts;
+    counts.f = heap::countAllocations([&]() { functions.f(Y, NablaF_Y); });
+    counts.QM = heap::countAllocations(
+        [&]() { functions.QM(Y, grad, HessOp, NablaF_Y); });
+    counts.metric = heap::countAllocations(
+        [&]() { functions.metric(Y, grad, V, NablaF_Y); });
+    counts.HessOp = heap::countAllocations([&]() { HessOp(Y, V, NablaF_Y); });
+    counts.precon = heap::countAllocations(
+        [&]() { (*functions.precon)(Y, grad, NablaF_Y); });
+    counts.retract =
+        heap::countAllocations([&]() { functions.retract(Y, V, NablaF_Y); });
+    return counts;
+  };
+
+  // the first iteration sizes the outputs and the workspace
+  iteration();
+  IterationAllocations counts = iteration();
+  IterationAllocations next_counts = iteration();
+#ifdef __GLIBC__
+  // the objective, the quadratic model (including its Hessian operator) and
+  // the metric do not allocate, while the Hessian-vector product, the
+  // preconditioner and the retraction only allocate the matrix they return
+  CHECK(counts.metric == 0);
+  CHECK(counts.retract == 1);
+  if (formulation == Formulation::Explicit &&
+      preconditioner == Preconditioner::Jacobi) {
+    CHECK(counts.f == 0);
+    CHECK(counts.QM == 0);
+    CHECK(counts.HessOp == 1);
+    CHECK(counts.precon == 1);
+  }
+
+  // the CHOLMOD solves of the implicit formulation and of the Cholesky
+  // preconditioner also allocate their solutions, but the same number of
+  // times in every iteration
+  CHECK(next_counts.f == counts.f);
+  CHECK(next_counts.QM == counts.QM);
+  CHECK(next_counts.HessOp == counts.HessOp);
+  CHECK(next_counts.precon == counts.precon);
+  CHECK(next_counts.retract == counts.retract);
+#endif
+
+  // the functions match the problem's operations
+  CHECK(functions.f(Y, NablaF_Y) == problem.evaluateObjective(Y));
+  CHECK(grad == problem.Riemannian_gradient(Y));
+  CHECK(HessOp(Y, V, NablaF_Y) ==
+        problem.Riemannian_Hessian_vector_product(Y, NablaF_Y, V));
+  CHECK((*functions.precon)(Y, grad, NablaF_Y) ==
+        problem.tangent_space_projection(Y, problem.precondition(grad)));
+  CHECK(functions.retract(Y, V, NablaF_Y) == problem.retract(Y, V));
+  // the metric sums the same products as the trace of V1^T * V2
+  CHECK(std::abs(functions.metric(Y, grad, V, NablaF_Y) -
+                 (grad.transpose() * V).trace()) <= 1e-12 * grad.norm() *
+                                                        V.norm());
+#ifdef CORA_USE_OPENMP
+  setParallelBackend(ParallelBackend::OpenMP);
+#endif
+}
+
+} // namespace CORA
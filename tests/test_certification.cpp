@@ -1,10 +1,12 @@
 #include <CORA/CORA_problem.h>
+#include <CORA/CORA_spmm.h>
 #include <CORA/CORA_types.h>
 #include <CORA/CORA_utils.h>
 #include <CORA/pyfg_text_parser.h>
 
 #include <test_utils.h>
 
+#include <cstdlib>
 #include <filesystem>
 #include <string>
 
@@ -124,4 +126,118 @@ TEST_CASE("Test small RA-SLAM verification") {
   CHECK_THAT(res.theta, Catch::Matchers::WithinAbs(expected_theta, 1e-6));
 }
 
+TEST_CASE("Certification reuses the symbolic analysis of the certificate "
+          "matrix") {
+  std::string data_subdir = "small_ra_slam_problem";
+  std::string pyfg_path = getTestDataFpath(data_subdir, "factor_graph.pyfg");
+  Problem problem = parsePyfgTextToProblem(pyfg_path);
+  problem.updateProblemData();
+  Matrix X_gt = getGroundTruthState(data_subdir);
+  Matrix X0 = getRandInit(data_subdir);
+
+  // the same matrix with another eta is refactorized without a new analysis
+  SparseMatrix S_rand = problem.get_certificate_matrix(X0);
+  CertificateFactorization factorization;
+  Matrix eigvec_guess = Matrix::Random(S_rand.rows(), 2);
+  CertResults res = fast_verification(S_rand, 1e-6, eigvec_guess, 1000, 3,
+                                      1e-3, MatrixStorage::Full,
+                                      &factorization);
+  CertResults reused_res = fast_verification(S_rand, 1e-2, eigvec_guess, 1000,
+                                             3, 1e-3, MatrixStorage::Full,
+                                             &factorization);
+  CertResults fresh_res = fast_verification(S_rand, 1e-2, eigvec_guess);
+  CHECK(factorization.numAnalyses() == 1);
+  CHECK_FALSE(res.is_certified);
+  CHECK(reused_res.is_certified == fresh_res.is_certified);
+  CHECK_THAT(reused_res.theta,
+             Catch::Matchers::WithinAbs(fresh_res.theta, 1e-6));
+
+  // the certificate matrices at every point (and rank) have the same pattern
+  CHECK(problem.numCertificationAnalyses() == 0);
+  CertResults gt_res = problem.certify_solution(X_gt, 1e-6, 4, X_gt);
+  CertResults rand_res = problem.certify_solution(X0, 1e-6, 4, X0);
+  Matrix X0_lifted = Matrix::Zero(X0.rows(), X0.cols() + 1);
+  X0_lifted.leftCols(X0.cols()) = X0;
+  X0_lifted.col(X0.cols()) = Vector::Random(X0.rows()) * 1e-3;
+  problem.certify_solution(X0_lifted, 1e-6, 4, X0_lifted);
+  CHECK(problem.numCertificationAnalyses() == 1);
+  CHECK(gt_res.is_certified);
+  CHECK_FALSE(rand_res.is_certified);
+}
+
+TEST_CASE("The certificate operator matches the certificate matrix") {
+  std::string data_subdir = "small_ra_slam_problem";
+  std::string pyfg_path = getTestDataFpath(data_subdir, "factor_graph.pyfg");
+  for (Formulation formulation :
+       {Formulation::Explicit, Formulation::Implicit}) {
+    for (MatrixStorage storage :
+         {MatrixStorage::Full, MatrixStorage::UpperTriangular}) {
+      Problem problem = parsePyfgTextToProblem(pyfg_path);
+      problem.setFormulation(formulation);
+      problem.setDataMatrixStorage(storage);
+      problem.updateProblemData();
+
+      Matrix Y = problem.getRandomInitialGuess();
+      Problem::LambdaBlocks Lambda_blocks = problem.compute_Lambda_blocks(Y);
+      CertificateOperator S_op =
+          problem.get_certificate_operator(Lambda_blocks);
+      SparseMatrix S =
+          getFullSymmetricMatrix(problem.get_certificate_matrix(Y), storage);
+      REQUIRE(S_op.size == S.rows());
+      CHECK(S_op.storage == storage);
+
+      Matrix X = Matrix::Random(S.rows(), 5);
+      Matrix SX;
+      S_op.multiply(X, SX);
+      Matrix expected_SX = S * X;
+      CHECK_THAT(SX, IsApproximatelyEqual<Matrix>(expected_SX, 1e-10));
+
+      SparseMatrix Id(S.rows(), S.cols());
+      Id.setIdentity();
+      SparseMatrix expected_M = S + 0.1 * Id;
+      CHECK_THAT(getFullSymmetricMatrix(S_op.assembleRegularized(0.1), storage),
+                 IsApproximatelyEqual<SparseMatrix>(expected_M, 1e-10));
+
+      // the verification gives the same results in either form
+      Matrix X0 = Matrix::Random(S.rows(), 4);
+      CertResults op_res = fast_verification(S_op, 1e-6, X0);
+      CertResults matrix_res = fast_verification(S, 1e-6, X0);
+      CHECK(op_res.is_certified == matrix_res.is_certified);
+      CHECK_THAT(op_res.theta,
+                 Catch::Matchers::WithinAbs(matrix_res.theta, 1e-8));
+    }
+  }
+}
+
+TEST_CASE("Certification reuses the cached gradient") {
+  std::string data_subdir = "small_ra_slam_problem";
+  std::string pyfg_path = getTestDataFpath(data_subdir, "factor_graph.pyfg");
+  for (Formulation formulation :
+       {Formulation::Explicit, Formulation::Implicit}) {
+    Problem problem = parsePyfgTextToProblem(pyfg_path);
+    problem.setFormulation(formulation);
+    problem.updateProblemData();
+    Problem uncached_problem = problem;
+    Matrix Y = problem.getRandomInitialGuess();
+    Matrix bootstrap = Matrix::Random(problem.getDataMatrixSize(), 2);
+
+    // the optimizer evaluates the gradient at its final iterate last
+    problem.Euclidean_gradient(Y);
+    REQUIRE(problem.numDataProductCacheMisses() == 1);
+    std::srand(0);
+    CertResults res = problem.certify_solution(Y, 1e-6, 4, bootstrap);
+    CHECK(problem.numDataProductCacheMisses() == 1);
+
+    // without a cached gradient, Q*Y is computed
+    size_t misses = uncached_problem.numDataProductCacheMisses();
+    std::srand(0);
+    CertResults uncached_res =
+        uncached_problem.certify_solution(Y, 1e-6, 4, bootstrap);
+    CHECK(uncached_problem.numDataProductCacheMisses() == misses + 1);
+    CHECK(res.is_certified == uncached_res.is_certified);
+    CHECK_THAT(res.theta,
+               Catch::Matchers::WithinAbs(uncached_res.theta, 1e-8));
+  }
+}
+
 } // namespace CORA
@@ -9,13 +9,22 @@
  *
  */
 
+#include <CORA/CORA_parallel.h>
 #include <CORA/CORA_problem.h>
+#include <CORA/CORA_utils.h>
+#include <CORA/pyfg_text_parser.h>
 
 #include <test_utils.h>
 
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <set>
 #include <string>
+#include <vector>
 
 #include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
 
 namespace CORA {
 
@@ -124,4 +133,472 @@ TEST_CASE("constructing single-range data matrix",
     REQUIRE(mat_prod.norm() < 1e-12);
   }
 }
+
+TEST_CASE("duplicate measurements are rejected regardless of symbol order",
+          "[problem::measurement_index]") {
+  int dim = 2;
+  int rank = 2;
+  Problem problem(dim, rank, Formulation::Explicit);
+  Symbol x1("x1");
+  Symbol x2("x2");
+  Symbol l1("l1");
+  Symbol l2("l2");
+  problem.addPoseVariable(x1);
+  problem.addPoseVariable(x2);
+  problem.addLandmarkVariable(l1);
+  problem.addLandmarkVariable(l2);
+
+  problem.addRangeMeasurement(RangeMeasurement(x1, l1, 1.0, 1.0));
+  problem.addRangeMeasurement(RangeMeasurement(x2, l1, 2.0, 1.0));
+  problem.addRangeMeasurement(RangeMeasurement(l2, x1, 3.0, 1.0));
+  REQUIRE_THROWS(problem.addRangeMeasurement(RangeMeasurement(l1, x1, 1, 1)));
+
+  RelativePoseMeasurement rpm(x1, x2, Matrix::Identity(dim, dim),
+                              Vector::Zero(dim), Matrix::Identity(3, 3));
+  problem.addRelativePoseMeasurement(rpm);
+  RelativePoseMeasurement rpm_reversed(x2, x1, Matrix::Identity(dim, dim),
+                                       Vector::Zero(dim),
+                                       Matrix::Identity(3, 3));
+  REQUIRE_THROWS(problem.addRelativePoseMeasurement(rpm_reversed));
+
+  // range variables come directly after the rotations, in insertion order
+  Index rot_offset = problem.numPosesDim();
+  CHECK(problem.getRangeIdx(std::make_pair(x1, l1)) == rot_offset);
+  CHECK(problem.getRangeIdx(std::make_pair(l1, x1)) == rot_offset);
+  CHECK(problem.getRangeIdx(std::make_pair(x2, l1)) == rot_offset + 1);
+  CHECK(problem.getRangeIdx(std::make_pair(x1, l2)) == rot_offset + 2);
+  REQUIRE_THROWS(problem.getRangeIdx(std::make_pair(x2, l2)));
+}
+
+TEST_CASE("incremental updates match rebuilding the data matrix",
+          "[problem::incremental_update]") {
+  Problem full_problem = getProblem("small_ra_slam_problem");
+  int dim = full_problem.dim();
+
+  std::vector<Symbol> poses(full_problem.numPoses(), Symbol('?', 0));
+  for (const auto &[sym, idx] : full_problem.getPoseSymbolMap()) {
+    poses[idx] = sym;
+  }
+  std::vector<Symbol> landmarks(full_problem.numLandmarks(), Symbol('?', 0));
+  for (const auto &[sym, idx] : full_problem.getLandmarkSymbolMap()) {
+    landmarks[idx] = sym;
+  }
+  std::vector<RelativePoseMeasurement> rpms = full_problem.getRPMs();
+  std::vector<RangeMeasurement> ranges = full_problem.getRangeMeasurements();
+
+  auto formulation = GENERATE(Formulation::Explicit, Formulation::Implicit);
+  Problem incremental_problem(dim, dim, formulation, Preconditioner::Jacobi);
+  incremental_problem.setIncrementalUpdates(true);
+
+  // everything streamed into incremental_problem so far, in order, so that
+  // it can be replayed into a problem built from scratch
+  std::vector<Symbol> streamed_poses, streamed_landmarks;
+  std::vector<RelativePoseMeasurement> streamed_rpms;
+  std::vector<RangeMeasurement> streamed_ranges;
+  std::vector<RelativePoseLandmarkMeasurement> streamed_rplms;
+  std::set<Symbol> streamed_variables;
+  std::vector<bool> rpm_streamed(rpms.size(), false);
+  std::vector<bool> range_streamed(ranges.size(), false);
+
+  // streams the given variables and then every measurement between streamed
+  // variables that has not been streamed yet
+  auto stream = [&](const std::vector<Symbol> &new_poses,
+                    const std::vector<Symbol> &new_landmarks) {
+    for (const auto &pose : new_poses) {
+      incremental_problem.addPoseVariable(pose);
+      streamed_poses.push_back(pose);
+      streamed_variables.insert(pose);
+    }
+    for (const auto &landmark : new_landmarks) {
+      incremental_problem.addLandmarkVariable(landmark);
+      streamed_landmarks.push_back(landmark);
+      streamed_variables.insert(landmark);
+    }
+    auto isStreamed = [&streamed_variables](const Symbol &sym) {
+      return streamed_variables.count(sym) > 0;
+    };
+    for (size_t i = 0; i < rpms.size(); i++) {
+      if (!rpm_streamed[i] && isStreamed(rpms[i].first_id) &&
+          isStreamed(rpms[i].second_id)) {
+        incremental_problem.addRelativePoseMeasurement(rpms[i]);
+        streamed_rpms.push_back(rpms[i]);
+        rpm_streamed[i] = true;
+      }
+    }
+    for (size_t i = 0; i < ranges.size(); i++) {
+      if (!range_streamed[i] && isStreamed(ranges[i].first_id) &&
+          isStreamed(ranges[i].second_id)) {
+        incremental_problem.addRangeMeasurement(ranges[i]);
+        streamed_ranges.push_back(ranges[i]);
+        range_streamed[i] = true;
+      }
+    }
+  };
+
+  auto checkMatchesRebuilt = [&]() {
+    incremental_problem.updateProblemData();
+
+    Problem rebuilt_problem(dim, dim, formulation, Preconditioner::Jacobi);
+    for (const auto &pose : streamed_poses) {
+      rebuilt_problem.addPoseVariable(pose);
+    }
+    for (const auto &landmark : streamed_landmarks) {
+      rebuilt_problem.addLandmarkVariable(landmark);
+    }
+    for (const auto &rpm : streamed_rpms) {
+      rebuilt_problem.addRelativePoseMeasurement(rpm);
+    }
+    for (const auto &range : streamed_ranges) {
+      rebuilt_problem.addRangeMeasurement(range);
+    }
+    for (const auto &rplm : streamed_rplms) {
+      rebuilt_problem.addRelativePoseLandmarkMeasurement(rplm);
+    }
+    rebuilt_problem.updateProblemData();
+
+    CHECK_THAT(incremental_problem.data_matrix_,
+               IsApproximatelyEqual(rebuilt_problem.data_matrix_, 1e-12));
+    if (formulation == Formulation::Implicit) {
+      CHECK_THAT(incremental_problem.Qmain_,
+                 IsApproximatelyEqual(rebuilt_problem.Qmain_, 1e-12));
+      CHECK_THAT(incremental_problem.TransOffDiagRed_,
+                 IsApproximatelyEqual(rebuilt_problem.TransOffDiagRed_, 1e-12));
+    }
+  };
+
+  // poses arrive in two batches, followed by the landmarks, so that the
+  // existing rows must be relabelled at each update
+  size_t half = poses.size() / 2;
+  stream(std::vector<Symbol>(poses.begin(), poses.begin() + half), {});
+  checkMatchesRebuilt();
+  stream(std::vector<Symbol>(poses.begin() + half, poses.end()), {});
+  checkMatchesRebuilt();
+  CHECK(incremental_problem.dataMatrixPatternChanged());
+  stream({}, landmarks);
+  checkMatchesRebuilt();
+  CHECK(incremental_problem.dataMatrixPatternChanged());
+
+  // a pose-landmark measurement between two poses that already share a
+  // relative pose measurement only touches existing nonzeros, so it is
+  // patched in place
+  const RelativePoseMeasurement &rpm = streamed_rpms.front();
+  RelativePoseLandmarkMeasurement rplm(rpm.first_id, rpm.second_id, rpm.t,
+                                       Matrix::Identity(dim, dim));
+  size_t num_analyses_skipped =
+      incremental_problem.numSymbolicAnalysesSkipped();
+  incremental_problem.addRelativePoseLandmarkMeasurement(rplm);
+  streamed_rplms.push_back(rplm);
+  checkMatchesRebuilt();
+  CHECK_FALSE(incremental_problem.dataMatrixPatternChanged());
+
+  // the Cholesky factorization of the translation block then only needs to
+  // be refactorized numerically
+  if (formulation == Formulation::Implicit) {
+    CHECK(incremental_problem.numSymbolicAnalysesSkipped() ==
+          num_analyses_skipped + 1);
+  }
+}
+
+TEST_CASE("upper-triangular storage of the data matrix matches full storage",
+          "[problem::storage]") {
+  auto formulation = GENERATE(Formulation::Explicit, Formulation::Implicit);
+  Problem full_problem = getUpdatedProblem(formulation);
+  Problem upper_problem = getUpdatedProblem(formulation, [](Problem &problem) {
+    problem.setDataMatrixStorage(MatrixStorage::UpperTriangular);
+  });
+
+  // only the upper triangle is stored, but the full matrix is returned
+  SparseMatrix full_data_matrix = full_problem.getDataMatrix();
+  SparseMatrix upper_data_matrix =
+      full_data_matrix.triangularView<Eigen::Upper>();
+  CHECK_THAT(upper_problem.data_matrix_,
+             IsApproximatelyEqual(upper_data_matrix, 1e-12));
+  CHECK_THAT(upper_problem.getDataMatrix(),
+             IsApproximatelyEqual(full_data_matrix, 1e-12));
+
+  Matrix Y = upper_problem.getRandomInitialGuess();
+  CHECK_THAT(upper_problem.Euclidean_gradient(Y),
+             IsApproximatelyEqual(full_problem.Euclidean_gradient(Y), 1e-10));
+
+  // the certificate matrix is stored like the data matrix (and is built for
+  // the translation-explicit form of the problem)
+  if (formulation == Formulation::Implicit) {
+    return;
+  }
+  Matrix X_gt = getGroundTruthState("small_ra_slam_problem");
+  SparseMatrix S_full = full_problem.get_certificate_matrix(X_gt);
+  SparseMatrix S_upper = upper_problem.get_certificate_matrix(X_gt);
+  SparseMatrix S_full_upper = S_full.triangularView<Eigen::Upper>();
+  CHECK_THAT(S_upper, IsApproximatelyEqual(S_full_upper, 1e-10));
+  CertResults results = fast_verification(S_upper, 1e-6, 1, 1000, 3, 1e-3,
+                                          MatrixStorage::UpperTriangular);
+  CHECK(results.is_certified);
+
+  Matrix X0 = getRandInit("small_ra_slam_problem");
+  CHECK_FALSE(fast_verification(upper_problem.get_certificate_matrix(X0), 1e-6,
+                                1, 1000, 3, 1e-3,
+                                MatrixStorage::UpperTriangular)
+                  .is_certified);
+}
+
+TEST_CASE("block sparse rotation products match scalar products",
+          "[problem::storage]") {
+  auto formulation = GENERATE(Formulation::Explicit, Formulation::Implicit);
+  auto storage =
+      GENERATE(MatrixStorage::Full, MatrixStorage::UpperTriangular);
+  Problem scalar_problem =
+      getUpdatedProblem(formulation, [storage](Problem &problem) {
+        problem.setDataMatrixStorage(storage);
+      });
+  Problem block_problem =
+      getUpdatedProblem(formulation, [storage](Problem &problem) {
+        problem.setDataMatrixStorage(storage);
+        problem.setBlockSparseRotations(true);
+      });
+
+  Matrix Y = block_problem.getRandomInitialGuess();
+  CHECK_THAT(block_problem.Euclidean_gradient(Y),
+             IsApproximatelyEqual(scalar_problem.Euclidean_gradient(Y), 1e-10));
+
+  // the split is stored in addition to the data matrix
+  CHECK(scalar_problem.blockSparseRotationMemoryUsage() == 0);
+  CHECK(block_problem.blockSparseRotationMemoryUsage() > 0);
+}
+
+TEST_CASE("matrix-free data matrix products match assembled products",
+          "[problem::storage]") {
+  auto preconditioner =
+      GENERATE(Preconditioner::Jacobi, Preconditioner::RegularizedCholesky);
+  std::string pyfg_path =
+      getTestDataFpath("small_ra_slam_problem", "factor_graph.pyfg");
+  Problem assembled_problem = parsePyfgTextToProblem(pyfg_path);
+  assembled_problem.setPreconditioner(preconditioner);
+  assembled_problem.updateProblemData();
+  Problem free_problem =
+      parsePyfgTextToProblem(pyfg_path, DataMatrixOperator::MatrixFree);
+  free_problem.setPreconditioner(preconditioner);
+  free_problem.updateProblemData();
+
+  // the data matrix is only assembled on request
+  CHECK(free_problem.data_matrix_.nonZeros() == 0);
+  CHECK(free_problem.matrixFreeMemoryUsage() > 0);
+  CHECK_THAT(free_problem.getDataMatrix(),
+             IsApproximatelyEqual(assembled_problem.getDataMatrix(), 1e-12));
+
+  // thin products use fixed-size kernels and wide ones dynamic kernels, and
+  // edges of the same color are split among threads
+  ParallelBackend backend = getParallelBackend();
+  setParallelBackend(ParallelBackend::Threads);
+  setNumThreads(3);
+  for (Index cols : {Index(2), kMaxThinProductCols + 2}) {
+    Matrix Y = Matrix::Random(assembled_problem.getExpectedVariableSize(), cols);
+    CHECK_THAT(free_problem.Euclidean_gradient(Y),
+               IsApproximatelyEqual(assembled_problem.Euclidean_gradient(Y),
+                                    1e-10));
+  }
+  setNumThreads(0);
+  setParallelBackend(backend);
+
+  Matrix Y = free_problem.getRandomInitialGuess();
+  CHECK_THAT(free_problem.precondition(Y),
+             IsApproximatelyEqual(assembled_problem.precondition(Y), 1e-8));
+
+  Matrix X_gt = getGroundTruthState("small_ra_slam_problem");
+  CHECK_THAT(free_problem.get_certificate_matrix(X_gt),
+             IsApproximatelyEqual(
+                 assembled_problem.get_certificate_matrix(X_gt), 1e-10));
+
+  // the implicit formulation needs the assembled blocks of the data matrix
+  free_problem.setFormulation(Formulation::Implicit);
+  REQUIRE_THROWS_AS(free_problem.updateProblemData(), std::invalid_argument);
+}
+
+TEST_CASE("matrix-free products sum the rows of busy variables per thread",
+          "[problem::storage]") {
+  // a landmark ranged from each of many poses, and a prior on each pose from
+  // the origin pose: the landmark and the origin are left out of the coloring
+  const Index d = 2;
+  const Index num_poses = 300;
+  const Index origin = num_poses;
+  const Index landmark = num_poses + 1;
+  // the rotations, then the translations (with the origin and the landmark),
+  // then the range bearings
+  const Index trans_offset = d * (num_poses + 1);
+  const Index range_offset = trans_offset + num_poses + 2;
+  MatrixFreeDataMatrix edges(d, range_offset + num_poses);
+  for (Index i = 0; i < num_poses; i++) {
+    Matrix R = Matrix::Identity(d, d);
+    Vector t = Vector::Random(d);
+    edges.addPoseEdge(d * origin, d * i, trans_offset + origin,
+                      trans_offset + i, R, t, 1.0, 2.0);
+    if (i > 0) {
+      edges.addPoseEdge(d * (i - 1), d * i, trans_offset + i - 1,
+                        trans_offset + i, R, t, 3.0, 4.0);
+    }
+    edges.addRangeEdge(range_offset + i, trans_offset + i,
+                       trans_offset + landmark, 1.5, 5.0);
+  }
+  edges.finalize();
+  // the origin rotation and translation, and the landmark
+  CHECK(edges.numUncoloredRows() == d + 2);
+  CHECK(edges.numColors() <= 6);
+
+  Matrix Y = Matrix::Random(edges.rows(), 3);
+  Matrix serial_QY, parallel_QY;
+  RowMajorMatrix Y_rows, QY_rows;
+  ParallelBackend backend = getParallelBackend();
+  setParallelBackend(ParallelBackend::Serial);
+  edges.multiply(Y, serial_QY, Y_rows, QY_rows);
+  setParallelBackend(ParallelBackend::Threads);
+  setNumThreads(3);
+  edges.multiply(Y, parallel_QY, Y_rows, QY_rows);
+  CHECK(parallel_QY.rows() == edges.rows());
+  CHECK_THAT(parallel_QY, IsApproximatelyEqual(serial_QY, 1e-10));
+  setNumThreads(0);
+  setParallelBackend(backend);
+}
+
+TEST_CASE("matrix-free products split the colors among threads without busy "
+          "variables",
+          "[problem::storage]") {
+  // odometry, skip-one loop closures and ranges between poses three apart:
+  // every variable is colored, and each color has enough edges for several
+  // threads
+  const Index d = 3;
+  const Index num_poses = 2000;
+  const Index trans_offset = d * num_poses;
+  const Index range_offset = trans_offset + num_poses;
+  MatrixFreeDataMatrix edges(d, range_offset + num_poses - 3);
+  for (Index i = 0; i < num_poses; i++) {
+    Matrix R = Matrix::Identity(d, d);
+    Vector t = Vector::Random(d);
+    if (i > 0) {
+      edges.addPoseEdge(d * (i - 1), d * i, trans_offset + i - 1,
+                        trans_offset + i, R, t, 1.0, 2.0);
+    }
+    if (i > 1) {
+      edges.addPoseEdge(d * (i - 2), d * i, trans_offset + i - 2,
+                        trans_offset + i, R, t, 3.0, 4.0);
+    }
+    if (i > 2) {
+      edges.addRangeEdge(range_offset + i - 3, trans_offset + i - 3,
+                         trans_offset + i, 1.5, 5.0);
+    }
+  }
+  edges.finalize();
+  CHECK(edges.numUncoloredRows() == 0);
+
+  ParallelBackend backend = getParallelBackend();
+  for (Index cols : {Index(1), Index(3), kMaxThinProductCols + 2}) {
+    Matrix Y = Matrix::Random(edges.rows(), cols);
+    Matrix serial_QY, parallel_QY;
+    RowMajorMatrix Y_rows, QY_rows;
+    setParallelBackend(ParallelBackend::Serial);
+    edges.multiply(Y, serial_QY, Y_rows, QY_rows);
+    setParallelBackend(ParallelBackend::Threads);
+    setNumThreads(3);
+    edges.multiply(Y, parallel_QY, Y_rows, QY_rows);
+    // no rows are summed per thread
+    CHECK(QY_rows.rows() == edges.rows());
+    CHECK_THAT(parallel_QY, IsApproximatelyEqual(serial_QY, 1e-10));
+    setNumThreads(0);
+  }
+  setParallelBackend(backend);
+}
+
+TEST_CASE("reverse Cuthill-McKee recovers the order of shuffled paths",
+          "[problem::ordering]") {
+  // two paths whose vertices are shuffled
+  const Index path_length = 50;
+  std::vector<Index> labels(2 * path_length);
+  std::iota(labels.begin(), labels.end(), 0);
+  std::shuffle(labels.begin(), labels.end(), std::mt19937(42));
+  std::vector<std::vector<Index>> adjacency(labels.size());
+  for (Index path = 0; path < 2; path++) {
+    for (Index k = path * path_length + 1; k < (path + 1) * path_length; k++) {
+      adjacency[labels[k - 1]].push_back(labels[k]);
+      adjacency[labels[k]].push_back(labels[k - 1]);
+    }
+  }
+
+  std::vector<Index> order = reverseCuthillMcKee(adjacency);
+  REQUIRE(order.size() == labels.size());
+  std::vector<Index> positions(order.size(), -1);
+  for (size_t k = 0; k < order.size(); k++) {
+    positions[order[k]] = k;
+  }
+  REQUIRE(std::count(positions.begin(), positions.end(), -1) == 0);
+
+  // each path is laid out contiguously, so the bandwidth is 1
+  for (size_t v = 0; v < adjacency.size(); v++) {
+    for (Index neighbor : adjacency[v]) {
+      CHECK(std::abs(positions[v] - positions[neighbor]) == 1);
+    }
+  }
+}
+
+TEST_CASE("reordered variables match the insertion order",
+          "[problem::ordering]") {
+  auto formulation = GENERATE(Formulation::Explicit, Formulation::Implicit);
+  Problem problem = getUpdatedProblem(formulation);
+  Problem reordered_problem =
+      getUpdatedProblem(formulation, [](Problem &reordered) {
+        reordered.setVariableOrdering(VariableOrdering::ReverseCuthillMcKee);
+      });
+
+  // copies the rows of each variable of Y (in insertion order) to its rows in
+  // the reordered problem
+  const Index d = problem.dim();
+  const bool has_translations = formulation == Formulation::Explicit;
+  const size_t num_variables =
+      problem.numPoses() + problem.numRangeMeasurements() +
+      (has_translations ? problem.numTranslationalStates() : 0);
+  auto reorder = [&](const Matrix &Y) {
+    Matrix Y_reordered(Y.rows(), Y.cols());
+    std::set<Index> rows;
+    for (const auto &[sym, idx] : problem.getPoseSymbolMap()) {
+      Y_reordered.middleRows(reordered_problem.getRotationIdx(sym) * d, d) =
+          Y.middleRows(problem.getRotationIdx(sym) * d, d);
+      rows.insert(reordered_problem.getRotationIdx(sym) * d);
+      if (has_translations) {
+        Y_reordered.row(reordered_problem.getTranslationIdx(sym)) =
+            Y.row(problem.getTranslationIdx(sym));
+        rows.insert(reordered_problem.getTranslationIdx(sym));
+      }
+    }
+    for (const auto &[sym, idx] : problem.getLandmarkSymbolMap()) {
+      if (has_translations) {
+        Y_reordered.row(reordered_problem.getTranslationIdx(sym)) =
+            Y.row(problem.getTranslationIdx(sym));
+        rows.insert(reordered_problem.getTranslationIdx(sym));
+      }
+    }
+    for (const auto &measure : problem.getRangeMeasurements()) {
+      Y_reordered.row(reordered_problem.getRangeIdx(measure.getSymbolPair())) =
+          Y.row(problem.getRangeIdx(measure.getSymbolPair()));
+      rows.insert(reordered_problem.getRangeIdx(measure.getSymbolPair()));
+    }
+    // every variable has its own rows
+    REQUIRE(rows.size() == num_variables);
+    return Y_reordered;
+  };
+
+  Matrix Y = problem.getRandomInitialGuess();
+  Matrix Y_reordered = reorder(Y);
+  CHECK(std::abs(reordered_problem.evaluateObjective(Y_reordered) -
+                 problem.evaluateObjective(Y)) < 1e-8);
+  CHECK_THAT(reordered_problem.Euclidean_gradient(Y_reordered),
+             IsApproximatelyEqual(reorder(problem.Euclidean_gradient(Y)),
+                                  1e-10));
+
+  if (formulation == Formulation::Implicit) {
+    return;
+  }
+  Matrix X_gt_reordered =
+      reorder(getGroundTruthState("small_ra_slam_problem"));
+  CertResults results = fast_verification(
+      reordered_problem.get_certificate_matrix(X_gt_reordered), 1e-6, 1);
+  CHECK(results.is_certified);
+}
+
 } // namespace CORA
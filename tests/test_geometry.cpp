@@ -1,11 +1,26 @@
 // cppcheck-suppress syntaxError
+#include <CORA/CORA_parallel.h>
 #include <CORA/CORA_types.h>
+#include <CORA/CORA_utils.h>
 #include <CORA/ObliqueManifold.h>
+#include <CORA/StiefelProduct.h>
 #include <test_utils.h>
 
 #include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
 #include <catch2/matchers/catch_matchers_floating_point.hpp>
 
+#include <Eigen/SVD>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
 namespace CORA {
 
 TEST_CASE("Testing unit-sphere functions", "[sphere]") {
@@ -81,4 +96,384 @@ TEST_CASE("Testing oblique manifold functions", "[oblique]") {
   REQUIRE_FALSE(Y_retract.isApprox(Y));
 }
 
+TEST_CASE("Stiefel product block kernels match dynamic-size products",
+          "[stiefel]") {
+  // k = 2 and k = 3 use the fixed-size kernels, k = 4 the dynamic ones
+  size_t k = GENERATE(2, 3, 4);
+  size_t p = 5;
+  size_t n = 4;
+  StiefelProduct M(k, p, n);
+
+  Matrix A = Matrix::Random(p, k * n);
+  Matrix B = Matrix::Random(p, k * n);
+  Matrix C = Matrix::Random(p, k * n);
+
+  // compute the block products one (dynamic-size) block at a time
+  Matrix sym_prod(p, k * n);
+  Matrix prod(p, k * n);
+  for (size_t i = 0; i < n; i++) {
+    Matrix Ai = A.middleCols(i * k, k);
+    Matrix P = B.middleCols(i * k, k).transpose() * C.middleCols(i * k, k);
+    sym_prod.middleCols(i * k, k) = Ai * (.5 * (P + P.transpose()));
+    prod.middleCols(i * k, k) = Ai * P;
+  }
+
+  Matrix S(k, k * n);
+  for (size_t i = 0; i < n; i++) {
+    S.middleCols(i * k, k) =
+        B.middleCols(i * k, k).transpose() * C.middleCols(i * k, k);
+  }
+
+  CHECK_THAT(M.SymBlockDiagProduct(A, B.transpose(), C),
+             IsApproximatelyEqual<Matrix>(sym_prod, 1e-12));
+  CHECK_THAT(M.BlockDiagProduct(A, S),
+             IsApproximatelyEqual<Matrix>(prod, 1e-12));
+
+  // the projection has orthonormal blocks
+  Matrix Y = M.projectToManifold(A);
+  for (size_t i = 0; i < n; i++) {
+    Matrix YtY = Y.middleCols(i * k, k).transpose() * Y.middleCols(i * k, k);
+    CHECK_THAT(YtY,
+               IsApproximatelyEqual<Matrix>(Matrix::Identity(k, k), 1e-12));
+  }
+}
+
+TEST_CASE("Polar projections match the SVD-based projections", "[stiefel]") {
+  size_t k = GENERATE(2, 3);
+  size_t p = 5;
+  size_t n = 50;
+  StiefelProduct M(k, p, n);
+
+  // the SVD-based projection of each block: A_i = U S V^T -> U V^T
+  auto svd_projection = [&](const Matrix &A) {
+    Matrix P(p, k * n);
+    for (size_t i = 0; i < n; i++) {
+      Eigen::JacobiSVD<Matrix> svd(A.middleCols(i * k, k),
+                                   Eigen::ComputeThinU | Eigen::ComputeThinV);
+      P.middleCols(i * k, k) = svd.matrixU() * svd.matrixV().transpose();
+    }
+    return P;
+  };
+
+  // arbitrary blocks
+  Matrix A = Matrix::Random(p, k * n);
+  CHECK_THAT(M.projectToManifold(A),
+             IsApproximatelyEqual<Matrix>(svd_projection(A), 1e-10));
+
+  // blocks close to the manifold, as in a retraction
+  Matrix Y = M.random_sample();
+  Matrix V = 1e-3 * M.projectToTangentSpace(Y, Matrix::Random(p, k * n));
+  CHECK_THAT(M.retract(Y, V),
+             IsApproximatelyEqual<Matrix>(svd_projection(Y + V), 1e-10));
+
+  // nearly rank-deficient blocks fall back to the SVD
+  Matrix A_singular = A;
+  A_singular.col(k - 1) = A.col(0) + 1e-4 * A.col(k - 1);
+  A_singular.col(2 * k - 1) = A.col(k) + 1e-7 * A.col(2 * k - 1);
+  Matrix P_singular = M.projectToManifold(A_singular);
+  CHECK_THAT(P_singular,
+             IsApproximatelyEqual<Matrix>(svd_projection(A_singular), 1e-8));
+
+  // the rotation projection also handles reflections
+  for (int trial = 0; trial < 10; trial++) {
+    Matrix R = Matrix::Random(k, k);
+    if (trial % 2 == 0) {
+      R.row(0) *= -1;
+    }
+    Eigen::JacobiSVD<Matrix> svd(R, Eigen::ComputeFullU | Eigen::ComputeFullV);
+    Matrix U = svd.matrixU();
+    if ((U * svd.matrixV().transpose()).determinant() < 0) {
+      U.col(k - 1) *= -1;
+    }
+    Matrix R_proj = projectToSOd(R);
+    CHECK_THAT(R_proj, IsApproximatelyEqual<Matrix>(
+                           U * svd.matrixV().transpose(), 1e-10));
+    CHECK_THAT(R_proj.determinant(), Catch::Matchers::WithinAbs(1.0, 1e-12));
+  }
+}
+
+TEST_CASE("The thin SVD from the Gram matrix matches the Jacobi SVD",
+          "[stiefel]") {
+  size_t r = GENERATE(3, 5);
+  Matrix Y = Matrix::Random(200, r);
+  Eigen::JacobiSVD<Matrix> svd(Y, Eigen::ComputeThinU);
+
+  Vector singular_values;
+  Matrix V;
+  thinSvdFromGram(Y, singular_values, V);
+  CHECK_THAT(singular_values, IsApproximatelyEqual<Vector>(
+                                  svd.singularValues(), 1e-10));
+  CHECK_THAT(V.transpose() * V,
+             IsApproximatelyEqual<Matrix>(Matrix::Identity(r, r), 1e-12));
+  // Y * V = U * Sigma, up to the sign of each column
+  Matrix YV = Y * V;
+  Matrix U_Sigma = svd.matrixU() * svd.singularValues().asDiagonal();
+  for (size_t i = 0; i < r; i++) {
+    Vector YV_i = YV.col(i);
+    Vector U_Sigma_i = U_Sigma.col(i);
+    CHECK_THAT(YV_i, IsApproximatelyEqualUpToSign<Vector>(U_Sigma_i, 1e-10));
+  }
+
+  // a rank-deficient Y has (numerically) zero trailing singular values
+  Matrix Y_deficient = Y;
+  Y_deficient.col(r - 1) = Y.col(0);
+  thinSvdFromGram(Y_deficient, singular_values, V);
+  CHECK(singular_values.minCoeff() >= 0);
+  CHECK(singular_values(r - 1) < 1e-6 * singular_values(0));
+}
+
+TEST_CASE("Manifold kernels are the same with every parallel backend",
+          "[stiefel][oblique][parallel]") {
+  size_t k = 3;
+  size_t p = 4;
+  size_t n = 1000;
+  StiefelProduct stiefel(k, p, n);
+  ObliqueManifold oblique(p, n);
+
+  Matrix A = Matrix::Random(p, k * n);
+  Matrix B = Matrix::Random(p, k * n);
+  Matrix C = Matrix::Random(p, n);
+  Matrix D = Matrix::Random(p, n);
+
+  auto evaluate_kernels = [&]() {
+    Matrix Y = stiefel.projectToManifold(A);
+    Matrix X = oblique.projectToManifold(C);
+    return std::vector<Matrix>{Y, stiefel.projectToTangentSpace(Y, B),
+                               stiefel.BlockDiagProduct(A, B.leftCols(k * n)),
+                               X, oblique.projectToTangentSpace(X, D)};
+  };
+
+  setParallelBackend(ParallelBackend::Serial);
+  std::vector<Matrix> serial_results = evaluate_kernels();
+
+  std::vector<ParallelBackend> backends = {ParallelBackend::Threads};
+#ifdef CORA_USE_OPENMP
+  backends.push_back(ParallelBackend::OpenMP);
+#endif
+  for (ParallelBackend backend : backends) {
+    setParallelBackend(backend);
+    setNumThreads(4);
+    // use chunks that do not evenly divide the number of frames
+    setManifoldGrainSize(7);
+    std::vector<Matrix> parallel_results = evaluate_kernels();
+    for (size_t i = 0; i < serial_results.size(); i++) {
+      CHECK(parallel_results[i] == serial_results[i]);
+    }
+  }
+
+  // every iteration of a parallel loop is run exactly once
+  std::vector<int> num_calls(1000, 0);
+  parallelFor(0, 1000, [&](Index i) { num_calls[i]++; }, 3);
+  CHECK(std::all_of(num_calls.begin(), num_calls.end(),
+                    [](int calls) { return calls == 1; }));
+
+  // exceptions thrown by an iteration are rethrown to the caller
+  CHECK_THROWS_AS(parallelFor(
+                      0, 100,
+                      [](Index i) {
+                        if (i == 42) {
+                          throw std::runtime_error("iteration failed");
+                        }
+                      }),
+                  std::runtime_error);
+
+  setNumThreads(0);
+  setManifoldGrainSize(256);
+#ifdef CORA_USE_OPENMP
+  setParallelBackend(ParallelBackend::OpenMP);
+#else
+  setParallelBackend(ParallelBackend::Serial);
+#endif
+}
+
+TEST_CASE("The Threads backend reuses the threads of its pool",
+          "[parallel]") {
+  setParallelBackend(ParallelBackend::Threads);
+  setNumThreads(3);
+  CHECK(internal::getThreadPool().size() == 2);
+
+  // collects the ids of the threads that run the iterations of a loop
+  auto get_thread_ids = [&]() {
+    std::mutex ids_mutex;
+    std::set<std::thread::id> ids;
+    parallelFor(
+        0, 64,
+        [&](Index) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+          std::lock_guard<std::mutex> lock(ids_mutex);
+          ids.insert(std::this_thread::get_id());
+        },
+        1);
+    ids.erase(std::this_thread::get_id());
+    return ids;
+  };
+  std::set<std::thread::id> first_ids = get_thread_ids();
+  std::set<std::thread::id> all_ids = first_ids;
+  for (int i = 0; i < 5; i++) {
+    std::set<std::thread::id> ids = get_thread_ids();
+    all_ids.insert(ids.begin(), ids.end());
+  }
+  // no threads beyond the two workers of the pool ever ran an iteration
+  CHECK(all_ids.size() <= 2);
+
+  setNumThreads(5);
+  CHECK(internal::getThreadPool().size() == 4);
+  setNumThreads(1);
+  CHECK(internal::getThreadPool().size() == 0);
+  std::vector<int> num_calls(100, 0);
+  parallelFor(0, 100, [&](Index i) { num_calls[i]++; });
+  CHECK(std::all_of(num_calls.begin(), num_calls.end(),
+                    [](int calls) { return calls == 1; }));
+
+  setNumThreads(0);
+#ifdef CORA_USE_OPENMP
+  setParallelBackend(ParallelBackend::OpenMP);
+#else
+  setParallelBackend(ParallelBackend::Serial);
+#endif
+}
+
+TEST_CASE("The parallel settings can change while another thread runs loops",
+          "[parallel]") {
+  setParallelBackend(ParallelBackend::Threads);
+  setNumThreads(2);
+
+  // a loop iteration cannot change the settings, as resizing the pool would
+  // wait for the loop itself
+  CHECK_THROWS_AS(parallelFor(0, 4, [](Index) { setNumThreads(3); }),
+                  std::logic_error);
+
+  // another thread changes the number of threads while loops run; the pool
+  // is only resized between loops, so every loop still runs each iteration
+  // exactly once
+  std::atomic<bool> done(false);
+  std::thread setter([&]() {
+    for (int i = 0; !done; i++) {
+      setNumThreads(2 + i % 3);
+    }
+  });
+  bool all_ran_once = true;
+  for (int loop = 0; loop < 200; loop++) {
+    std::vector<int> num_calls(64, 0);
+    parallelFor(0, 64, [&](Index i) { num_calls[i]++; });
+    all_ran_once = all_ran_once &&
+                   std::all_of(num_calls.begin(), num_calls.end(),
+                               [](int calls) { return calls == 1; });
+  }
+  done = true;
+  setter.join();
+  CHECK(all_ran_once);
+
+  setNumThreads(0);
+#ifdef CORA_USE_OPENMP
+  setParallelBackend(ParallelBackend::OpenMP);
+#else
+  setParallelBackend(ParallelBackend::Serial);
+#endif
+}
+
+TEST_CASE("Manifold operations in the transposed layout match the standard "
+          "layout",
+          "[stiefel][oblique]") {
+  size_t k = GENERATE(2, 3, 4);
+  size_t p = 5;
+  size_t n = 20;
+  StiefelProduct stiefel(k, p, n);
+  ObliqueManifold oblique(p, n);
+
+  // the variables are stored as blocks of the rows of a larger matrix, as in
+  // a CORA Problem
+  Matrix A = Matrix::Random(k * n + n + 3, p);
+  auto rot_rows = A.topRows(k * n);
+  auto range_rows = A.middleRows(k * n, n);
+  Matrix Y_rot = stiefel.projectToManifold(rot_rows.transpose());
+  Matrix Y_range = oblique.projectToManifold(range_rows.transpose());
+  Matrix S = Matrix::Random(k, k * n);
+
+  Matrix P_rot(k * n, p);
+  stiefel.projectTransposedToManifold(rot_rows, P_rot);
+  CHECK_THAT(P_rot, IsApproximatelyEqual<Matrix>(Y_rot.transpose(), 1e-12));
+  Matrix P_range(n, p);
+  oblique.projectTransposedToManifold(range_rows, P_range);
+  CHECK_THAT(P_range,
+             IsApproximatelyEqual<Matrix>(Y_range.transpose(), 1e-12));
+
+  Matrix expected_rot =
+      stiefel.projectToTangentSpace(
+          Y_rot, rot_rows.transpose() -
+                     stiefel.BlockDiagProduct(rot_rows.transpose(), S))
+          .transpose();
+  Matrix expected_range =
+      oblique.projectToTangentSpace(Y_range, range_rows.transpose())
+          .transpose();
+
+  // the tangent space projections may be done in place
+  Matrix A_copy = A;
+  stiefel.subtractTransposedBlockDiagProduct(S, A_copy.topRows(k * n),
+                                             rot_rows);
+  stiefel.projectTransposedToTangentSpace(Y_rot.transpose(), rot_rows,
+                                          rot_rows);
+  oblique.projectTransposedToTangentSpace(Y_range.transpose(), range_rows,
+                                          range_rows);
+  CHECK_THAT(Matrix(rot_rows),
+             IsApproximatelyEqual<Matrix>(expected_rot, 1e-12));
+  CHECK_THAT(Matrix(range_rows),
+             IsApproximatelyEqual<Matrix>(expected_range, 1e-12));
+  CHECK(A.bottomRows(3) == A_copy.bottomRows(3));
+
+  // ... as may the projections onto the manifolds
+  stiefel.projectTransposedToManifold(A_copy.topRows(k * n),
+                                      A_copy.topRows(k * n));
+  oblique.projectTransposedToManifold(A_copy.middleRows(k * n, n),
+                                      A_copy.middleRows(k * n, n));
+  CHECK_THAT(Matrix(A_copy.topRows(k * n)),
+             IsApproximatelyEqual<Matrix>(Y_rot.transpose(), 1e-12));
+  CHECK_THAT(Matrix(A_copy.middleRows(k * n, n)),
+             IsApproximatelyEqual<Matrix>(Y_range.transpose(), 1e-12));
+}
+
+#ifdef CORA_FLOAT_MANIFOLDS
+TEST_CASE("Single-precision manifolds match double precision",
+          "[stiefel][oblique]") {
+  size_t k = GENERATE(2, 3, 4);
+  size_t p = 5;
+  size_t n = 20;
+  StiefelProduct stiefel(k, p, n);
+  ObliqueManifold oblique(p, n);
+  StiefelProductT<float> float_stiefel(k, p, n);
+  ObliqueManifoldT<float> float_oblique(p, n);
+
+  Matrix A = Matrix::Random(k * n, p);
+  Matrix B = Matrix::Random(k * n, p);
+  Matrix C = Matrix::Random(n, p);
+  Matrix D = Matrix::Random(n, p);
+  MatrixT<float> float_A = A.cast<float>();
+  MatrixT<float> float_B = B.cast<float>();
+  MatrixT<float> float_C = C.cast<float>();
+  MatrixT<float> float_D = D.cast<float>();
+
+  Matrix Y_rot(k * n, p), Y_range(n, p);
+  stiefel.projectTransposedToManifold(A, Y_rot);
+  oblique.projectTransposedToManifold(C, Y_range);
+  MatrixT<float> float_Y_rot(k * n, p), float_Y_range(n, p);
+  float_stiefel.projectTransposedToManifold(float_A, float_Y_rot);
+  float_oblique.projectTransposedToManifold(float_C, float_Y_range);
+  CHECK_THAT(Matrix(float_Y_rot.cast<Scalar>()),
+             IsApproximatelyEqual<Matrix>(Y_rot, 1e-5));
+  CHECK_THAT(Matrix(float_Y_range.cast<Scalar>()),
+             IsApproximatelyEqual<Matrix>(Y_range, 1e-5));
+
+  stiefel.projectTransposedToTangentSpace(Y_rot, B, B);
+  oblique.projectTransposedToTangentSpace(Y_range, D, D);
+  float_stiefel.projectTransposedToTangentSpace(float_Y_rot, float_B,
+                                                float_B);
+  float_oblique.projectTransposedToTangentSpace(float_Y_range, float_D,
+                                                float_D);
+  CHECK_THAT(Matrix(float_B.cast<Scalar>()),
+             IsApproximatelyEqual<Matrix>(B, 1e-5));
+  CHECK_THAT(Matrix(float_D.cast<Scalar>()),
+             IsApproximatelyEqual<Matrix>(D, 1e-5));
+}
+#endif
+
 } // namespace CORA
@@ -7,6 +7,7 @@
 
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/matchers/catch_matchers.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
 
 namespace CORA {
 
@@ -35,6 +36,16 @@ void checkHelperFunctions(std::string data_subdir) {
   Matrix Hvp = prob.Riemannian_Hessian_vector_product(x0, Egrad, rand_dX);
   Matrix expectedHessProd = getExpectedHessProd(data_subdir);
   CHECK_THAT(Hvp, IsApproximatelyEqual(expectedHessProd, 1e-6));
+
+  // Q*Y is cached between evaluations at the same point, so moving to a new
+  // point must not reuse it
+  Matrix x1 = x0 + rand_dX;
+  Matrix expectedEgradX1 = prob.getDataMatrix() * x1;
+  CHECK_THAT(prob.evaluateObjective(x1),
+             Catch::Matchers::WithinRel(
+                 0.5 * (x1.transpose() * expectedEgradX1).trace(), 1e-9));
+  CHECK_THAT(prob.Euclidean_gradient(x1),
+             IsApproximatelyEqual(expectedEgradX1, 1e-6));
 }
 
 TEST_CASE("optimizer helpers RA-SLAM", "[opt-helpers::small_ra_slam_problem]") {
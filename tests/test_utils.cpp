@@ -183,6 +183,17 @@ Problem getProblem(std::string data_subdir) {
   return problem;
 }
 
+Problem getUpdatedProblem(Formulation formulation,
+                          const std::function<void(Problem &)> &configure) {
+  Problem problem = getProblem("small_ra_slam_problem");
+  problem.setFormulation(formulation);
+  if (configure) {
+    configure(problem);
+  }
+  problem.updateProblemData();
+  return problem;
+}
+
 Matrix getRandInit(std::string data_subdir) {
   std::string init_path = getTestDataFpath(data_subdir, "X_rand_dim2.mm");
   Matrix x0 = readMatrixMarketFile(init_path).toDense();
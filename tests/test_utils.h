@@ -8,6 +8,7 @@
 
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <string>
 
@@ -115,6 +116,11 @@ std::string checkSubmatricesAreCorrect(Problem prob,
 
 // load problem data
 Problem getProblem(std::string data_subdir);
+// the small RA-SLAM problem in the given formulation, with its data updated
+// after the (optional) configure function has set its other options
+Problem getUpdatedProblem(Formulation formulation,
+                          const std::function<void(Problem &)> &configure =
+                              nullptr);
 Matrix getRandInit(std::string data_subdir);
 Matrix getGroundTruthState(std::string data_subdir);
 Matrix getRandDX(std::string data_subdir);